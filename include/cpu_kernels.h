@@ -0,0 +1,73 @@
+#ifndef CPU_KERNELS_H
+#define CPU_KERNELS_H
+
+#include <cstdint>
+#include <vector>
+
+namespace godot {
+
+/**
+ * 热点像素内核函数表
+ * 同一份标量实现按不同编译选项编译多次，由编译器自动向量化，运行时根据CPU特性选择其中一份
+ */
+struct CpuKernelTable {
+    const char* name;   // 变体名称：generic、avx2
+
+    // 对每个像素的指定通道加上delta并饱和到0-255（颜色变化）
+    void (*add_channel_saturate)(uint8_t* pixels, int count, int channels, int channel, int delta);
+
+    // 颜色通道与灰度纹理按alpha混合：p = (1-alpha)*p + alpha*gray（纹理变化）
+    // 颜色通道数由通道数决定：带alpha的布局（2、4）最后一个通道为alpha，不修改
+    void (*blend_gray)(uint8_t* pixels, const uint8_t* gray, int count, int channels, float alpha);
+
+    // 颜色通道与固定颜色按逐像素不透明度混合，权重为alpha*coverage/255（添加物体）
+    void (*blend_color_coverage)(uint8_t* pixels, const uint8_t* coverage, int count, int channels,
+                                 const float* color, float alpha);
+
+    // 颜色通道与RGBA精灵按精灵alpha混合，灰度布局使用精灵的亮度（贴纸）
+    void (*blend_sprite)(uint8_t* pixels, const uint8_t* sprite, int count, int channels, float alpha);
+
+    // mask非零的像素颜色通道向远离中间灰的方向移动delta并饱和（细微图案）
+    void (*push_contrast_masked)(uint8_t* pixels, const uint8_t* mask, int count, int channels, int delta);
+
+    // 逐像素取各通道绝对差的最大值（谜题校验）
+    void (*max_abs_diff)(const uint8_t* a, const uint8_t* b, uint8_t* out, int count, int channels);
+
+    // RGBA去掉alpha得到RGB（检测器输入预处理）
+    void (*rgba_to_rgb)(const uint8_t* src, uint8_t* dst, int count);
+
+    // L8/LA8的亮度复制到RGB三个通道（检测器输入预处理），channels为1或2
+    void (*gray_to_rgb)(const uint8_t* src, uint8_t* dst, int count, int channels);
+};
+
+/**
+ * CPU特性
+ */
+struct CpuFeatures {
+    bool avx2;          // x86_64 AVX2
+    bool fma;           // x86_64 FMA3
+    bool neon;          // ARM Advanced SIMD
+    bool dotprod;       // ARMv8.2 点积指令
+    bool fp16;          // ARMv8.2 半精度浮点SIMD
+};
+
+/**
+ * 获取当前使用的内核函数表
+ * 首次调用（库加载时）根据CPU特性选择；设置环境变量DIFF_DETECTOR_CPU可强制指定变体，
+ * 指定的变体不可用时向stderr输出警告
+ */
+const CpuKernelTable& get_cpu_kernels();
+
+/**
+ * 获取检测到的CPU特性
+ */
+const CpuFeatures& get_cpu_features();
+
+/**
+ * 获取本库中编译进来且当前CPU支持的变体
+ */
+std::vector<const CpuKernelTable*> get_available_cpu_kernels();
+
+} // namespace godot
+
+#endif // CPU_KERNELS_H
@@ -0,0 +1,145 @@
+#ifndef DAEMON_PROTOCOL_H
+#define DAEMON_PROTOCOL_H
+
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <cstddef>
+#include <opencv2/core.hpp>
+#include "diff_generator.h"
+#include "puzzle_pack.h"
+
+namespace godot {
+
+/*
+ * 谜题生成守护进程协议（Unix域套接字，小端）
+ *
+ * 每条消息为DaemonMessageHeader加负载，客户端可在一个连接上连续发送多个请求，
+ * 响应按请求顺序返回并带回相同的request_id。
+ *
+ *   DAEMON_MESSAGE_GENERATE  请求：DaemonGenerateRequest + 图像文件字节（JPEG/PNG等）
+ *   DAEMON_MESSAGE_PUZZLE    响应：DaemonPuzzleHeader + PackDiffRecord[diff_count] + 数据块
+ *   DAEMON_MESSAGE_ERROR     响应：UTF-8错误信息
+ *   DAEMON_MESSAGE_STATS     请求：无负载；响应：JSON文本
+ *   DAEMON_MESSAGE_BUSY      连接数已满时在读取任何请求前发送（request_id为0），随后关闭连接；负载为UTF-8说明
+ *
+ * 谜题响应复用谜题包的差异记录和数据块编码，数据块偏移相对于负载起始位置。
+ * 配方模式（DAEMON_RESULT_RECIPE）只返回差异记录，客户端按记录中的算法、强度系数和随机种子
+ * 用reapply_diff在原图上重放；补丁模式返回每个差异区域修改后的像素。
+ */
+
+constexpr char DAEMON_MAGIC[4] = { 'D', 'D', 'M', 'N' };
+constexpr uint32_t DAEMON_PROTOCOL_VERSION = 1;
+constexpr uint64_t DAEMON_MAX_PAYLOAD = 256ull * 1024 * 1024;
+constexpr const char* DAEMON_DEFAULT_SOCKET = "/tmp/diff_detector.sock";
+
+enum DaemonMessageType : uint32_t {
+    DAEMON_MESSAGE_GENERATE = 1,
+    DAEMON_MESSAGE_PUZZLE = 2,
+    DAEMON_MESSAGE_ERROR = 3,
+    DAEMON_MESSAGE_STATS = 4,
+    DAEMON_MESSAGE_BUSY = 5
+};
+
+enum DaemonResultMode : uint32_t {
+    DAEMON_RESULT_RECIPE = 0,   // 只返回差异记录（每个差异80字节）
+    DAEMON_RESULT_PATCHES = 1   // 同时返回区域补丁（PNG，LA8为原始像素）
+};
+
+// DaemonGenerateRequest::flags
+constexpr uint32_t DAEMON_REQUEST_SEED = 1;             // 使用请求中的随机种子
+
+// DaemonPuzzleHeader::flags
+constexpr uint32_t DAEMON_PUZZLE_DETECTION_CACHED = 1;  // 检测结果来自缓存
+constexpr uint32_t DAEMON_PUZZLE_DETECTED = 2;          // 守护进程加载了模型并做了检测
+
+#pragma pack(push, 1)
+
+struct DaemonMessageHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t type;              // DaemonMessageType
+    uint32_t request_id;
+    uint64_t payload_size;
+};
+
+struct DaemonGenerateRequest {
+    uint32_t diff_count;
+    uint32_t difficulty;
+    uint32_t result_mode;       // DaemonResultMode
+    uint32_t flags;
+    uint32_t seed;
+    float time_budget_ms;       // <=0表示不限制
+    uint8_t reserved[8];
+};
+
+struct DaemonPuzzleHeader {
+    uint32_t width;
+    uint32_t height;
+    uint32_t channels;          // 1-4，补丁与重放使用的像素布局
+    uint32_t difficulty;        // 重放时传给reapply_diff
+    uint32_t diff_count;
+    uint32_t result_mode;
+    uint32_t flags;
+    float decode_ms;
+    float detect_ms;            // 包括等待批量推理的时间
+    float generate_ms;
+    uint8_t reserved[8];
+};
+
+#pragma pack(pop)
+
+/**
+ * 解析后的谜题响应
+ */
+struct DaemonPuzzle {
+    DaemonPuzzleHeader header;
+    std::vector<DiffInfo> diffs;
+    std::vector<cv::Mat> patches;   // 补丁模式下与diffs一一对应，配方模式为空
+};
+
+/**
+ * 发送一条消息（处理部分写入和EINTR）
+ */
+bool daemon_write_message(int fd, uint32_t type, uint32_t request_id, const void* payload, size_t size);
+
+/**
+ * 接收一条消息，校验魔数、版本和负载上限
+ * @return 成功返回true，连接关闭或消息无效返回false
+ */
+bool daemon_read_message(int fd, DaemonMessageHeader& header, std::vector<uint8_t>& payload);
+
+/**
+ * 在路径上监听
+ * 路径已存在时只在它是没有进程监听的遗留套接字时删除；是普通文件或已有守护进程在监听时失败
+ * @param error 失败原因
+ * @return 套接字描述符，失败返回-1
+ */
+int daemon_listen(const std::string& path, int backlog, std::string& error);
+
+/**
+ * 连接到守护进程
+ * @return 套接字描述符，失败返回-1
+ */
+int daemon_connect(const std::string& path);
+
+void daemon_close(int fd);
+
+/**
+ * 编码谜题响应负载
+ * @param header 谜题头，diff_count由写入的差异数决定
+ * @param diffs 差异信息，补丁模式下改用encoded中裁剪后的差异
+ * @param encoded 补丁模式下由PuzzlePackWriter::encode_puzzle得到的编码结果，配方模式为空
+ * @param payload 输出的负载
+ */
+void encode_daemon_puzzle(const DaemonPuzzleHeader& header, const std::vector<DiffInfo>& diffs,
+                          const EncodedPuzzle* encoded, std::vector<uint8_t>& payload);
+
+/**
+ * 解析谜题响应负载并解码补丁
+ */
+bool decode_daemon_puzzle(const std::vector<uint8_t>& payload, DaemonPuzzle& puzzle);
+
+} // namespace godot
+
+#endif // DAEMON_PROTOCOL_H
@@ -0,0 +1,118 @@
+#ifndef DETECTION_SET_H
+#define DETECTION_SET_H
+
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include <opencv2/core.hpp>
+
+namespace godot {
+
+/**
+ * 只读连续数组视图，不持有数据
+ */
+template <typename T>
+class ConstSpan {
+public:
+    ConstSpan() : ptr(nullptr), count(0) {}
+    ConstSpan(const T* data, size_t size) : ptr(data), count(size) {}
+
+    const T* data() const { return ptr; }
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+    const T* begin() const { return ptr; }
+    const T* end() const { return ptr + count; }
+    const T& operator[](size_t index) const { return ptr[index]; }
+
+private:
+    const T* ptr;
+    size_t count;
+};
+
+/**
+ * 单个检测物体的只读视图，引用DetectionSet中的数据
+ * DetectionSet被修改或销毁后失效
+ */
+struct DetectionView {
+    int class_id;                  // 类别ID
+    float confidence;              // 置信度
+    const cv::Rect& bounding_box;  // 边界框
+    ConstSpan<cv::Point> points;   // 分割点集
+};
+
+/**
+ * 检测结果集合（数组结构）
+ * 类别、置信度和边界框各自连续存放，所有分割点放在同一块点数组中，按偏移划分到各物体。
+ * 清空时保留容量，重复检测不再为每个物体分配内存，复制整个集合也只需复制几个数组。
+ */
+class DetectionSet {
+public:
+    class Iterator {
+    public:
+        Iterator(const DetectionSet* set, size_t index) : set(set), index(index) {}
+        DetectionView operator*() const { return (*set)[index]; }
+        Iterator& operator++() { index++; return *this; }
+        bool operator!=(const Iterator& other) const { return index != other.index; }
+
+    private:
+        const DetectionSet* set;
+        size_t index;
+    };
+
+    DetectionSet();
+    ~DetectionSet();
+
+    /**
+     * 清空结果，保留已分配的容量
+     */
+    void clear();
+
+    /**
+     * 预留容量
+     * @param objects 物体数量
+     * @param points 分割点总数
+     */
+    void reserve(size_t objects, size_t points);
+
+    /**
+     * 追加一个物体，之后调用add_point追加的点属于该物体
+     */
+    void add(int class_id, float confidence, const cv::Rect& bounding_box);
+    void add_point(const cv::Point& point);
+
+    /**
+     * 将所有边界框和分割点按比例缩放并限制在指定尺寸内
+     * 用于把缩小图像上的检测结果映射回全分辨率坐标
+     */
+    void scale(double scale_x, double scale_y, const cv::Size& size);
+
+    size_t size() const { return class_ids.size(); }
+    bool empty() const { return class_ids.empty(); }
+
+    DetectionView operator[](size_t index) const {
+        return { class_ids[index], confidences[index], boxes[index],
+                 ConstSpan<cv::Point>(points.data() + offsets[index], offsets[index + 1] - offsets[index]) };
+    }
+    Iterator begin() const { return Iterator(this, 0); }
+    Iterator end() const { return Iterator(this, size()); }
+
+    // 按数组访问，下标与物体一一对应
+    ConstSpan<int> get_class_ids() const { return ConstSpan<int>(class_ids.data(), class_ids.size()); }
+    ConstSpan<float> get_confidences() const { return ConstSpan<float>(confidences.data(), confidences.size()); }
+    ConstSpan<cv::Rect> get_boxes() const { return ConstSpan<cv::Rect>(boxes.data(), boxes.size()); }
+
+    // 所有物体的分割点，物体i的点为[offsets[i], offsets[i + 1])，偏移数组长度为size() + 1
+    ConstSpan<cv::Point> get_points() const { return ConstSpan<cv::Point>(points.data(), points.size()); }
+    ConstSpan<uint32_t> get_point_offsets() const { return ConstSpan<uint32_t>(offsets.data(), offsets.size()); }
+
+private:
+    std::vector<int> class_ids;
+    std::vector<float> confidences;
+    std::vector<cv::Rect> boxes;
+    std::vector<cv::Point> points;
+    std::vector<uint32_t> offsets;
+};
+
+} // namespace godot
+
+#endif // DETECTION_SET_H
@@ -0,0 +1,131 @@
+#ifndef DIFF_ASSET_CACHE_H
+#define DIFF_ASSET_CACHE_H
+
+#include <vector>
+#include <map>
+#include <cstddef>
+#include <cstdint>
+#include <opencv2/core.hpp>
+
+namespace godot {
+
+// 添加物体使用的内置形状
+enum DiffShapeType {
+    DIFF_SHAPE_CIRCLE = 0,
+    DIFF_SHAPE_RECTANGLE = 1,
+    DIFF_SHAPE_TRIANGLE = 2,
+    DIFF_SHAPE_COUNT = 3
+};
+
+/**
+ * 差异算法的程序化素材缓存
+ * 纹理块、细微图案遮罩和抗锯齿形状精灵按（类型、尺寸档位、难度、变体）在首次使用时生成，
+ * 之后算法只需把缓存的素材混合到ROI中。素材内容只由键决定（以键为随机种子生成），
+ * 与生成顺序和缓存是否被清空无关，因此按种子重放差异时结果不变。
+ * 非线程安全，每个DiffGenerator持有一份。
+ */
+class DiffAssetCache {
+public:
+    static constexpr int VARIANT_COUNT = 4;     // 每个键的随机变体数量
+
+    DiffAssetCache();
+    ~DiffAssetCache();
+
+    /**
+     * 纹理块（CV_8UC1灰度方格），边长为不小于size的尺寸档位
+     * @param size 需要覆盖的边长
+     * @param difficulty 难度级别，决定方格大小
+     * @param variant 变体 [0, VARIANT_COUNT)
+     */
+    const cv::Mat& get_texture_tile(int size, int difficulty, int variant);
+
+    /**
+     * 细微图案遮罩（CV_8UC1，被选中的像素为255），边长为不小于size的尺寸档位
+     */
+    const cv::Mat& get_pattern_mask(int size, int difficulty, int variant);
+
+    /**
+     * 抗锯齿形状精灵（CV_8UC1不透明度），边长为最接近size的尺寸档位
+     * @param shape DiffShapeType
+     * @param size 形状外接正方形的边长
+     */
+    const cv::Mat& get_shape_sprite(int shape, int size);
+
+    /**
+     * 缩放到指定尺寸档位的贴纸（CV_8UC4，RGBA），长边为最接近size的尺寸档位
+     * @param index 贴纸下标
+     * @param size 长边
+     */
+    const cv::Mat& get_sticker(int index, int size);
+
+    /**
+     * 添加用户贴纸
+     * @param rgba RGBA8图像，缓存保存一份副本
+     * @return 贴纸下标
+     */
+    int add_sticker(const cv::Mat& rgba);
+    void clear_stickers();
+    int get_sticker_count() const;
+
+    /**
+     * 贴纸原图，添加后不再修改，可在缓存之间共享
+     */
+    const std::vector<cv::Mat>& get_stickers() const;
+
+    /**
+     * 替换为另一缓存的贴纸（共享原图数据），与当前贴纸不同时清空已缩放的素材
+     */
+    void set_stickers(const std::vector<cv::Mat>& source);
+
+    /**
+     * 设置生成素材的内存预算（字节，不含贴纸原图），超出时清空已生成的素材
+     */
+    void set_memory_budget(size_t bytes);
+    size_t get_memory_budget() const;
+    size_t get_memory_usage() const;
+
+    /**
+     * 清空已生成的素材（保留贴纸）
+     */
+    void clear();
+
+    /**
+     * 向上取尺寸档位：每个2的幂区间分为8档，档位与实际尺寸相差不超过约12%
+     */
+    static int size_bucket_up(int size);
+
+    /**
+     * 取最接近的尺寸档位
+     */
+    static int size_bucket_nearest(int size);
+
+private:
+    enum AssetType {
+        ASSET_TEXTURE_TILE = 0,
+        ASSET_PATTERN_MASK = 1,
+        ASSET_SHAPE_SPRITE = 2,
+        ASSET_STICKER = 3
+    };
+
+    struct AssetKey {
+        int type;
+        int size;
+        int param;      // 难度、形状或贴纸下标
+        int variant;
+
+        bool operator<(const AssetKey& other) const;
+        uint32_t seed() const;
+    };
+
+    std::map<AssetKey, cv::Mat> assets;
+    std::vector<cv::Mat> stickers;
+    size_t memory_usage;
+    size_t memory_budget;
+
+    const cv::Mat* find(const AssetKey& key) const;
+    const cv::Mat& store(const AssetKey& key, cv::Mat asset);
+};
+
+} // namespace godot
+
+#endif // DIFF_ASSET_CACHE_H
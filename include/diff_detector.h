@@ -4,22 +4,27 @@
 #include <godot_cpp/classes/image.hpp>
 #include <godot_cpp/classes/ref.hpp>
 #include <godot_cpp/variant/array.hpp>
+#include <godot_cpp/variant/callable.hpp>
 #include <godot_cpp/variant/dictionary.hpp>
 #include <opencv2/core.hpp>
+#include <chrono>
+#include <condition_variable>
 #include <memory>
+#include <mutex>
+
+#include "diff_generator.h"
+#include "instance_label_map.h"
+#include "memory_governor.h"
+#include "stream_session.h"
 
 namespace godot {
 
 // 前向声明
 class DiffGenerator;
 class YoloDetector;
-
-// 差异点信息结构
-struct DiffInfo {
-    Vector2 position;   // 坐标
-    float size;         // 大小
-    int algorithm_id;   // 使用的差异算法ID
-};
+class PuzzlePrefetcher;
+class PuzzleValidator;
+class StreamSession;
 
 // 主要GDExtension类
 class DiffDetector : public RefCounted {
@@ -28,6 +33,13 @@ class DiffDetector : public RefCounted {
 private:
     std::unique_ptr<DiffGenerator> diff_generator;
     std::unique_ptr<YoloDetector> yolo_detector;
+    std::unique_ptr<PuzzlePrefetcher> prefetcher;
+    std::unique_ptr<PuzzleValidator> validator;
+    std::unique_ptr<StreamSession> stream_session;
+    std::mutex detector_mutex;  // 保护下面的检测器占用状态
+    std::condition_variable detector_condition;
+    bool detector_busy;         // 检测器正在推理
+    int foreground_waiting;     // 等待检测器的前台请求数，非零时预取线程让出
     
     // 差异生成参数
     int diff_count;     // 差异点数量
@@ -35,6 +47,47 @@ private:
 
     std::vector<DiffInfo> generated_diffs; // 生成的差异信息
 
+    // 单个差异重新生成所需的状态
+    cv::Mat original_working;                       // 差异应用前的工作缓冲区
+    cv::Mat working_image;                          // 当前应用了差异的工作缓冲区
+    DetectionSet cached_detections;                 // 上次检测结果
+    InstanceLabelMap label_map;                     // 由上次检测结果构建的实例标签图
+    Image::Format output_format;                    // 输出图像格式，与工作缓冲区的像素布局一致
+
+    StreamFrameStats stream_stats;                  // 最近一帧流式处理的统计
+
+    MemoryGovernor memory_governor;                 // 单次生成的内存预算与实际用量
+    MemoryPlan memory_plan;                         // 上次生成采用的内存策略
+    cv::Size planned_source_size;                   // 本次调用的源图像尺寸，由plan_memory记录
+
+    // generated_diffs的坐标所在的图像，代理策略下用于把差异坐标换算回源图像
+    cv::Size diff_source_size;                      // 源图像尺寸
+    cv::Size diff_image_size;                       // 生成差异的工作图像（即输出图像）尺寸
+    int diff_scale;                                 // 代理缩小倍数，其它策略为1
+
+    // 独占共享检测器：前台请求排在所有等待中的预取请求之前
+    void acquire_detector(bool foreground);
+    void release_detector();
+
+    // 在共享检测器上运行检测（线程安全），预取线程传入foreground=false
+    bool run_detection(const cv::Mat& image, DetectionSet& detections, bool foreground = true);
+
+    // 按原始像素布局复制Godot图像为自有内存的工作缓冲区，不支持的格式返回false
+    static bool create_working_image(const Ref<Image>& image, cv::Mat& working);
+
+    // 按内存预算选择策略，任何策略都超出预算时报错并返回false
+    bool plan_memory(const MemoryPlanInput& input);
+
+    // 按当前内存策略运行检测：全分辨率转换为RGB，或由源布局缩小后检测并映射回工作图像
+    bool run_planned_detection(const cv::Mat& image, DetectionSet& detections);
+
+    // 释放上次生成保留的reroll_diff状态
+    void release_generation_state();
+
+    // 在工作缓冲区上生成差异并保存reroll_diff所需的状态（仅标准策略），失败返回false
+    bool generate_on_working(cv::Mat& cv_image, const DetectionSet& detections, Image::Format format,
+                             std::chrono::steady_clock::time_point start_time, double time_budget_ms);
+
 protected:
     static void _bind_methods();
 
@@ -42,10 +95,63 @@ public:
     DiffDetector();
     ~DiffDetector();
 
+    // 与PuzzlePackLoader共用的转换辅助函数
+
+    // 将差异信息转换为GDScript字典
+    static Dictionary create_diff_dictionary(const DiffInfo& diff);
+
+    // 支持的图像格式对应的通道数，不支持的格式返回0
+    static int get_format_channels(Image::Format format);
+    static Image::Format get_channels_format(int channels);
+
+    // 将工作缓冲区的指定区域复制为指定格式的Godot图像
+    static Ref<Image> create_output_image(const cv::Mat& image, const cv::Rect& region, Image::Format format);
+
     // Godot接口方法
     bool initialize();
-    Ref<Image> generate_diff_image(const Ref<Image>& source_image, int diff_count, int difficulty);
+    Ref<Image> generate_diff_image(const Ref<Image>& source_image, int diff_count, int difficulty, double time_budget_ms = 0.0);
+    Ref<Image> generate_diff_from_buffer(const PackedByteArray& buffer, int diff_count, int difficulty, double time_budget_ms = 0.0);
     Array get_diff_data() const;
+    Dictionary get_detection_data() const;
+    Dictionary reroll_diff(int index, const Dictionary& options);
+    Dictionary validate_puzzle(const Ref<Image>& original_image, const Ref<Image>& modified_image,
+                               const Array& diff_data, const Dictionary& options);
+    
+    // 后台预取
+    bool prefetch_level(int64_t level_id, const Ref<Image>& source_image, int diff_count, int difficulty);
+    Dictionary take_prefetched(int64_t level_id);
+    Ref<Image> apply_puzzle_patches(const Ref<Image>& source_image, const Dictionary& puzzle) const;
+    bool is_prefetched(int64_t level_id) const;
+    void cancel_prefetch(int64_t level_id);
+    void cancel_all_prefetch();
+    int get_prefetch_pending_count() const;
+    int64_t get_prefetch_memory_usage() const;
+    void set_prefetch_memory_budget(int64_t bytes);
+    int64_t get_prefetch_memory_budget() const;
+    
+    // 单次生成的内存预算
+    void set_memory_budget(int64_t bytes);
+    int64_t get_memory_budget() const;
+    Dictionary get_memory_report() const;
+    
+    // 视频流/摄像头帧
+    void start_stream(int diff_count, int difficulty, const Dictionary& options);
+    Ref<Image> process_stream_frame(const Ref<Image>& frame);
+    Array get_stream_diff_data() const;
+    Dictionary get_stream_stats() const;
+    void stop_stream();
+    
+    // 自定义差异算法
+    int register_diff_algorithm(const String& name, int min_difficulty, int max_difficulty, const Callable& kernel);
+    bool unregister_diff_algorithm(int algorithm_id);
+    void set_algorithm_enabled(int algorithm_id, bool enabled);
+    Array get_algorithm_list() const;
+    Dictionary get_cpu_features() const;
+    
+    // 添加物体使用的用户贴纸
+    int add_sticker(const Ref<Image>& sticker);
+    void clear_stickers();
+    int get_sticker_count() const;
     
     // 设置/获取参数
     void set_diff_count(int count);
@@ -53,6 +159,9 @@ public:
     
     void set_difficulty(int diff);
     int get_difficulty() const;
+    
+    void set_calibration_iterations(int iterations);
+    int get_calibration_iterations() const;
 };
 
 }  // namespace godot
@@ -4,10 +4,13 @@
 #include <vector>
 #include <string>
 #include <random>
-#include <map>
 #include <functional>
+#include <cstdint>
 #include <opencv2/core.hpp>
 #include "yolo_detector.h"
+#include "diff_asset_cache.h"
+
+namespace godot {
 
 // 差异类型枚举
 enum DiffType {
@@ -20,15 +23,64 @@ enum DiffType {
     DIFF_ROTATION = 6,
     DIFF_FLIP = 7,
     DIFF_BLUR = 8,
-    DIFF_ADDITION = 9
+    DIFF_ADDITION = 9,
+    DIFF_TYPE_COUNT = 10        // 内置算法数量，自定义算法ID从此开始
+};
+
+// 像素布局枚举，值+1即通道数
+enum PixelLayoutType {
+    PIXEL_LAYOUT_L8 = 0,
+    PIXEL_LAYOUT_LA8 = 1,
+    PIXEL_LAYOUT_RGB8 = 2,
+    PIXEL_LAYOUT_RGBA8 = 3,
+    PIXEL_LAYOUT_COUNT = 4
 };
 
 // 差异信息结构体
 struct DiffInfo {
     cv::Point position;         // 差异位置
     cv::Size size;              // 差异大小
-    DiffType algorithm_id;      // 使用的算法ID
+    int algorithm_id;           // 使用的算法ID（内置为DiffType，自定义>=DIFF_TYPE_COUNT）
     cv::Rect region;            // 差异区域
+    float perceptual_score;     // 区域内实测的平均ΔE（Lab）
+    float intensity_scale;      // 校准后使用的强度系数
+    uint32_t seed;              // 算法使用的随机种子，重放时据此复现相同的随机参数
+};
+
+/**
+ * 差异算法元数据
+ */
+struct DiffAlgorithmInfo {
+    const char* name;           // 算法名称
+    int min_difficulty;         // 适用的最低难度
+    int max_difficulty;         // 适用的最高难度
+    float cost_per_pixel;       // 每像素相对开销估计（颜色变化为1.0）
+    bool needs_mask;            // 是否需要构建遮罩
+    bool scalable;              // 强度是否随intensity_scale调整（可参与感知校准）
+};
+
+class InstanceLabelMap;
+
+// 自定义差异算法函数
+using CustomDiffKernel = std::function<void(cv::Mat&, const cv::Rect&, int, DiffInfo&)>;
+
+/**
+ * 生成器的用户配置快照：自定义算法、算法启用状态、感知校准次数和贴纸
+ * 用于让其它线程上的生成器与之生成相同的谜题；随机数状态和开销模型不包含在内
+ */
+struct DiffGeneratorConfig {
+    struct CustomAlgorithmConfig {
+        std::string name;
+        int min_difficulty;
+        int max_difficulty;
+        float cost_per_pixel;
+        CustomDiffKernel kernel;    // 为空表示该槽位已注销，保持算法ID不变
+    };
+
+    std::vector<CustomAlgorithmConfig> custom_algorithms;   // 下标为 id - DIFF_TYPE_COUNT
+    std::vector<bool> algorithm_enabled;                    // 每个算法ID的启用状态
+    int calibration_iterations;
+    std::vector<cv::Mat> stickers;                          // RGBA8贴纸原图，与源生成器共享数据
 };
 
 /**
@@ -40,39 +92,242 @@ public:
     DiffGenerator();
     ~DiffGenerator();
 
+    /**
+     * 重新设置随机种子，使之后的生成结果可复现（默认以当前时间为种子）
+     * @param seed 随机种子
+     */
+    void set_seed(uint32_t seed);
+
     /**
      * 生成图像差异
      * @param image 原始图像
+     * @param detections 检测到的物体
      * @param diff_count 差异数量
      * @param difficulty 难度级别 (1-10)
-     * @param detections 检测到的物体
      * @param diff_info 输出的差异信息
+     * @param time_budget_ms 时间预算（毫秒），<=0表示不限制
+     * @param labels 与image同尺寸的实例标签图，非空时落在物体上的差异只修改物体自身的像素
+     * @return 成功返回true，失败返回false
+     */
+    bool generate_diffs(cv::Mat& image, const DetectionSet& detections,
+                      int diff_count, int difficulty,
+                      std::vector<DiffInfo>& diff_info,
+                      double time_budget_ms = 0.0,
+                      const InstanceLabelMap* labels = nullptr);
+
+    /**
+     * 从整次调用的时间预算中扣除解码和检测已消耗的时间，得到generate_diffs的预算
+     * @return 不限制时为0；预算已耗尽时为极小的正值，只生成保底差异
+     */
+    static double remaining_time_budget(double time_budget_ms, double elapsed_ms);
+
+    /**
+     * 重新生成单个差异，只处理该差异所在区域
+     * @param image 已应用差异的图像
+     * @param original 应用差异前的原始图像
+     * @param detections 检测到的物体
+     * @param index 要重新生成的差异下标
+     * @param difficulty 难度级别 (1-10)
+     * @param algorithm_id 指定算法ID，<0表示随机选择与之前不同的算法
+     * @param new_region 是否为该差异选择新的区域
+     * @param diff_info 差异信息，index处的条目会被更新
+     * @param labels 与image同尺寸的实例标签图，可为空
      * @return 成功返回true，失败返回false
      */
-    bool generate_diffs(cv::Mat& image, int diff_count, int difficulty, 
-                      const std::vector<DetectedObject>& detections,
-                      std::vector<DiffInfo>& diff_info);
+    bool reroll_diff(cv::Mat& image, const cv::Mat& original,
+                   const DetectionSet& detections,
+                   int index, int difficulty, int algorithm_id, bool new_region,
+                   std::vector<DiffInfo>& diff_info,
+                   const InstanceLabelMap* labels = nullptr);
+
+    /**
+     * 按已有差异的参数（算法、强度系数、随机种子）在新图像上重放该差异，不做校准
+     * 用于视频流中把同一差异逐帧应用到跟踪后的区域，保持时间上的稳定
+     * @param image 要应用差异的图像
+     * @param info 差异信息，区域为要应用的位置
+     * @param difficulty 难度级别 (1-10)
+     * @return 成功返回true，区域不在图像内或布局不支持时返回false
+     */
+    bool reapply_diff(cv::Mat& image, const DiffInfo& info, int difficulty);
+
+    /**
+     * 注册自定义差异算法
+     * @param name 算法名称
+     * @param min_difficulty 适用的最低难度
+     * @param max_difficulty 适用的最高难度
+     * @param cost_per_pixel 每像素相对开销估计
+     * @param kernel 算法函数
+     * @return 分配的算法ID（>=DIFF_TYPE_COUNT），失败返回-1
+     */
+    int register_algorithm(const std::string& name, int min_difficulty, int max_difficulty,
+                         float cost_per_pixel, CustomDiffKernel kernel);
+
+    /**
+     * 注销自定义差异算法
+     * @param algorithm_id register_algorithm返回的ID
+     * @return 成功返回true，内置算法或无效ID返回false
+     */
+    bool unregister_algorithm(int algorithm_id);
+
+    /**
+     * 启用或禁用算法（禁用后不再被随机选中）
+     * @param algorithm_id 算法ID
+     * @param enabled 是否启用
+     */
+    void set_algorithm_enabled(int algorithm_id, bool enabled);
+
+    /**
+     * 获取算法元数据
+     * @param algorithm_id 算法ID
+     * @return 元数据指针，无效ID返回nullptr
+     */
+    const DiffAlgorithmInfo* get_algorithm_info(int algorithm_id) const;
+
+    /**
+     * 获取已注册的算法总数（内置+自定义槽位）
+     */
+    int get_algorithm_count() const;
+
+    /**
+     * 获取程序化素材缓存（纹理块、图案遮罩、形状精灵和用户贴纸）
+     */
+    DiffAssetCache& get_asset_cache();
+    const DiffAssetCache& get_asset_cache() const;
+
+    /**
+     * 设置感知校准的最大迭代次数
+     * @param iterations 迭代次数，0表示关闭校准
+     */
+    void set_calibration_iterations(int iterations);
+    int get_calibration_iterations() const;
+
+    /**
+     * 获取当前用户配置的快照
+     */
+    DiffGeneratorConfig get_config() const;
+
+    /**
+     * 应用另一生成器的配置快照，之后的生成使用相同的算法、启用状态、校准次数和贴纸
+     * 已有算法ID的开销模型保留，新增的自定义算法按其相对开销初始化
+     */
+    void apply_config(const DiffGeneratorConfig& config);
+
+    /**
+     * 难度对应的目标感知强度（区域内平均ΔE）
+     * @param difficulty 难度级别 (1-10)
+     */
+    static float target_delta_e(int difficulty);
+
+    /**
+     * 根据图像类型确定像素布局
+     * @param image 图像
+     * @param layout 输出的像素布局
+     * @return 8位1-4通道图像返回true，否则返回false
+     */
+    static bool get_pixel_layout(const cv::Mat& image, PixelLayoutType& layout);
+
+    /**
+     * 计算两幅同尺寸图像的平均ΔE76（L8/LA8视为灰度，alpha不参与计算）
+     */
+    static float measure_delta_e(const cv::Mat& before, const cv::Mat& after);
+
+    /**
+     * 获取本设备上测得的算法开销
+     * @param algorithm_id 算法ID
+     * @return 每像素耗时（纳秒），无效ID返回0
+     */
+    double get_measured_cost(int algorithm_id) const;
+
+    /**
+     * 预测在指定区域上应用算法的耗时
+     * @param algorithm_id 算法ID
+     * @param area 区域面积（像素）
+     * @return 预测耗时（纳秒）
+     */
+    double estimate_cost_ns(int algorithm_id, int area) const;
 
 private:
+    // 内置算法的成员函数指针类型
+    using DiffKernel = void (DiffGenerator::*)(cv::Mat&, const cv::Rect&, int, DiffInfo&);
+
+    // 自定义算法条目
+    struct CustomAlgorithm {
+        std::string name;           // 名称存储（info.name指向此处）
+        DiffAlgorithmInfo info;     // 元数据
+        CustomDiffKernel kernel;    // 算法函数，为空表示已注销
+    };
+
+    // 在线开销模型条目
+    struct AlgorithmCost {
+        double ns_per_pixel;        // 每像素耗时的指数滑动平均（纳秒）
+        int samples;                // 已采样次数
+    };
+
+    // 按像素布局和DiffType索引的内置算法分发表
+    static const DiffKernel builtin_kernels[PIXEL_LAYOUT_COUNT][DIFF_TYPE_COUNT];
+    static const DiffAlgorithmInfo builtin_info[DIFF_TYPE_COUNT];
+
     std::mt19937 rng;  // 随机数生成器
-    std::map<DiffType, std::function<void(cv::Mat&, const cv::Rect&, int, DiffInfo&)>> diff_algorithms;
+    std::vector<CustomAlgorithm> custom_algorithms;    // 自定义算法，下标为 id - DIFF_TYPE_COUNT
+    std::vector<bool> algorithm_enabled;               // 每个算法ID的启用状态
+    std::vector<AlgorithmCost> algorithm_costs;        // 每个算法ID的开销模型
+    float intensity_scale;                             // 当前强度系数，各算法按此缩放难度对应的强度
+    int calibration_iterations;                        // 感知校准的最大迭代次数
+    PixelLayoutType pixel_layout;                      // 当前调用的像素布局，每次调用开始时确定
+    const InstanceLabelMap* label_map;                 // 当前调用的实例标签图，可为空
+    int object_label;                                  // 当前差异所在物体的标签，0表示修改整个区域
+    DiffAssetCache asset_cache;                        // 纹理、图案和添加物体使用的预生成素材
 
     /**
      * 选择差异区域
      * @param image 图像
+     * @param detections 检测到的物体
      * @param diff_count 差异数量
+     * @return 选择的区域列表，互不重叠且位于图像内；图像放不下时少于diff_count
+     */
+    std::vector<cv::Rect> select_diff_regions(const cv::Mat& image,
+                                           const DetectionSet& detections,
+                                           int diff_count);
+
+    /**
+     * 为重新生成的差异选择一个不与其他差异重叠的新区域
+     * @param image 图像
      * @param detections 检测到的物体
-     * @return 选择的区域列表
+     * @param diff_info 现有差异信息
+     * @param index 要替换区域的差异下标
+     * @return 新区域，找不到时返回空矩形
      */
-    std::vector<cv::Rect> select_diff_regions(const cv::Mat& image, int diff_count,
-                                           const std::vector<DetectedObject>& detections);
+    cv::Rect select_replacement_region(const cv::Mat& image,
+                                     const DetectionSet& detections,
+                                     const std::vector<DiffInfo>& diff_info, int index);
 
     /**
      * 根据难度选择算法
      * @param difficulty 难度级别
-     * @return 选择的算法类型
+     * @param area 区域面积（像素），用于预测开销
+     * @param max_cost_ns 本次允许的最大耗时（纳秒），<0表示不限制
+     * @return 选择的算法ID
      */
-    DiffType select_algorithm_for_difficulty(int difficulty);
+    int select_algorithm_for_difficulty(int difficulty, int area = 0, double max_cost_ns = -1.0);
+
+    /**
+     * 用实测耗时更新开销模型
+     * @param algorithm_id 算法ID
+     * @param area 区域面积（像素）
+     * @param elapsed_ns 实测耗时（纳秒）
+     */
+    void record_cost(int algorithm_id, int area, double elapsed_ns);
+
+    /**
+     * 应用差异算法，并在ROI内测量感知强度、迭代调整强度使其落入难度对应的目标带
+     * @param image 图像
+     * @param region 区域
+     * @param difficulty 难度级别
+     * @param algorithm_id 算法ID
+     * @param diff_info 输出的差异信息
+     */
+    void apply_calibrated(cv::Mat& image, const cv::Rect& region, int difficulty,
+                        int algorithm_id, DiffInfo& diff_info);
 
     /**
      * 应用差异算法
@@ -82,20 +337,37 @@ private:
      * @param algorithm_id 算法ID
      * @param diff_info 输出的差异信息
      */
-    void apply_diff_algorithm(cv::Mat& image, const cv::Rect& region, int difficulty, 
-                           DiffType algorithm_id, DiffInfo& diff_info);
-
-    // 各种差异算法
-    void apply_color_shift(cv::Mat& image, const cv::Rect& region, int difficulty, DiffInfo& diff_info);
-    void apply_object_removal(cv::Mat& image, const cv::Rect& region, int difficulty, DiffInfo& diff_info);
-    void apply_texture_change(cv::Mat& image, const cv::Rect& region, int difficulty, DiffInfo& diff_info);
-    void apply_shape_deform(cv::Mat& image, const cv::Rect& region, int difficulty, DiffInfo& diff_info);
-    void apply_subtle_pattern(cv::Mat& image, const cv::Rect& region, int difficulty, DiffInfo& diff_info);
-    void apply_scale_change(cv::Mat& image, const cv::Rect& region, int difficulty, DiffInfo& diff_info);
-    void apply_rotation(cv::Mat& image, const cv::Rect& region, int difficulty, DiffInfo& diff_info);
-    void apply_flip(cv::Mat& image, const cv::Rect& region, int difficulty, DiffInfo& diff_info);
-    void apply_blur(cv::Mat& image, const cv::Rect& region, int difficulty, DiffInfo& diff_info);
-    void apply_addition(cv::Mat& image, const cv::Rect& region, int difficulty, DiffInfo& diff_info);
+    void apply_diff_algorithm(cv::Mat& image, const cv::Rect& region, int difficulty,
+                           int algorithm_id, DiffInfo& diff_info);
+
+    /**
+     * 对区域内第row行（相对区域）中属于当前物体的每段连续像素调用fn(x0, x1)
+     * 没有对应物体时整行作为一段
+     */
+    template <typename Fn>
+    void for_each_object_span(const cv::Rect& region, int row, Fn&& fn) const;
+
+    /**
+     * 把在区域副本上处理得到的结果写回图像：只写属于当前物体的像素段，alpha保持原值
+     * @param transformed 与区域同尺寸、同类型的处理结果，其alpha通道会被替换
+     */
+    template <typename Layout>
+    void write_object_spans(cv::Mat& image, const cv::Rect& region, cv::Mat& transformed);
+
+    // 各种差异算法，按像素布局模板化；逐像素算法只修改颜色通道，
+    // 几何类算法在区域副本上处理后经write_object_spans写回
+    template <typename Layout> void apply_color_shift(cv::Mat& image, const cv::Rect& region, int difficulty, DiffInfo& diff_info);
+    template <typename Layout> void apply_object_removal(cv::Mat& image, const cv::Rect& region, int difficulty, DiffInfo& diff_info);
+    template <typename Layout> void apply_texture_change(cv::Mat& image, const cv::Rect& region, int difficulty, DiffInfo& diff_info);
+    template <typename Layout> void apply_shape_deform(cv::Mat& image, const cv::Rect& region, int difficulty, DiffInfo& diff_info);
+    template <typename Layout> void apply_subtle_pattern(cv::Mat& image, const cv::Rect& region, int difficulty, DiffInfo& diff_info);
+    template <typename Layout> void apply_scale_change(cv::Mat& image, const cv::Rect& region, int difficulty, DiffInfo& diff_info);
+    template <typename Layout> void apply_rotation(cv::Mat& image, const cv::Rect& region, int difficulty, DiffInfo& diff_info);
+    template <typename Layout> void apply_flip(cv::Mat& image, const cv::Rect& region, int difficulty, DiffInfo& diff_info);
+    template <typename Layout> void apply_blur(cv::Mat& image, const cv::Rect& region, int difficulty, DiffInfo& diff_info);
+    template <typename Layout> void apply_addition(cv::Mat& image, const cv::Rect& region, int difficulty, DiffInfo& diff_info);
 };
 
-#endif // DIFF_GENERATOR_H 
\ No newline at end of file
+} // namespace godot
+
+#endif // DIFF_GENERATOR_H
@@ -0,0 +1,33 @@
+#ifndef DIFF_LOG_H
+#define DIFF_LOG_H
+
+#ifdef DIFF_DETECTOR_HEADLESS
+#include <iostream>
+#include <sstream>
+#else
+#include <godot_cpp/variant/utility_functions.hpp>
+#endif
+
+namespace godot {
+
+/**
+ * 核心代码（DiffGenerator等）的错误输出
+ * GDExtension中转发到Godot输出；定义DIFF_DETECTOR_HEADLESS的命令行工具中写到stderr
+ */
+template <typename... Args>
+inline void log_error(const Args&... args) {
+#ifdef DIFF_DETECTOR_HEADLESS
+    // 先拼成整行再输出，避免多线程输出交错
+    std::ostringstream line;
+    line << "ERROR: ";
+    (line << ... << args);
+    line << '\n';
+    std::cerr << line.str();
+#else
+    UtilityFunctions::print_error(args...);
+#endif
+}
+
+} // namespace godot
+
+#endif // DIFF_LOG_H
@@ -0,0 +1,63 @@
+#ifndef IMAGE_DECODE_H
+#define IMAGE_DECODE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <opencv2/core.hpp>
+
+namespace godot {
+
+/*
+ * 压缩图像解码
+ * generate_diff_from_buffer、守护进程和负载测试工具共用，保证同一份文件字节在各处得到相同的像素：
+ * 忽略EXIF方向（与Godot的load_jpg_from_buffer一致），16位转换为8位，
+ * 通道按Godot的顺序排列（L8/RGB8/RGBA8）。
+ */
+
+/**
+ * 从JPEG的SOF段读取图像尺寸，不解码像素
+ * @return 数据是JPEG且找到了SOF段
+ */
+bool read_jpeg_size(const uint8_t* data, size_t size, int& width, int& height);
+
+/**
+ * 从PNG的IHDR块读取图像尺寸和按全分辨率解码后的通道数，不解码像素
+ * 调色板可能带透明，和灰度+透明一样按4通道返回
+ */
+bool read_png_size(const uint8_t* data, size_t size, int& width, int& height, int& channels);
+
+/**
+ * 全分辨率解码的imdecode标志：JPEG没有透明通道按ANYCOLOR解码，其它格式保留透明通道
+ */
+int get_image_decode_flags(bool is_jpeg);
+
+/**
+ * JPEG缩小解码用作检测输入时的倍数：1/2、1/4、1/8中缩小后长边仍不低于检测输入边长的最大倍数，
+ * 图像不够大时返回1
+ */
+int get_reduced_decode_factor(int width, int height);
+
+/**
+ * JPEG在DCT阶段按1/2、1/4、1/8缩小解码的imdecode标志，其它倍数为全分辨率彩色解码
+ */
+int get_reduced_decode_flags(int factor);
+
+/**
+ * 把imdecode的结果转换为8位并按Godot的通道顺序写入working
+ * working已是目标尺寸和类型时直接写入其缓冲区；decoded可能被就地转换
+ */
+bool convert_decoded_image(cv::Mat& decoded, cv::Mat& working);
+
+/**
+ * 按指定标志解码并转换，失败返回false
+ */
+bool decode_image_buffer(const cv::Mat& encoded, int flags, cv::Mat& working);
+
+/**
+ * 按文件类型选择全分辨率解码标志后解码并转换，失败返回false
+ */
+bool decode_image_buffer(const uint8_t* data, size_t size, cv::Mat& working);
+
+} // namespace godot
+
+#endif // IMAGE_DECODE_H
@@ -0,0 +1,77 @@
+#ifndef INSTANCE_LABEL_MAP_H
+#define INSTANCE_LABEL_MAP_H
+
+#include <vector>
+#include <cstdint>
+#include <opencv2/core.hpp>
+#include "detection_set.h"
+
+namespace godot {
+
+/**
+ * 实例标签图
+ * 每个像素保存所属检测物体的编号（0为背景，物体i为i+1），由分割点集扫描线填充得到。
+ * 每张图像构建一次，之后由各差异算法只读共享，使修改只落在物体自身的像素上。
+ * 物体不超过255个时为CV_8UC1，否则为CV_16UC1。
+ */
+class InstanceLabelMap {
+public:
+    InstanceLabelMap();
+    ~InstanceLabelMap();
+
+    /**
+     * 按检测结果构建标签图，重叠处由置信度更高的物体覆盖
+     * 分割点少于3个的物体按边界框填充
+     * @param size 图像尺寸
+     * @param objects 检测到的物体
+     */
+    void build(const cv::Size& size, const DetectionSet& objects);
+
+    void clear();
+    bool empty() const;
+
+    const cv::Mat& get_labels() const;
+    int get_object_count() const;
+
+    /**
+     * 查找区域对应的物体标签
+     * @param region 差异区域
+     * @return 与区域对应的物体边界框重叠度最高（IoU不低于0.5）的标签，没有时返回0
+     */
+    int find_label(const cv::Rect& region) const;
+
+    /**
+     * 对区域内第row行（相对区域）中标签为label的每段连续像素调用fn(x0, x1)
+     * x0、x1为相对区域的列范围[x0, x1)
+     */
+    template <typename Fn>
+    void for_each_span(const cv::Rect& region, int row, int label, Fn&& fn) const {
+        if (labels.depth() == CV_8U) {
+            scan_spans(labels.ptr<uint8_t>(region.y + row) + region.x, region.width, label, fn);
+        } else {
+            scan_spans(labels.ptr<uint16_t>(region.y + row) + region.x, region.width, label, fn);
+        }
+    }
+
+private:
+    cv::Mat labels;
+    std::vector<cv::Rect> boxes;    // 下标为标签-1，已裁剪到图像内
+
+    template <typename T, typename Fn>
+    static void scan_spans(const T* row, int width, int label, Fn& fn) {
+        const T value = static_cast<T>(label);
+        int x = 0;
+        while (x < width) {
+            while (x < width && row[x] != value) x++;
+            int start = x;
+            while (x < width && row[x] == value) x++;
+            if (x > start) {
+                fn(start, x);
+            }
+        }
+    }
+};
+
+} // namespace godot
+
+#endif // INSTANCE_LABEL_MAP_H
@@ -0,0 +1,104 @@
+#ifndef MEMORY_GOVERNOR_H
+#define MEMORY_GOVERNOR_H
+
+#include <cstddef>
+#include <opencv2/core.hpp>
+
+namespace godot {
+
+// 单次生成的内存策略，按占用从高到低排列
+enum MemoryStrategy {
+    MEMORY_STRATEGY_STANDARD = 0,           // 保留原图副本和标签图，支持reroll_diff
+    MEMORY_STRATEGY_IN_PLACE = 1,           // 直接在输出缓冲区上生成，不保留reroll_diff所需的状态
+    MEMORY_STRATEGY_REDUCED_DETECTION = 2,  // 同上，检测输入由源布局直接缩小得到，不做全分辨率RGB转换
+    MEMORY_STRATEGY_PROXY = 3,              // 在按整数倍缩小的代理图像上生成，输出为代理分辨率
+    MEMORY_STRATEGY_REJECT = 4              // 任何策略都超出预算
+};
+
+// 估算所需的源图像描述
+struct MemoryPlanInput {
+    int width;
+    int height;
+    int channels;
+    bool mipmaps;           // 输出需要生成mipmap
+    bool compressed;        // 源为压缩文件，解码结果在转换到工作缓冲区前短暂存在
+    bool reduced_decode;    // 解码器支持按1/2、1/4、1/8缩小解码（JPEG）
+};
+
+// 选定的策略
+struct MemoryPlan {
+    MemoryStrategy strategy;
+    int scale;              // 代理图像的缩小倍数，其它策略为1
+    size_t estimated_peak;  // 估算的峰值字节数；拒绝时为所有策略中的最小值
+};
+
+/**
+ * 内存预算调节器
+ * 生成前按图像尺寸估算各策略的峰值工作集（本流程分配的图像缓冲区，不含调用方持有的源图像、
+ * 模型张量和区域大小的临时缓冲区），选择不超出预算的占用最高的策略，即尽量保留功能和分辨率；
+ * 生成过程中按分配的缓冲区大小记账，得到每次调用的记账峰值。记账只覆盖上述缓冲区，
+ * 不是进程实际占用的测量值（不含分配器开销、OpenCV内部临时缓冲区和其它线程的分配）。非线程安全。
+ */
+class MemoryGovernor {
+public:
+    MemoryGovernor();
+    ~MemoryGovernor();
+
+    /**
+     * 设置预算（字节），0表示不限制
+     */
+    void set_budget(size_t bytes);
+    size_t get_budget() const;
+
+    /**
+     * 选择不超出预算的策略
+     * 代理图像的长边不低于检测输入边长；压缩源只有支持缩小解码时才能使用代理
+     */
+    MemoryPlan plan(const MemoryPlanInput& input) const;
+
+    /**
+     * 估算指定策略的峰值字节数
+     * @param scale 代理缩小倍数，只对MEMORY_STRATEGY_PROXY有效
+     */
+    static size_t estimate_peak(const MemoryPlanInput& input, MemoryStrategy strategy, int scale = 1);
+
+    /**
+     * 缩小检测输入的整数倍数，使长边不低于检测输入边长
+     */
+    static int get_detection_reduce_factor(int width, int height);
+
+    /**
+     * 按整数倍数缩小图像（INTER_AREA，保持源像素布局）
+     * dst已是目标尺寸和类型时直接写入其缓冲区
+     */
+    static void downscale(const cv::Mat& src, int factor, cv::Mat& dst);
+
+    static const char* get_strategy_name(MemoryStrategy strategy);
+
+    // 每次调用的缓冲区用量记账
+
+    /**
+     * 开始新的一次调用，清零当前用量和峰值
+     */
+    void begin_call();
+
+    /**
+     * 记录分配或释放的缓冲区
+     */
+    void acquire(size_t bytes);
+    void release(size_t bytes);
+
+    size_t get_accounted() const;
+    size_t get_accounted_peak() const;
+
+    static size_t mat_bytes(const cv::Mat& mat);
+
+private:
+    size_t budget;
+    size_t current;
+    size_t peak;
+};
+
+} // namespace godot
+
+#endif // MEMORY_GOVERNOR_H
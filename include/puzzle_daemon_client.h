@@ -0,0 +1,55 @@
+#ifndef PUZZLE_DAEMON_CLIENT_H
+#define PUZZLE_DAEMON_CLIENT_H
+
+#include <godot_cpp/classes/image.hpp>
+#include <godot_cpp/classes/ref.hpp>
+#include <godot_cpp/classes/ref_counted.hpp>
+#include <godot_cpp/variant/dictionary.hpp>
+#include <godot_cpp/variant/packed_byte_array.hpp>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace godot {
+
+class DiffGenerator;
+
+/**
+ * 谜题生成守护进程客户端
+ * 通过Unix域套接字向diff_puzzle_daemon请求谜题，模型只在守护进程中加载一次。
+ * 请求是阻塞的，需要时在WorkerThreadPool中调用。
+ */
+class PuzzleDaemonClient : public RefCounted {
+    GDCLASS(PuzzleDaemonClient, RefCounted);
+
+private:
+    int socket_fd;
+    uint32_t next_request_id;
+    std::unique_ptr<DiffGenerator> replay_generator;    // 在客户端重放配方
+
+    // 发送请求并等待对应的响应，失败时断开连接
+    bool send_request(uint32_t type, const std::vector<uint8_t>& payload, std::vector<uint8_t>& response);
+
+protected:
+    static void _bind_methods();
+
+public:
+    PuzzleDaemonClient();
+    ~PuzzleDaemonClient();
+
+    bool connect_to_daemon(const String& socket_path);
+    void disconnect_from_daemon();
+    bool is_connected_to_daemon() const;
+
+    // 结果格式与DiffDetector::take_prefetched一致，配方模式下patches为空，需要用apply_recipe生成修改图
+    Dictionary generate(const PackedByteArray& buffer, int diff_count, int difficulty, const Dictionary& options);
+
+    // 在原图上重放配方模式的结果
+    Ref<Image> apply_recipe(const Ref<Image>& source_image, const Dictionary& puzzle);
+
+    Dictionary get_daemon_stats();
+};
+
+} // namespace godot
+
+#endif // PUZZLE_DAEMON_CLIENT_H
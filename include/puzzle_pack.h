@@ -0,0 +1,242 @@
+#ifndef PUZZLE_PACK_H
+#define PUZZLE_PACK_H
+
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <cstdio>
+#include <opencv2/core.hpp>
+#include "diff_generator.h"
+
+namespace godot {
+
+/*
+ * 谜题包二进制格式（小端，所有数据块按16字节对齐）
+ *
+ *   PackHeader
+ *   数据块：原图编码数据、差异补丁、改变掩码（顺序任意）
+ *   PackPuzzleEntry[puzzle_count]   按名称排序的索引
+ *   PackDiffRecord[...]             每个谜题的差异记录连续存放
+ *   字符串表
+ *
+ * 打开时只读取头部和索引，补丁和原图在使用时才解码。
+ */
+
+constexpr char PUZZLE_PACK_MAGIC[8] = { 'D', 'I', 'F', 'F', 'P', 'A', 'C', 'K' };
+constexpr uint32_t PUZZLE_PACK_VERSION = 1;
+
+// 数据块编码
+enum PackEncoding : uint32_t {
+    PACK_ENCODING_NONE = 0,     // 无数据
+    PACK_ENCODING_RAW = 1,      // 原始像素，逐行紧密排列
+    PACK_ENCODING_PNG = 2,      // PNG（通道顺序与源像素布局一致）
+    PACK_ENCODING_BITS = 3,     // 每像素1位，每行按字节对齐，高位在前
+    PACK_ENCODING_FILE = 4      // 原始图像文件的字节（JPEG/PNG等）
+};
+
+// 原图存放方式
+enum PackOriginalMode : uint32_t {
+    PACK_ORIGINAL_EMBEDDED = 0, // 原图文件嵌入包内
+    PACK_ORIGINAL_REFERENCE = 1 // 只记录相对于包文件的路径
+};
+
+#pragma pack(push, 1)
+
+struct PackHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t puzzle_count;
+    uint64_t index_offset;      // PackPuzzleEntry数组
+    uint64_t diffs_offset;      // PackDiffRecord数组
+    uint32_t diff_record_count;
+    uint32_t reserved0;
+    uint64_t strings_offset;    // 字符串表
+    uint64_t strings_size;
+    uint64_t file_size;         // 用于检测截断的文件
+    uint8_t reserved[8];
+};
+
+// 数据块在文件中的位置
+struct PackBlob {
+    uint64_t offset;
+    uint64_t size;
+    uint32_t encoding;          // PackEncoding
+    uint32_t reserved;
+};
+
+struct PackPuzzleEntry {
+    uint32_t name_offset;       // 字符串表中的名称
+    uint32_t name_length;
+    uint32_t width;
+    uint32_t height;
+    uint32_t channels;          // 1-4，与DiffDetector支持的L8/LA8/RGB8/RGBA8对应
+    uint32_t original_mode;     // PackOriginalMode
+    uint32_t source_offset;     // 字符串表中的原图路径（引用模式）
+    uint32_t source_length;
+    uint32_t first_diff;        // 在PackDiffRecord数组中的起始下标
+    uint32_t diff_count;
+    PackBlob original;          // 嵌入模式下的原图文件
+};
+
+struct PackDiffRecord {
+    int32_t region[4];          // x, y, width, height
+    int32_t algorithm_id;
+    float perceptual_score;
+    float intensity_scale;
+    uint32_t seed;
+    PackBlob patch;             // 区域内修改后的像素
+    PackBlob mask;              // 区域内实际改变的像素
+};
+
+#pragma pack(pop)
+
+/**
+ * 编码完成、等待写入的谜题
+ * 编码（PNG压缩、掩码计算）可在多个线程并行进行，写入时只做顺序追加
+ */
+struct EncodedPuzzle {
+    std::string name;
+    int width;
+    int height;
+    int channels;
+    PackOriginalMode original_mode;
+    std::string source;                         // 引用模式下的原图路径
+    std::vector<uint8_t> original_data;         // 嵌入模式下的原图文件字节
+    std::vector<DiffInfo> diffs;
+    std::vector<std::vector<uint8_t>> patches;  // 与diffs一一对应
+    std::vector<uint32_t> patch_encodings;
+    std::vector<std::vector<uint8_t>> masks;
+};
+
+/**
+ * 谜题包写入器
+ */
+class PuzzlePackWriter {
+public:
+    PuzzlePackWriter();
+    ~PuzzlePackWriter();
+
+    /**
+     * 编码一个谜题（线程安全，不访问写入器状态）
+     * @param name 谜题名称，包内唯一
+     * @param original 原图（8位1-4通道）
+     * @param modified 应用差异后的图像
+     * @param diffs 差异信息，裁剪到图像内后为空区域的差异不写入
+     * @param original_file 原图文件字节，非空时嵌入包内
+     * @param source 原图文件相对于包文件的路径，original_file为空时记录为引用
+     * @param compress_patches 是否用PNG压缩补丁（LA8布局始终存原始像素）
+     * @param puzzle 输出的编码结果
+     * @return 成功返回true，失败返回false
+     */
+    static bool encode_puzzle(const std::string& name, const cv::Mat& original, const cv::Mat& modified,
+                            const std::vector<DiffInfo>& diffs, std::vector<uint8_t> original_file,
+                            const std::string& source, bool compress_patches, EncodedPuzzle& puzzle);
+
+    /**
+     * 创建包文件
+     */
+    bool open(const std::string& path);
+
+    /**
+     * 追加一个编码好的谜题（非线程安全，调用方需串行化）
+     */
+    bool add_puzzle(const EncodedPuzzle& puzzle);
+
+    /**
+     * 写入索引和字符串表并关闭文件
+     */
+    bool finish();
+
+private:
+    struct PendingEntry {
+        std::string name;
+        std::string source;
+        PackPuzzleEntry entry;
+        std::vector<PackDiffRecord> diffs;
+    };
+
+    FILE* file;
+    uint64_t offset;
+    std::vector<PendingEntry> entries;
+
+    bool write_blob(const std::vector<uint8_t>& data, uint32_t encoding, PackBlob& blob);
+    bool write_bytes(const void* data, size_t size);
+    bool align();
+};
+
+/**
+ * 谜题包读取器
+ * 优先以内存映射打开，无法映射时（例如位于APK内）由调用方读入内存后打开
+ */
+class PuzzlePack {
+public:
+    PuzzlePack();
+    ~PuzzlePack();
+
+    PuzzlePack(const PuzzlePack&) = delete;
+    PuzzlePack& operator=(const PuzzlePack&) = delete;
+
+    /**
+     * 以内存映射打开包文件，只校验头部和索引
+     */
+    bool open(const std::string& path);
+
+    /**
+     * 从内存中的包数据打开，读取器接管数据
+     */
+    bool open_memory(std::vector<uint8_t>&& data);
+
+    void close();
+    bool is_open() const;
+
+    int get_puzzle_count() const;
+    const PackPuzzleEntry* get_entry(int index) const;
+    std::string get_name(int index) const;
+    std::string get_source(int index) const;
+
+    /**
+     * 按名称查找谜题（索引按名称排序，二分查找）
+     * @return 下标，不存在返回-1
+     */
+    int find_puzzle(const std::string& name) const;
+
+    /**
+     * 获取谜题的差异记录（直接指向映射内存）
+     */
+    const PackDiffRecord* get_diffs(int index) const;
+
+    /**
+     * 获取嵌入的原图文件字节（直接指向映射内存）
+     * @return 嵌入模式返回true，引用模式返回false
+     */
+    bool get_original_file(int index, const uint8_t*& data, size_t& size) const;
+
+    /**
+     * 解码单个差异的补丁
+     * @param index 谜题下标
+     * @param diff_index 差异下标
+     * @param patch 输出的补丁，像素布局与原图一致
+     */
+    bool decode_patch(int index, int diff_index, cv::Mat& patch) const;
+
+    /**
+     * 解码单个差异的改变掩码（CV_8UC1，改变的像素为255）
+     */
+    bool decode_mask(int index, int diff_index, cv::Mat& mask) const;
+
+private:
+    const uint8_t* data;
+    size_t size;
+    std::vector<uint8_t> owned;     // open_memory时持有的数据
+    void* mapping;                  // 映射句柄（Windows）
+    void* mapped_data;              // 映射的起始地址，为空表示未映射
+
+    const PackHeader* header() const;
+    bool validate();
+    bool blob_in_range(const PackBlob& blob) const;
+    const PackDiffRecord* get_diff_record(int index, int diff_index) const;
+};
+
+} // namespace godot
+
+#endif // PUZZLE_PACK_H
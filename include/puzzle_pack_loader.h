@@ -0,0 +1,56 @@
+#ifndef PUZZLE_PACK_LOADER_H
+#define PUZZLE_PACK_LOADER_H
+
+#include <godot_cpp/classes/image.hpp>
+#include <godot_cpp/classes/ref.hpp>
+#include <godot_cpp/classes/ref_counted.hpp>
+#include <godot_cpp/variant/array.hpp>
+#include <godot_cpp/variant/dictionary.hpp>
+#include <godot_cpp/variant/packed_string_array.hpp>
+#include <memory>
+
+namespace godot {
+
+class PuzzlePack;
+
+/**
+ * 谜题包加载器
+ * 以内存映射打开谜题包，打开时只读取索引；原图和补丁在请求时才解码
+ */
+class PuzzlePackLoader : public RefCounted {
+    GDCLASS(PuzzlePackLoader, RefCounted);
+
+private:
+    std::unique_ptr<PuzzlePack> pack;
+    String pack_directory;      // 包文件所在目录，用于解析引用模式的原图路径
+
+protected:
+    static void _bind_methods();
+
+public:
+    PuzzlePackLoader();
+    ~PuzzlePackLoader();
+
+    bool open(const String& path);
+    void close();
+    bool is_open() const;
+
+    int get_puzzle_count() const;
+    PackedStringArray get_puzzle_names() const;
+    int find_puzzle(const String& name) const;
+
+    // 元数据（不解码像素）
+    Dictionary get_puzzle_info(int index) const;
+
+    // 按需解码
+    Ref<Image> load_original(int index) const;
+    Ref<Image> get_patch(int index, int diff_index) const;
+    Ref<Image> get_mask(int index, int diff_index) const;
+
+    // 解码全部补丁，结果格式与DiffDetector::take_prefetched一致，可直接传给apply_puzzle_patches
+    Dictionary get_puzzle(int index) const;
+};
+
+} // namespace godot
+
+#endif // PUZZLE_PACK_LOADER_H
@@ -0,0 +1,150 @@
+#ifndef PUZZLE_PREFETCHER_H
+#define PUZZLE_PREFETCHER_H
+
+#include <vector>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <functional>
+#include <condition_variable>
+#include <cstdint>
+#include <opencv2/core.hpp>
+#include "diff_generator.h"
+#include "yolo_detector.h"
+
+namespace godot {
+
+/**
+ * 预取完成的谜题
+ * 只保存差异区域的补丁与元数据，不保存完整的修改后图像
+ */
+struct PrefetchedPuzzle {
+    int64_t level_id;               // 关卡ID
+    int format;                     // 源图像格式（Image::Format），补丁与其像素布局一致
+    std::vector<DiffInfo> diffs;    // 差异信息
+    std::vector<cv::Mat> patches;   // 每个差异区域修改后的像素，与diffs一一对应
+
+    /**
+     * 估算占用的内存字节数
+     */
+    size_t byte_size() const;
+};
+
+// 检测回调：在共享的检测器上运行检测并返回结果
+using PrefetchDetectFunction = std::function<bool(const cv::Mat&, DetectionSet&)>;
+
+/**
+ * 谜题预取器
+ * 在低优先级后台线程上生成后续关卡的谜题，并在内存预算内缓存结果
+ */
+class PuzzlePrefetcher {
+public:
+    /**
+     * @param detect 检测回调，可能被多个工作线程同时调用，需要自行加锁
+     */
+    explicit PuzzlePrefetcher(PrefetchDetectFunction detect);
+    ~PuzzlePrefetcher();
+
+    /**
+     * 加入预取队列
+     * @param level_id 关卡ID
+     * @param image 工作图像（源像素布局），预取器接管其内存
+     * @param format 源图像格式
+     * @param diff_count 差异数量
+     * @param difficulty 难度级别 (1-10)
+     * @param config 调用方生成器的配置快照，工作线程的生成器按此生成，与前台生成结果一致
+     * @return 成功返回true，已在队列或已完成时返回false
+     */
+    bool enqueue(int64_t level_id, const cv::Mat& image, int format,
+               int diff_count, int difficulty, const DiffGeneratorConfig& config);
+
+    /**
+     * 取出已完成的谜题
+     * @param level_id 关卡ID
+     * @param puzzle 输出的谜题
+     * @return 已完成返回true，否则返回false
+     */
+    bool take(int64_t level_id, PrefetchedPuzzle& puzzle);
+
+    /**
+     * 查询谜题是否已完成
+     */
+    bool is_ready(int64_t level_id) const;
+
+    /**
+     * 取消指定关卡（排队中的直接移除，运行中的结果被丢弃）
+     */
+    void cancel(int64_t level_id);
+
+    /**
+     * 取消所有排队和运行中的任务，已完成的谜题保留
+     */
+    void cancel_all();
+
+    /**
+     * 设置已完成谜题的内存预算（字节）
+     */
+    void set_memory_budget(size_t bytes);
+    size_t get_memory_budget() const;
+
+    /**
+     * 获取已完成谜题当前占用的内存（字节）
+     */
+    size_t get_memory_usage() const;
+
+    /**
+     * 获取排队和运行中的任务数量
+     */
+    int get_pending_count() const;
+
+private:
+    // 预取任务
+    struct PrefetchJob {
+        int64_t level_id;
+        cv::Mat image;
+        int format;
+        int diff_count;
+        int difficulty;
+        DiffGeneratorConfig config;
+        std::shared_ptr<std::atomic<bool>> cancelled;
+    };
+
+    PrefetchDetectFunction detect_function;
+
+    mutable std::mutex mutex;
+    std::condition_variable queue_condition;
+    std::deque<PrefetchJob> queue;                          // 排队中的任务
+    std::map<int64_t, std::shared_ptr<std::atomic<bool>>> running;  // 运行中的任务
+    std::map<int64_t, PrefetchedPuzzle> ready;              // 已完成的谜题
+    std::vector<std::thread> workers;
+    bool stopping;
+    size_t memory_budget;
+    size_t memory_usage;
+
+    /**
+     * 按需启动工作线程（调用方需持有mutex）
+     */
+    void ensure_workers();
+
+    /**
+     * 工作线程主循环
+     */
+    void worker_loop();
+
+    /**
+     * 在预算内存入完成的谜题，超出时优先淘汰关卡ID最大的谜题（调用方需持有mutex）
+     */
+    void store_ready(PrefetchedPuzzle&& puzzle);
+
+    /**
+     * 降低当前线程的调度优先级
+     */
+    static void lower_thread_priority();
+};
+
+} // namespace godot
+
+#endif // PUZZLE_PREFETCHER_H
@@ -0,0 +1,78 @@
+#ifndef PUZZLE_VALIDATOR_H
+#define PUZZLE_VALIDATOR_H
+
+#include <vector>
+#include <opencv2/core.hpp>
+
+namespace godot {
+
+/**
+ * 校验参数
+ */
+struct ValidationOptions {
+    int change_threshold;       // 像素被视为改变的最小通道差值 (0-255)
+    float min_visibility;       // 差异可见所需的最低可见度分数 (0-1)
+    int min_stray_area;         // 报告区域外杂散改变的最小连通域面积（像素）
+};
+
+/**
+ * 单个差异的校验结果
+ */
+struct DiffValidation {
+    int changed_pixels;         // 区域内改变的像素数
+    float changed_ratio;        // 区域内改变像素的比例
+    float mean_delta;           // 改变像素的平均通道差值 (0-255)
+    float visibility;           // 可见度分数 = changed_ratio * mean_delta / 255
+    bool visible;               // 是否满足可见度要求
+    std::vector<int> overlaps;  // 与之重叠的其他差异下标
+};
+
+/**
+ * 整个谜题的校验结果
+ */
+struct ValidationReport {
+    std::vector<DiffValidation> diffs;      // 每个差异的结果，与输入区域一一对应
+    std::vector<cv::Rect> stray_components; // 所有差异区域之外的改变连通域
+    int stray_pixels;                       // 差异区域之外改变的像素总数
+    bool valid;                             // 所有差异可见、无重叠且无杂散改变
+};
+
+/**
+ * 谜题校验器
+ * 对原图与修改图逐像素求各通道绝对差的最大值，阈值化后检查每个差异是否可见、
+ * 区域之外是否有杂散改变以及差异之间是否重叠
+ */
+class PuzzleValidator {
+public:
+    PuzzleValidator();
+    ~PuzzleValidator();
+
+    /**
+     * 校验谜题
+     * @param original 原始图像（8位，1-4通道）
+     * @param modified 修改后的图像，尺寸和类型须与原图一致
+     * @param regions 每个差异的区域
+     * @param report 输出的校验结果
+     * @return 输入有效返回true，否则返回false
+     */
+    bool validate(const cv::Mat& original, const cv::Mat& modified,
+                const std::vector<cv::Rect>& regions, ValidationReport& report);
+
+    void set_options(const ValidationOptions& new_options);
+    const ValidationOptions& get_options() const;
+
+private:
+    ValidationOptions options;
+
+    // 复用的中间缓冲区，批量校验时避免反复分配
+    cv::Mat max_diff;           // 各通道最大差值（单通道）
+    cv::Mat change_mask;        // 改变像素掩码
+    cv::Mat region_mask;        // 差异区域掩码
+    cv::Mat labels;             // 连通域标签
+    cv::Mat stats;              // 连通域统计
+    cv::Mat centroids;          // 连通域质心
+};
+
+} // namespace godot
+
+#endif // PUZZLE_VALIDATOR_H
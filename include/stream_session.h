@@ -0,0 +1,133 @@
+#ifndef STREAM_SESSION_H
+#define STREAM_SESSION_H
+
+#include <vector>
+#include <functional>
+#include <cstdint>
+#include <opencv2/core.hpp>
+#include "diff_generator.h"
+#include "yolo_detector.h"
+
+namespace godot {
+
+/**
+ * 流式会话参数
+ */
+struct StreamOptions {
+    int detect_interval;            // 每隔多少帧重新运行一次检测，<=0表示只在首帧和场景切换时检测
+    float scene_change_threshold;   // 缩略图平均灰度差超过该比例 (0-1) 视为场景切换
+    int search_margin;              // 跟踪时在上一帧区域周围搜索的范围（全分辨率像素）
+    float min_track_score;          // 模板匹配的最低相关系数，低于该值视为跟踪丢失
+};
+
+/**
+ * 单帧处理统计
+ */
+struct StreamFrameStats {
+    int64_t frame_index;            // 帧序号，从0开始
+    bool detected;                  // 本帧是否运行了检测
+    bool scene_change;              // 本帧是否检测到场景切换（差异会全部重新生成）
+    int lost_tracks;                // 跟踪丢失并被替换的差异数量
+    double detect_ms;               // 检测耗时
+    double track_ms;                // 跟踪耗时
+    double apply_ms;                // 应用差异耗时
+};
+
+// 检测回调：在共享的检测器上运行检测并返回结果
+using StreamDetectFunction = std::function<bool(const cv::Mat&, DetectionSet&)>;
+
+/**
+ * 视频流差异会话
+ * 只在首帧、每隔detect_interval帧或场景切换时运行检测，其余帧用模板匹配跟踪差异区域，
+ * 并以相同的算法、强度系数和随机种子把差异重放到新帧上，使差异在时间上保持稳定
+ */
+class StreamSession {
+public:
+    /**
+     * @param generator 差异生成器（与调用方共享，包括自定义算法）
+     * @param detect 检测回调
+     */
+    StreamSession(DiffGenerator& generator, StreamDetectFunction detect);
+    ~StreamSession();
+
+    /**
+     * 开始新的会话，下一帧会重新检测并生成差异
+     * @param diff_count 差异数量
+     * @param difficulty 难度级别 (1-10)
+     */
+    void start(int diff_count, int difficulty);
+
+    /**
+     * 处理一帧，差异直接写入输入帧，不复制整帧
+     * @param frame 输入帧（8位1-4通道），返回时已应用差异
+     * @param stats 输出的本帧统计
+     * @return 成功返回true，失败返回false（帧可能已被部分修改）
+     */
+    bool process_frame(cv::Mat& frame, StreamFrameStats& stats);
+
+    /**
+     * 获取当前差异（区域为最近一帧中的位置）
+     */
+    const std::vector<DiffInfo>& get_diffs() const;
+
+    void set_options(const StreamOptions& new_options);
+    const StreamOptions& get_options() const;
+
+private:
+    // 单个差异的跟踪状态
+    struct Track {
+        cv::Mat template_gray;      // 上一帧中该区域的灰度模板（跟踪分辨率）
+        cv::Point2f position;       // 区域左上角的亚像素位置（全分辨率）
+    };
+
+    DiffGenerator& generator;
+    StreamDetectFunction detect_function;
+    StreamOptions options;
+
+    int diff_count;
+    int difficulty;
+    int64_t frame_index;
+    int64_t last_detect_frame;
+    cv::Size frame_size;            // 当前差异所在帧的尺寸，尺寸变化时重新生成
+
+    std::vector<DiffInfo> diffs;
+    std::vector<Track> tracks;
+    DetectionSet detections;
+
+    // 复用的中间缓冲区
+    cv::Mat scaled;                 // 缩放到跟踪分辨率的当前帧
+    cv::Mat gray;                   // 当前帧灰度图（跟踪分辨率）
+    cv::Mat thumbnail;              // 当前帧缩略图
+    cv::Mat previous_thumbnail;     // 上一帧缩略图
+    cv::Mat match_result;           // 模板匹配结果
+
+    /**
+     * 生成跟踪用的灰度图和场景切换检测用的缩略图
+     */
+    void prepare_frame(const cv::Mat& frame);
+
+    /**
+     * 与上一帧缩略图比较判断是否发生场景切换
+     */
+    bool is_scene_change() const;
+
+    /**
+     * 在搜索窗口内跟踪单个差异
+     * @return 跟踪成功返回true，区域移出画面或相关系数过低返回false
+     */
+    bool track_region(size_t index);
+
+    /**
+     * 用当前帧的检测结果校正跟踪漂移：与检测框重叠足够时移动到检测框位置
+     */
+    void snap_to_detections();
+
+    /**
+     * 从当前灰度图更新差异的跟踪模板
+     */
+    void update_template(size_t index);
+};
+
+} // namespace godot
+
+#endif // STREAM_SESSION_H
@@ -3,18 +3,12 @@
 
 #include <vector>
 #include <string>
+#include <memory>
 #include <opencv2/core.hpp>
 #include <litert/tflite_model.h>
+#include "detection_set.h"
 
-/**
- * 表示检测到的物体的结构体
- */
-struct DetectedObject {
-    int class_id;                  // 类别ID
-    float confidence;              // 置信度
-    cv::Rect bounding_box;         // 边界框
-    std::vector<cv::Point> points; // 分割点集
-};
+namespace godot {
 
 /**
  * YOLOv11检测器类
@@ -39,11 +33,19 @@ public:
      */
     bool detect(const cv::Mat& image);
 
+    /**
+     * 将8位1-4通道图像转换为模型需要的RGB输入
+     * @param image 输入图像（L8、LA8、RGB8或RGBA8布局）
+     * @param rgb 输出的RGB图像，输入已是RGB时与输入共享数据
+     * @return 布局受支持返回true，否则返回false
+     */
+    static bool prepare_input(const cv::Mat& image, cv::Mat& rgb);
+
     /**
      * 获取检测结果
-     * @return 检测到的物体列表
+     * @return 检测到的物体，下次detect前有效
      */
-    std::vector<DetectedObject> get_detections() const;
+    const DetectionSet& get_detections() const;
 
     /**
      * 设置置信度阈值
@@ -69,18 +71,14 @@ public:
      */
     float get_nms_threshold() const;
 
-    /**
-     * 在图像上绘制检测结果
-     * @param image 要绘制的图像
-     */
-    void draw_detections(cv::Mat& image);
-
 private:
     bool is_initialized;               // 是否已初始化
     float confidence_threshold;        // 置信度阈值
     float nms_threshold;               // 非极大值抑制阈值
-    std::vector<DetectedObject> detections; // 检测结果
+    DetectionSet detections;           // 检测结果，跨调用复用容量
     std::unique_ptr<litert::TFLiteModel> model; // TFLite模型
 };
 
+} // namespace godot
+
 #endif // YOLO_DETECTOR_H 
\ No newline at end of file
@@ -38,6 +38,8 @@ def setup_opencv_mobile():
     elif build_platform == "macos":
         # 对于macOS，我们也使用iOS版本，然后做必要的调整
         url = "https://github.com/nihui/opencv-mobile/releases/download/v32/opencv-mobile-4.11.0-macos.zip"
+    elif build_platform == "linux":
+        url = "https://github.com/nihui/opencv-mobile/releases/download/v32/opencv-mobile-4.11.0-ubuntu-2404.zip"
     else:  # android
         url = "https://github.com/nihui/opencv-mobile/releases/download/v32/opencv-mobile-4.11.0-android.zip"
     
@@ -97,6 +99,12 @@ def setup_litert():
             run_command(build_cmd)
             shutil.copy("bazel-bin/tflite/libtensorflowlite.so", "lib/libtensorflowlite.dylib")
             
+        elif build_platform == "linux":
+            # Linux桌面平台使用Bazel构建（本机x86_64，无需交叉编译配置）
+            build_cmd = "bazel build //tflite:libtensorflowlite.so"
+            run_command(build_cmd)
+            shutil.copy("bazel-bin/tflite/libtensorflowlite.so", "lib/libtensorflowlite.so")
+            
         else:  # android
             # Android平台使用Bazel构建
             build_cmd = "bazel build //tflite:libtensorflowlite.so --config=android"
@@ -0,0 +1,7 @@
+// AVX2变体：由SConstruct以 -mavx2 -mfma 编译，仅在x86_64目标上加入
+#if defined(__x86_64__) || defined(_M_X64)
+#define CPU_KERNELS_NAMESPACE cpu_avx2
+#define CPU_KERNELS_TABLE cpu_kernels_avx2
+#define CPU_KERNELS_NAME "avx2"
+#include "cpu_kernels_impl.h"
+#endif
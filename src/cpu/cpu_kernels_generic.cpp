@@ -0,0 +1,5 @@
+// 通用变体：只使用目标平台的基线指令集（x86_64 SSE2 / arm64 NEON）
+#define CPU_KERNELS_NAMESPACE cpu_generic
+#define CPU_KERNELS_TABLE cpu_kernels_generic
+#define CPU_KERNELS_NAME "generic"
+#include "cpu_kernels_impl.h"
@@ -0,0 +1,206 @@
+// 热点像素内核的实现，每个ISA变体的源文件各包含一次
+// 包含前需定义：
+//   CPU_KERNELS_NAMESPACE  变体命名空间
+//   CPU_KERNELS_TABLE      导出的函数表变量名
+//   CPU_KERNELS_NAME       变体名称字符串
+//
+// 注意：这里不使用std::min/std::max等标准库模板。它们是弱符号的inline实例，
+// 在以AVX2编译的目标文件中实例化后，链接器可能让通用变体也使用该版本，
+// 导致不支持AVX2的CPU上出现非法指令。所有代码都放在匿名命名空间中。
+
+#include "cpu_kernels.h"
+
+namespace godot {
+namespace CPU_KERNELS_NAMESPACE {
+namespace {
+
+inline uint8_t saturate_u8(int value) {
+    return static_cast<uint8_t>(value < 0 ? 0 : (value > 255 ? 255 : value));
+}
+
+inline uint8_t saturate_u8(float value) {
+    return static_cast<uint8_t>(value < 0.0f ? 0.0f : (value > 255.0f ? 255.0f : value));
+}
+
+template <int Channels>
+void add_channel_saturate_n(uint8_t* pixels, int count, int channel, int delta) {
+    for (int i = 0; i < count; i++) {
+        uint8_t& value = pixels[i * Channels + channel];
+        value = saturate_u8(value + delta);
+    }
+}
+
+void add_channel_saturate(uint8_t* pixels, int count, int channels, int channel, int delta) {
+    // 按通道数特化，让编译器以常量步长向量化
+    switch (channels) {
+        case 1: add_channel_saturate_n<1>(pixels, count, channel, delta); break;
+        case 2: add_channel_saturate_n<2>(pixels, count, channel, delta); break;
+        case 3: add_channel_saturate_n<3>(pixels, count, channel, delta); break;
+        case 4: add_channel_saturate_n<4>(pixels, count, channel, delta); break;
+    }
+}
+
+template <int Channels, int ColorChannels>
+void blend_gray_n(uint8_t* pixels, const uint8_t* gray, int count, float alpha) {
+    const float keep = 1.0f - alpha;
+    for (int i = 0; i < count; i++) {
+        const float g = alpha * gray[i];
+        for (int c = 0; c < ColorChannels; c++) {
+            uint8_t& value = pixels[i * Channels + c];
+            value = saturate_u8(keep * value + g);
+        }
+    }
+}
+
+void blend_gray(uint8_t* pixels, const uint8_t* gray, int count, int channels, float alpha) {
+    switch (channels) {
+        case 1: blend_gray_n<1, 1>(pixels, gray, count, alpha); break;
+        case 2: blend_gray_n<2, 1>(pixels, gray, count, alpha); break;
+        case 3: blend_gray_n<3, 3>(pixels, gray, count, alpha); break;
+        case 4: blend_gray_n<4, 3>(pixels, gray, count, alpha); break;
+    }
+}
+
+template <int Channels, int ColorChannels>
+void blend_color_coverage_n(uint8_t* pixels, const uint8_t* coverage, int count, const float* color, float alpha) {
+    const float weight_scale = alpha / 255.0f;
+    for (int i = 0; i < count; i++) {
+        if (coverage[i] == 0) {
+            continue;
+        }
+        const float weight = coverage[i] * weight_scale;
+        for (int c = 0; c < ColorChannels; c++) {
+            uint8_t& value = pixels[i * Channels + c];
+            value = saturate_u8(value + (color[c] - value) * weight);
+        }
+    }
+}
+
+void blend_color_coverage(uint8_t* pixels, const uint8_t* coverage, int count, int channels,
+                          const float* color, float alpha) {
+    switch (channels) {
+        case 1: blend_color_coverage_n<1, 1>(pixels, coverage, count, color, alpha); break;
+        case 2: blend_color_coverage_n<2, 1>(pixels, coverage, count, color, alpha); break;
+        case 3: blend_color_coverage_n<3, 3>(pixels, coverage, count, color, alpha); break;
+        case 4: blend_color_coverage_n<4, 3>(pixels, coverage, count, color, alpha); break;
+    }
+}
+
+template <int Channels, int ColorChannels>
+void blend_sprite_n(uint8_t* pixels, const uint8_t* sprite, int count, float alpha) {
+    const float weight_scale = alpha / 255.0f;
+    for (int i = 0; i < count; i++) {
+        const uint8_t* source = sprite + i * 4;
+        if (source[3] == 0) {
+            continue;
+        }
+        const float weight = source[3] * weight_scale;
+        if (ColorChannels == 1) {
+            // BT.601亮度
+            const float luma = (source[0] * 77 + source[1] * 150 + source[2] * 29) / 256.0f;
+            uint8_t& value = pixels[i * Channels];
+            value = saturate_u8(value + (luma - value) * weight);
+        } else {
+            for (int c = 0; c < ColorChannels; c++) {
+                uint8_t& value = pixels[i * Channels + c];
+                value = saturate_u8(value + (source[c] - value) * weight);
+            }
+        }
+    }
+}
+
+void blend_sprite(uint8_t* pixels, const uint8_t* sprite, int count, int channels, float alpha) {
+    switch (channels) {
+        case 1: blend_sprite_n<1, 1>(pixels, sprite, count, alpha); break;
+        case 2: blend_sprite_n<2, 1>(pixels, sprite, count, alpha); break;
+        case 3: blend_sprite_n<3, 3>(pixels, sprite, count, alpha); break;
+        case 4: blend_sprite_n<4, 3>(pixels, sprite, count, alpha); break;
+    }
+}
+
+template <int Channels, int ColorChannels>
+void push_contrast_masked_n(uint8_t* pixels, const uint8_t* mask, int count, int delta) {
+    for (int i = 0; i < count; i++) {
+        if (mask[i] == 0) {
+            continue;
+        }
+        for (int c = 0; c < ColorChannels; c++) {
+            uint8_t& value = pixels[i * Channels + c];
+            value = saturate_u8(value < 128 ? value + delta : value - delta);
+        }
+    }
+}
+
+void push_contrast_masked(uint8_t* pixels, const uint8_t* mask, int count, int channels, int delta) {
+    switch (channels) {
+        case 1: push_contrast_masked_n<1, 1>(pixels, mask, count, delta); break;
+        case 2: push_contrast_masked_n<2, 1>(pixels, mask, count, delta); break;
+        case 3: push_contrast_masked_n<3, 3>(pixels, mask, count, delta); break;
+        case 4: push_contrast_masked_n<4, 3>(pixels, mask, count, delta); break;
+    }
+}
+
+template <int Channels>
+void max_abs_diff_n(const uint8_t* a, const uint8_t* b, uint8_t* out, int count) {
+    for (int i = 0; i < count; i++) {
+        int result = 0;
+        for (int c = 0; c < Channels; c++) {
+            int d = a[i * Channels + c] - b[i * Channels + c];
+            d = d < 0 ? -d : d;
+            result = d > result ? d : result;
+        }
+        out[i] = static_cast<uint8_t>(result);
+    }
+}
+
+void max_abs_diff(const uint8_t* a, const uint8_t* b, uint8_t* out, int count, int channels) {
+    switch (channels) {
+        case 1: max_abs_diff_n<1>(a, b, out, count); break;
+        case 2: max_abs_diff_n<2>(a, b, out, count); break;
+        case 3: max_abs_diff_n<3>(a, b, out, count); break;
+        case 4: max_abs_diff_n<4>(a, b, out, count); break;
+    }
+}
+
+void rgba_to_rgb(const uint8_t* src, uint8_t* dst, int count) {
+    for (int i = 0; i < count; i++) {
+        dst[i * 3 + 0] = src[i * 4 + 0];
+        dst[i * 3 + 1] = src[i * 4 + 1];
+        dst[i * 3 + 2] = src[i * 4 + 2];
+    }
+}
+
+template <int Channels>
+void gray_to_rgb_n(const uint8_t* src, uint8_t* dst, int count) {
+    for (int i = 0; i < count; i++) {
+        const uint8_t value = src[i * Channels];
+        dst[i * 3 + 0] = value;
+        dst[i * 3 + 1] = value;
+        dst[i * 3 + 2] = value;
+    }
+}
+
+void gray_to_rgb(const uint8_t* src, uint8_t* dst, int count, int channels) {
+    switch (channels) {
+        case 1: gray_to_rgb_n<1>(src, dst, count); break;
+        case 2: gray_to_rgb_n<2>(src, dst, count); break;
+    }
+}
+
+} // namespace
+} // namespace CPU_KERNELS_NAMESPACE
+
+extern const CpuKernelTable CPU_KERNELS_TABLE;
+const CpuKernelTable CPU_KERNELS_TABLE = {
+    CPU_KERNELS_NAME,
+    &CPU_KERNELS_NAMESPACE::add_channel_saturate,
+    &CPU_KERNELS_NAMESPACE::blend_gray,
+    &CPU_KERNELS_NAMESPACE::blend_color_coverage,
+    &CPU_KERNELS_NAMESPACE::blend_sprite,
+    &CPU_KERNELS_NAMESPACE::push_contrast_masked,
+    &CPU_KERNELS_NAMESPACE::max_abs_diff,
+    &CPU_KERNELS_NAMESPACE::rgba_to_rgb,
+    &CPU_KERNELS_NAMESPACE::gray_to_rgb
+};
+
+} // namespace godot
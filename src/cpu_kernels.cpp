@@ -0,0 +1,113 @@
+#include "cpu_kernels.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#if (defined(__ANDROID__) || defined(__linux__)) && defined(__aarch64__)
+#include <sys/auxv.h>
+#elif defined(__APPLE__) && defined(__aarch64__)
+#include <sys/sysctl.h>
+#endif
+
+namespace godot {
+
+// 各变体的函数表，定义在src/cpu/下按不同指令集编译的源文件中
+extern const CpuKernelTable cpu_kernels_generic;
+#ifdef DIFF_DETECTOR_CPU_AVX2
+extern const CpuKernelTable cpu_kernels_avx2;
+#endif
+
+// 旧版本头文件中可能缺少的hwcap位
+#ifndef HWCAP_ASIMD
+#define HWCAP_ASIMD (1 << 1)
+#endif
+#ifndef HWCAP_ASIMDHP
+#define HWCAP_ASIMDHP (1 << 10)
+#endif
+#ifndef HWCAP_ASIMDDP
+#define HWCAP_ASIMDDP (1 << 20)
+#endif
+
+static CpuFeatures detect_cpu_features() {
+    CpuFeatures features = {};
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+    __builtin_cpu_init();
+    features.avx2 = __builtin_cpu_supports("avx2");
+    features.fma = __builtin_cpu_supports("fma");
+#elif (defined(__ANDROID__) || defined(__linux__)) && defined(__aarch64__)
+    unsigned long hwcap = getauxval(AT_HWCAP);
+    features.neon = (hwcap & HWCAP_ASIMD) != 0;
+    features.dotprod = (hwcap & HWCAP_ASIMDDP) != 0;
+    features.fp16 = (hwcap & HWCAP_ASIMDHP) != 0;
+#elif defined(__APPLE__) && defined(__aarch64__)
+    int value = 0;
+    size_t size = sizeof(value);
+    features.neon = true;
+    features.dotprod = sysctlbyname("hw.optional.arm.FEAT_DotProd", &value, &size, nullptr, 0) == 0 && value != 0;
+    value = 0;
+    size = sizeof(value);
+    features.fp16 = sysctlbyname("hw.optional.arm.FEAT_FP16", &value, &size, nullptr, 0) == 0 && value != 0;
+#elif defined(__aarch64__)
+    features.neon = true;
+#endif
+
+    return features;
+}
+
+const CpuFeatures& get_cpu_features() {
+    static const CpuFeatures features = detect_cpu_features();
+    return features;
+}
+
+std::vector<const CpuKernelTable*> get_available_cpu_kernels() {
+    // 按优先级从低到高排列
+    std::vector<const CpuKernelTable*> available = { &cpu_kernels_generic };
+    const CpuFeatures& features = get_cpu_features();
+
+#ifdef DIFF_DETECTOR_CPU_AVX2
+    if (features.avx2 && features.fma) {
+        available.push_back(&cpu_kernels_avx2);
+    }
+#endif
+
+    (void)features;
+    return available;
+}
+
+static const CpuKernelTable* select_cpu_kernels() {
+    std::vector<const CpuKernelTable*> available = get_available_cpu_kernels();
+
+    // 环境变量可强制指定变体（用于测试），未知或当前CPU不支持时给出警告并使用自动选择的变体
+    const char* forced = std::getenv("DIFF_DETECTOR_CPU");
+    if (forced && forced[0] != '\0') {
+        for (const CpuKernelTable* table : available) {
+            if (std::strcmp(table->name, forced) == 0) {
+                return table;
+            }
+        }
+
+        // 选择在库加载时进行，此时Godot的输出接口尚未初始化，直接写stderr
+        std::string names;
+        for (const CpuKernelTable* table : available) {
+            names += names.empty() ? "" : ", ";
+            names += table->name;
+        }
+        std::fprintf(stderr, "WARNING: DIFF_DETECTOR_CPU=%s is unknown or not supported on this CPU "
+                     "(available: %s), using %s\n", forced, names.c_str(), available.back()->name);
+    }
+
+    return available.back();
+}
+
+const CpuKernelTable& get_cpu_kernels() {
+    static const CpuKernelTable* active = select_cpu_kernels();
+    return *active;
+}
+
+// 库加载时完成选择，避免首次调用热点内核时才检测
+[[maybe_unused]] static const CpuKernelTable& cpu_kernels_at_load = get_cpu_kernels();
+
+} // namespace godot
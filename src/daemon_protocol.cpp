@@ -0,0 +1,309 @@
+#include "daemon_protocol.h"
+
+#include <opencv2/imgcodecs.hpp>
+#include <algorithm>
+#include <cstring>
+
+#if !defined(WIN32) && !defined(_WIN32)
+#include <cerrno>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#define DAEMON_SOCKETS_SUPPORTED 1
+
+// Apple平台没有这两个标志，改用SO_NOSIGPIPE
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+#ifndef SOCK_CLOEXEC
+#define SOCK_CLOEXEC 0
+#endif
+#endif
+
+namespace godot {
+
+static_assert(sizeof(DaemonMessageHeader) == 24, "DaemonMessageHeader layout changed");
+static_assert(sizeof(DaemonGenerateRequest) == 32, "DaemonGenerateRequest layout changed");
+static_assert(sizeof(DaemonPuzzleHeader) == 48, "DaemonPuzzleHeader layout changed");
+
+// ---------------------------------------------------------------------------
+// 套接字
+
+#ifdef DAEMON_SOCKETS_SUPPORTED
+
+static bool write_all(int fd, const void* data, size_t size) {
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    while (size > 0) {
+        // 对端关闭时返回错误而不是触发SIGPIPE
+        ssize_t written = send(fd, bytes, size, MSG_NOSIGNAL);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        bytes += written;
+        size -= static_cast<size_t>(written);
+    }
+    return true;
+}
+
+static bool read_all(int fd, void* data, size_t size) {
+    uint8_t* bytes = static_cast<uint8_t*>(data);
+    while (size > 0) {
+        ssize_t received = recv(fd, bytes, size, 0);
+        if (received == 0) {
+            return false;
+        }
+        if (received < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        bytes += received;
+        size -= static_cast<size_t>(received);
+    }
+    return true;
+}
+
+static bool make_address(const std::string& path, sockaddr_un& address) {
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (path.empty() || path.size() >= sizeof(address.sun_path)) {
+        return false;
+    }
+    memcpy(address.sun_path, path.c_str(), path.size());
+    return true;
+}
+
+bool daemon_write_message(int fd, uint32_t type, uint32_t request_id, const void* payload, size_t size) {
+    DaemonMessageHeader header;
+    memcpy(header.magic, DAEMON_MAGIC, sizeof(header.magic));
+    header.version = DAEMON_PROTOCOL_VERSION;
+    header.type = type;
+    header.request_id = request_id;
+    header.payload_size = size;
+    return write_all(fd, &header, sizeof(header)) && (size == 0 || write_all(fd, payload, size));
+}
+
+bool daemon_read_message(int fd, DaemonMessageHeader& header, std::vector<uint8_t>& payload) {
+    if (!read_all(fd, &header, sizeof(header))) {
+        return false;
+    }
+    if (memcmp(header.magic, DAEMON_MAGIC, sizeof(header.magic)) != 0 ||
+        header.version != DAEMON_PROTOCOL_VERSION || header.payload_size > DAEMON_MAX_PAYLOAD) {
+        return false;
+    }
+    payload.resize(static_cast<size_t>(header.payload_size));
+    return payload.empty() || read_all(fd, payload.data(), payload.size());
+}
+
+int daemon_listen(const std::string& path, int backlog, std::string& error) {
+    sockaddr_un address;
+    if (!make_address(path, address)) {
+        error = "socket path is empty or too long";
+        return -1;
+    }
+
+    // 只删除没有进程监听的遗留套接字，不删除普通文件，也不抢占正在运行的守护进程
+    struct stat info;
+    if (lstat(path.c_str(), &info) == 0) {
+        if (!S_ISSOCK(info.st_mode)) {
+            error = "path exists and is not a socket";
+            return -1;
+        }
+        int probe = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (probe < 0) {
+            error = strerror(errno);
+            return -1;
+        }
+        int connected = connect(probe, reinterpret_cast<sockaddr*>(&address), sizeof(address));
+        int probe_error = errno;
+        close(probe);
+        if (connected == 0) {
+            error = "another daemon is already running on this socket";
+            return -1;
+        }
+        if (probe_error != ECONNREFUSED) {
+            error = strerror(probe_error);
+            return -1;
+        }
+        unlink(path.c_str());
+    }
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        error = strerror(errno);
+        return -1;
+    }
+    if (bind(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 || listen(fd, backlog) != 0) {
+        error = strerror(errno);
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int daemon_connect(const std::string& path) {
+    sockaddr_un address;
+    if (!make_address(path, address)) {
+        return -1;
+    }
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    if (connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0) {
+        close(fd);
+        return -1;
+    }
+#ifdef SO_NOSIGPIPE
+    int enabled = 1;
+    setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &enabled, sizeof(enabled));
+#endif
+    return fd;
+}
+
+void daemon_close(int fd) {
+    if (fd >= 0) {
+        close(fd);
+    }
+}
+
+#else
+
+// 不支持Unix域套接字的平台
+bool daemon_write_message(int, uint32_t, uint32_t, const void*, size_t) {
+    return false;
+}
+
+bool daemon_read_message(int, DaemonMessageHeader&, std::vector<uint8_t>&) {
+    return false;
+}
+
+int daemon_listen(const std::string&, int, std::string& error) {
+    error = "Unix domain sockets are not supported on this platform";
+    return -1;
+}
+
+int daemon_connect(const std::string&) {
+    return -1;
+}
+
+void daemon_close(int) {
+}
+
+#endif
+
+// ---------------------------------------------------------------------------
+// 谜题负载
+
+static void append_blob(std::vector<uint8_t>& payload, const std::vector<uint8_t>& data, uint32_t encoding, PackBlob& blob) {
+    blob.offset = data.empty() ? 0 : payload.size();
+    blob.size = data.size();
+    blob.encoding = data.empty() ? PACK_ENCODING_NONE : encoding;
+    blob.reserved = 0;
+    payload.insert(payload.end(), data.begin(), data.end());
+}
+
+void encode_daemon_puzzle(const DaemonPuzzleHeader& header, const std::vector<DiffInfo>& diffs,
+                          const EncodedPuzzle* encoded, std::vector<uint8_t>& payload) {
+    // 补丁模式使用编码时裁剪到图像内的区域，编码时跳过的空区域差异不发送
+    const std::vector<DiffInfo>& records = encoded ? encoded->diffs : diffs;
+    DaemonPuzzleHeader puzzle_header = header;
+    puzzle_header.diff_count = static_cast<uint32_t>(records.size());
+    puzzle_header.result_mode = encoded ? DAEMON_RESULT_PATCHES : DAEMON_RESULT_RECIPE;
+
+    size_t records_offset = sizeof(DaemonPuzzleHeader);
+    payload.assign(records_offset + records.size() * sizeof(PackDiffRecord), 0);
+    memcpy(payload.data(), &puzzle_header, sizeof(puzzle_header));
+
+    for (size_t i = 0; i < records.size(); i++) {
+        const DiffInfo& info = records[i];
+        PackDiffRecord record;
+        memset(&record, 0, sizeof(record));
+        record.region[0] = info.region.x;
+        record.region[1] = info.region.y;
+        record.region[2] = info.region.width;
+        record.region[3] = info.region.height;
+        record.algorithm_id = info.algorithm_id;
+        record.perceptual_score = info.perceptual_score;
+        record.intensity_scale = info.intensity_scale;
+        record.seed = info.seed;
+        if (encoded) {
+            append_blob(payload, encoded->patches[i], encoded->patch_encodings[i], record.patch);
+        }
+        memcpy(payload.data() + records_offset + i * sizeof(PackDiffRecord), &record, sizeof(record));
+    }
+}
+
+static bool decode_blob_patch(const std::vector<uint8_t>& payload, const PackDiffRecord& record, int channels, cv::Mat& patch) {
+    if (record.patch.offset > payload.size() || record.patch.size > payload.size() - record.patch.offset) {
+        return false;
+    }
+
+    int width = record.region[2];
+    int height = record.region[3];
+    int type = CV_8UC(channels);
+    const uint8_t* blob = payload.data() + record.patch.offset;
+
+    switch (record.patch.encoding) {
+        case PACK_ENCODING_RAW: {
+            if (record.patch.size != static_cast<uint64_t>(width) * height * channels) {
+                return false;
+            }
+            cv::Mat(height, width, type, const_cast<uint8_t*>(blob)).copyTo(patch);
+            return true;
+        }
+        case PACK_ENCODING_PNG: {
+            cv::Mat encoded(1, static_cast<int>(record.patch.size), CV_8UC1, const_cast<uint8_t*>(blob));
+            patch = cv::imdecode(encoded, cv::IMREAD_UNCHANGED);
+            return !patch.empty() && patch.cols == width && patch.rows == height && patch.type() == type;
+        }
+        default:
+            return false;
+    }
+}
+
+bool decode_daemon_puzzle(const std::vector<uint8_t>& payload, DaemonPuzzle& puzzle) {
+    if (payload.size() < sizeof(DaemonPuzzleHeader)) {
+        return false;
+    }
+    memcpy(&puzzle.header, payload.data(), sizeof(DaemonPuzzleHeader));
+
+    const DaemonPuzzleHeader& header = puzzle.header;
+    size_t records_size = static_cast<size_t>(header.diff_count) * sizeof(PackDiffRecord);
+    if (header.channels < 1 || header.channels > 4 || records_size > payload.size() - sizeof(DaemonPuzzleHeader)) {
+        return false;
+    }
+
+    puzzle.diffs.resize(header.diff_count);
+    puzzle.patches.clear();
+    for (uint32_t i = 0; i < header.diff_count; i++) {
+        PackDiffRecord record;
+        memcpy(&record, payload.data() + sizeof(DaemonPuzzleHeader) + i * sizeof(PackDiffRecord), sizeof(record));
+
+        DiffInfo& info = puzzle.diffs[i];
+        info.region = cv::Rect(record.region[0], record.region[1], record.region[2], record.region[3]);
+        info.position = cv::Point(info.region.x + info.region.width / 2, info.region.y + info.region.height / 2);
+        info.size = info.region.size();
+        info.algorithm_id = record.algorithm_id;
+        info.perceptual_score = record.perceptual_score;
+        info.intensity_scale = record.intensity_scale;
+        info.seed = record.seed;
+
+        if (header.result_mode == DAEMON_RESULT_PATCHES) {
+            cv::Mat patch;
+            if (record.patch.encoding != PACK_ENCODING_NONE &&
+                !decode_blob_patch(payload, record, static_cast<int>(header.channels), patch)) {
+                return false;
+            }
+            puzzle.patches.push_back(patch);
+        }
+    }
+    return true;
+}
+
+} // namespace godot
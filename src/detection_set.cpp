@@ -0,0 +1,58 @@
+#include "detection_set.h"
+
+#include <algorithm>
+
+namespace godot {
+
+DetectionSet::DetectionSet() {
+    offsets.push_back(0);
+}
+
+DetectionSet::~DetectionSet() {
+}
+
+void DetectionSet::clear() {
+    class_ids.clear();
+    confidences.clear();
+    boxes.clear();
+    points.clear();
+    offsets.resize(1);
+}
+
+void DetectionSet::reserve(size_t objects, size_t point_count) {
+    class_ids.reserve(objects);
+    confidences.reserve(objects);
+    boxes.reserve(objects);
+    offsets.reserve(objects + 1);
+    points.reserve(point_count);
+}
+
+void DetectionSet::add(int class_id, float confidence, const cv::Rect& bounding_box) {
+    class_ids.push_back(class_id);
+    confidences.push_back(confidence);
+    boxes.push_back(bounding_box);
+    offsets.push_back(offsets.back());
+}
+
+void DetectionSet::add_point(const cv::Point& point) {
+    points.push_back(point);
+    offsets.back()++;
+}
+
+void DetectionSet::scale(double scale_x, double scale_y, const cv::Size& size) {
+    const cv::Rect bounds(0, 0, size.width, size.height);
+    for (cv::Rect& box : boxes) {
+        int x0 = cvFloor(box.x * scale_x);
+        int y0 = cvFloor(box.y * scale_y);
+        int x1 = cvCeil((box.x + box.width) * scale_x);
+        int y1 = cvCeil((box.y + box.height) * scale_y);
+        box = cv::Rect(x0, y0, x1 - x0, y1 - y0) & bounds;
+    }
+
+    for (cv::Point& point : points) {
+        point.x = std::min(std::max(cvRound(point.x * scale_x), 0), size.width - 1);
+        point.y = std::min(std::max(cvRound(point.y * scale_y), 0), size.height - 1);
+    }
+}
+
+} // namespace godot
@@ -0,0 +1,210 @@
+#include "diff_asset_cache.h"
+
+#include <opencv2/imgproc.hpp>
+#include <algorithm>
+#include <random>
+#include <tuple>
+
+namespace godot {
+
+// 默认素材内存预算
+constexpr size_t DEFAULT_ASSET_MEMORY_BUDGET = 32 * 1024 * 1024;
+
+// 形状精灵的超采样倍数，缩小后得到抗锯齿边缘
+constexpr int SPRITE_SUPERSAMPLE = 4;
+
+bool DiffAssetCache::AssetKey::operator<(const AssetKey& other) const {
+    return std::tie(type, size, param, variant) < std::tie(other.type, other.size, other.param, other.variant);
+}
+
+uint32_t DiffAssetCache::AssetKey::seed() const {
+    return static_cast<uint32_t>(type) * 73856093u ^ static_cast<uint32_t>(size) * 19349663u ^
+           static_cast<uint32_t>(param) * 83492791u ^ static_cast<uint32_t>(variant) * 2654435761u;
+}
+
+DiffAssetCache::DiffAssetCache() : memory_usage(0), memory_budget(DEFAULT_ASSET_MEMORY_BUDGET) {
+}
+
+DiffAssetCache::~DiffAssetCache() {
+}
+
+int DiffAssetCache::size_bucket_up(int size) {
+    if (size <= 16) {
+        return std::max(size, 1);
+    }
+    int power = 1;
+    while (power * 2 <= size) {
+        power *= 2;
+    }
+    int step = power / 8;
+    return (size + step - 1) / step * step;
+}
+
+int DiffAssetCache::size_bucket_nearest(int size) {
+    if (size <= 16) {
+        return std::max(size, 1);
+    }
+    int power = 1;
+    while (power * 2 <= size) {
+        power *= 2;
+    }
+    int step = power / 8;
+    return (size + step / 2) / step * step;
+}
+
+const cv::Mat* DiffAssetCache::find(const AssetKey& key) const {
+    auto it = assets.find(key);
+    return it != assets.end() ? &it->second : nullptr;
+}
+
+const cv::Mat& DiffAssetCache::store(const AssetKey& key, cv::Mat asset) {
+    // 素材可随时按键重新生成，超出预算时直接全部清空
+    size_t bytes = asset.total() * asset.elemSize();
+    if (!assets.empty() && memory_usage + bytes > memory_budget) {
+        clear();
+    }
+    memory_usage += bytes;
+    return assets.emplace(key, std::move(asset)).first->second;
+}
+
+const cv::Mat& DiffAssetCache::get_texture_tile(int size, int difficulty, int variant) {
+    difficulty = std::max(1, std::min(10, difficulty));
+    AssetKey key = { ASSET_TEXTURE_TILE, size_bucket_up(size), difficulty, variant };
+    if (const cv::Mat* cached = find(key)) {
+        return *cached;
+    }
+
+    // 难度越高方格越细，与原先逐格绘制的纹理一致
+    int pattern_size = std::max(2, 10 - difficulty / 2);
+    int cells = (key.size + pattern_size - 1) / pattern_size;
+
+    std::mt19937 generator(key.seed());
+    std::uniform_int_distribution<int> value_dist(0, 255);
+    cv::Mat grid(cells, cells, CV_8UC1);
+    for (int i = 0; i < cells; i++) {
+        uint8_t* row = grid.ptr<uint8_t>(i);
+        for (int j = 0; j < cells; j++) {
+            row[j] = static_cast<uint8_t>(value_dist(generator));
+        }
+    }
+
+    cv::Mat expanded;
+    cv::resize(grid, expanded, cv::Size(cells * pattern_size, cells * pattern_size), 0, 0, cv::INTER_NEAREST);
+    return store(key, expanded(cv::Rect(0, 0, key.size, key.size)).clone());
+}
+
+const cv::Mat& DiffAssetCache::get_pattern_mask(int size, int difficulty, int variant) {
+    difficulty = std::max(1, std::min(10, difficulty));
+    AssetKey key = { ASSET_PATTERN_MASK, size_bucket_up(size), difficulty, variant };
+    if (const cv::Mat* cached = find(key)) {
+        return *cached;
+    }
+
+    // 与原先逐像素掷随机数的规则相同，只在生成时计算一次
+    std::mt19937 generator(key.seed());
+    std::uniform_int_distribution<int> pattern_dist(0, difficulty);
+    cv::Mat mask(key.size, key.size, CV_8UC1);
+    for (int i = 0; i < key.size; i++) {
+        uint8_t* row = mask.ptr<uint8_t>(i);
+        for (int j = 0; j < key.size; j++) {
+            row[j] = (i + j) % (difficulty + 1) == pattern_dist(generator) ? 255 : 0;
+        }
+    }
+    return store(key, std::move(mask));
+}
+
+const cv::Mat& DiffAssetCache::get_shape_sprite(int shape, int size) {
+    AssetKey key = { ASSET_SHAPE_SPRITE, size_bucket_nearest(size), shape, 0 };
+    if (const cv::Mat* cached = find(key)) {
+        return *cached;
+    }
+
+    // 在超采样画布上绘制后按面积缩小，得到抗锯齿的不透明度
+    int canvas_size = key.size * SPRITE_SUPERSAMPLE;
+    int last = canvas_size - 1;
+    cv::Mat canvas = cv::Mat::zeros(canvas_size, canvas_size, CV_8UC1);
+    switch (shape) {
+        case DIFF_SHAPE_CIRCLE:
+            cv::circle(canvas, cv::Point(canvas_size / 2, canvas_size / 2), canvas_size / 2, cv::Scalar(255), -1);
+            break;
+        case DIFF_SHAPE_RECTANGLE:
+            canvas.setTo(cv::Scalar(255));
+            break;
+        default: {
+            std::vector<cv::Point> triangle = { cv::Point(canvas_size / 2, 0), cv::Point(0, last), cv::Point(last, last) };
+            cv::fillPoly(canvas, std::vector<std::vector<cv::Point>>{triangle}, cv::Scalar(255));
+            break;
+        }
+    }
+
+    cv::Mat sprite;
+    cv::resize(canvas, sprite, cv::Size(key.size, key.size), 0, 0, cv::INTER_AREA);
+    return store(key, std::move(sprite));
+}
+
+const cv::Mat& DiffAssetCache::get_sticker(int index, int size) {
+    AssetKey key = { ASSET_STICKER, size_bucket_nearest(size), index, 0 };
+    if (const cv::Mat* cached = find(key)) {
+        return *cached;
+    }
+
+    // 保持长宽比，长边缩放到尺寸档位
+    const cv::Mat& source = stickers[index];
+    double scale = static_cast<double>(key.size) / std::max(source.cols, source.rows);
+    cv::Size scaled_size(std::max(1, cvRound(source.cols * scale)), std::max(1, cvRound(source.rows * scale)));
+    cv::Mat sticker;
+    cv::resize(source, sticker, scaled_size, 0, 0, scale < 1.0 ? cv::INTER_AREA : cv::INTER_LINEAR);
+    return store(key, std::move(sticker));
+}
+
+int DiffAssetCache::add_sticker(const cv::Mat& rgba) {
+    stickers.push_back(rgba.clone());
+    return static_cast<int>(stickers.size()) - 1;
+}
+
+void DiffAssetCache::clear_stickers() {
+    stickers.clear();
+    clear();
+}
+
+int DiffAssetCache::get_sticker_count() const {
+    return static_cast<int>(stickers.size());
+}
+
+const std::vector<cv::Mat>& DiffAssetCache::get_stickers() const {
+    return stickers;
+}
+
+void DiffAssetCache::set_stickers(const std::vector<cv::Mat>& source) {
+    bool same = source.size() == stickers.size();
+    for (size_t i = 0; same && i < source.size(); i++) {
+        same = source[i].data == stickers[i].data;
+    }
+    if (same) {
+        return;
+    }
+    stickers = source;
+    clear();
+}
+
+void DiffAssetCache::set_memory_budget(size_t bytes) {
+    memory_budget = bytes;
+    if (memory_usage > memory_budget) {
+        clear();
+    }
+}
+
+size_t DiffAssetCache::get_memory_budget() const {
+    return memory_budget;
+}
+
+size_t DiffAssetCache::get_memory_usage() const {
+    return memory_usage;
+}
+
+void DiffAssetCache::clear() {
+    assets.clear();
+    memory_usage = 0;
+}
+
+} // namespace godot
@@ -1,23 +1,45 @@
 #include "diff_detector.h"
 #include "diff_generator.h"
 #include "yolo_detector.h"
+#include "puzzle_prefetcher.h"
+#include "puzzle_validator.h"
+#include "stream_session.h"
+#include "cpu_kernels.h"
+#include "image_decode.h"
 
 #include <godot_cpp/core/class_db.hpp>
 #include <godot_cpp/core/error_macros.hpp>
+#include <godot_cpp/variant/packed_float32_array.hpp>
+#include <godot_cpp/variant/packed_int32_array.hpp>
+#include <godot_cpp/variant/packed_vector2_array.hpp>
 #include <godot_cpp/variant/utility_functions.hpp>
+#include <opencv2/imgcodecs.hpp>
 #include <opencv2/imgproc.hpp>
 
+#include <algorithm>
+#include <chrono>
+#include <cmath>
 #include <filesystem>
+#include <future>
 
 namespace godot {
 
-DiffDetector::DiffDetector() : diff_count(5), difficulty(1) {
+DiffDetector::DiffDetector() : detector_busy(false), foreground_waiting(0),
+                               diff_count(5), difficulty(1), output_format(Image::FORMAT_RGB8), stream_stats(),
+                               memory_plan{ MEMORY_STRATEGY_STANDARD, 1, 0 },
+                               diff_scale(1) {
     diff_generator = std::make_unique<DiffGenerator>();
     yolo_detector = std::make_unique<YoloDetector>();
+    validator = std::make_unique<PuzzleValidator>();
+    prefetcher = std::make_unique<PuzzlePrefetcher>(
+        [this](const cv::Mat& image, DetectionSet& detections) {
+            return run_detection(image, detections, false);
+        });
 }
 
 DiffDetector::~DiffDetector() {
-    // 智能指针会自动清理资源
+    // 先停止预取线程，它们会访问检测器
+    prefetcher.reset();
 }
 
 bool DiffDetector::initialize() {
@@ -28,12 +50,17 @@ bool DiffDetector::initialize() {
     model_path += "android/";
     #elif defined(__APPLE__)
     model_path += "ios/";
+    #elif defined(__linux__)
+    model_path += "linux/";
     #endif
     
     model_path += "assets/yolo11s-seg_float16.tflite";
     
     // 初始化YOLO检测器
-    if (!yolo_detector->initialize(model_path)) {
+    acquire_detector(true);
+    bool initialized = yolo_detector->initialize(model_path);
+    release_detector();
+    if (!initialized) {
         UtilityFunctions::print("Failed to initialize YOLO detector with model: ", model_path.c_str());
         return false;
     }
@@ -42,7 +69,7 @@ bool DiffDetector::initialize() {
     return true;
 }
 
-Ref<Image> DiffDetector::generate_diff_image(const Ref<Image>& source_image, int count, int diff) {
+Ref<Image> DiffDetector::generate_diff_image(const Ref<Image>& source_image, int count, int diff, double time_budget_ms) {
     // 参数验证
     if (source_image.is_null()) {
         UtilityFunctions::print_error("Source image is null");
@@ -53,72 +80,965 @@ Ref<Image> DiffDetector::generate_diff_image(const Ref<Image>& source_image, int
     if (count < 5) count = 5;
     if (count > 10) count = 10;
     
+    auto start_time = std::chrono::steady_clock::now();
+    
     // 设置内部参数
     set_diff_count(count);
     set_difficulty(diff);
     
-    // 将Godot图像转换为OpenCV格式
-    PackedByteArray image_data = source_image->get_data();
     int width = source_image->get_width();
     int height = source_image->get_height();
-    int components = source_image->get_format() >= Image::FORMAT_RGB8 ? 3 : 4;
+    int channels = get_format_channels(source_image->get_format());
+    if (channels == 0) {
+        UtilityFunctions::print_error("Unsupported image format: ", source_image->get_format(), " (expected L8, LA8, RGB8 or RGBA8)");
+        return source_image;
+    }
     
-    cv::Mat cv_image(height, width, components == 3 ? CV_8UC3 : CV_8UC4, image_data.ptrw());
+    // 按预算选择策略；被拒绝时保留上次生成的reroll_diff状态，通过后才释放
+    MemoryPlanInput plan_input = { width, height, channels, source_image->has_mipmaps(), false, false };
+    if (!plan_memory(plan_input)) {
+        return source_image;
+    }
+    release_generation_state();
+    memory_governor.begin_call();
     
-    // 如果是RGBA，需要转换为RGB
-    if (components == 4) {
-        cv::cvtColor(cv_image, cv_image, cv::COLOR_RGBA2RGB);
+    Ref<Image> modified_image;
+    if (memory_plan.strategy == MEMORY_STRATEGY_STANDARD) {
+        // 按原始像素布局包装为OpenCV格式，不做颜色转换
+        cv::Mat cv_image;
+        if (!create_working_image(source_image, cv_image)) {
+            return source_image;
+        }
+        memory_governor.acquire(MemoryGovernor::mat_bytes(cv_image));
+        
+        // 运行YOLO检测
+        DetectionSet detections;
+        if (!run_planned_detection(cv_image, detections)) {
+            UtilityFunctions::print_error("YOLO detection failed");
+            return source_image;
+        }
+        
+        if (!generate_on_working(cv_image, detections, source_image->get_format(), start_time, time_budget_ms)) {
+            return source_image;
+        }
+        
+        // 创建修改后的Godot图像
+        modified_image = create_output_image(working_image, cv::Rect(0, 0, width, height), output_format);
+        memory_governor.acquire(MemoryGovernor::mat_bytes(working_image));
+    } else {
+        // 直接在输出缓冲区上生成：源数据只读访问，代理策略在复制时按整数倍缩小
+        PackedByteArray source_data = source_image->get_data();
+        cv::Mat source_view(height, width, CV_8UC(channels), const_cast<uint8_t*>(source_data.ptr()));
+        cv::Size working_size(std::max(1, width / memory_plan.scale), std::max(1, height / memory_plan.scale));
+        
+        PackedByteArray output_data;
+        output_data.resize(static_cast<int64_t>(working_size.area()) * channels);
+        cv::Mat cv_image(working_size, CV_8UC(channels), output_data.ptrw());
+        MemoryGovernor::downscale(source_view, memory_plan.scale, cv_image);
+        memory_governor.acquire(MemoryGovernor::mat_bytes(cv_image));
+        
+        DetectionSet detections;
+        if (!run_planned_detection(cv_image, detections)) {
+            UtilityFunctions::print_error("YOLO detection failed");
+            return source_image;
+        }
+        
+        if (!generate_on_working(cv_image, detections, source_image->get_format(), start_time, time_budget_ms)) {
+            return source_image;
+        }
+        
+        // 输出图像与此处共享缓冲区，先放开本地引用，生成mipmap时不再复制
+        modified_image = Image::create_from_data(working_size.width, working_size.height, false, output_format, output_data);
+        output_data = PackedByteArray();
     }
     
-    // 运行YOLO检测
-    if (!yolo_detector->detect(cv_image)) {
-        UtilityFunctions::print_error("YOLO detection failed");
-        return source_image;
+    if (source_image->has_mipmaps()) {
+        // 重新分配带mipmap的数据，旧数据在复制完成后释放
+        size_t base_bytes = static_cast<size_t>(modified_image->get_data().size());
+        modified_image->generate_mipmaps();
+        memory_governor.acquire(static_cast<size_t>(modified_image->get_data().size()));
+        memory_governor.release(base_bytes);
+    }
+    return modified_image;
+}
+
+bool DiffDetector::plan_memory(const MemoryPlanInput& input) {
+    planned_source_size = cv::Size(input.width, input.height);
+    memory_plan = memory_governor.plan(input);
+    if (memory_plan.strategy == MEMORY_STRATEGY_REJECT) {
+        UtilityFunctions::print_error("Image ", input.width, "x", input.height, " needs at least ",
+                                      static_cast<int64_t>(memory_plan.estimated_peak / (1024 * 1024)),
+                                      " MB with the lowest-memory strategy, memory budget is ",
+                                      static_cast<int64_t>(memory_governor.get_budget() / (1024 * 1024)), " MB");
+        return false;
+    }
+    return true;
+}
+
+bool DiffDetector::run_planned_detection(const cv::Mat& image, DetectionSet& detections) {
+    if (memory_plan.strategy == MEMORY_STRATEGY_STANDARD || memory_plan.strategy == MEMORY_STRATEGY_IN_PLACE) {
+        // 非RGB布局时检测前转换出一份全分辨率RGB
+        size_t input_bytes = image.channels() == 3 ? 0 : image.total() * (image.channels() == 2 ? 4 : 3);
+        memory_governor.acquire(input_bytes);
+        bool detected = run_detection(image, detections);
+        memory_governor.release(input_bytes);
+        return detected;
+    }
+    
+    // 模型输入只有640像素，先在源布局上缩小再转换，结果按实际比例映射回工作图像
+    cv::Mat reduced;
+    MemoryGovernor::downscale(image, MemoryGovernor::get_detection_reduce_factor(image.cols, image.rows), reduced);
+    size_t input_bytes = MemoryGovernor::mat_bytes(reduced) + reduced.total() * 3;
+    memory_governor.acquire(input_bytes);
+    bool detected = run_detection(reduced, detections);
+    memory_governor.release(input_bytes);
+    if (detected) {
+        detections.scale(static_cast<double>(image.cols) / reduced.cols,
+                         static_cast<double>(image.rows) / reduced.rows, image.size());
+    }
+    return detected;
+}
+
+void DiffDetector::release_generation_state() {
+    working_image.release();
+    original_working.release();
+    label_map.clear();
+}
+
+bool DiffDetector::generate_on_working(cv::Mat& cv_image, const DetectionSet& detections, Image::Format format,
+                                       std::chrono::steady_clock::time_point start_time, double time_budget_ms) {
+    // 标准策略保留原始工作缓冲区和检测结果，供reroll_diff只恢复并重新生成单个差异
+    bool keep_reroll_state = memory_plan.strategy == MEMORY_STRATEGY_STANDARD;
+    if (keep_reroll_state) {
+        original_working = cv_image.clone();
+        memory_governor.acquire(MemoryGovernor::mat_bytes(original_working));
     }
+    cached_detections = detections;
+    output_format = format;
     
-    // 获取检测结果
-    const std::vector<DetectedObject>& detections = yolo_detector->get_detections();
+    // 每张图像只构建一次实例标签图，生成和之后的reroll_diff共用
+    label_map.build(cv_image.size(), detections);
+    size_t label_bytes = MemoryGovernor::mat_bytes(label_map.get_labels());
+    memory_governor.acquire(label_bytes);
     
     // 生成差异（修改cv_image）
     generated_diffs.clear();
-    bool diff_result = diff_generator->generate_diffs(cv_image, detections, diff_count, difficulty, generated_diffs);
+    
+    // 解码和检测已消耗的时间从预算中扣除，剩余部分用于差异生成
+    double elapsed_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start_time).count();
+    double diff_budget_ms = DiffGenerator::remaining_time_budget(time_budget_ms, elapsed_ms);
+    bool diff_result = diff_generator->generate_diffs(cv_image, detections, diff_count, difficulty, generated_diffs,
+                                                      diff_budget_ms, &label_map);
     
     if (!diff_result) {
         UtilityFunctions::print_error("Failed to generate differences");
-        return source_image;
+        release_generation_state();
+        return false;
     }
     
-    // 如果需要转回RGBA格式
-    if (components == 4) {
-        cv::cvtColor(cv_image, cv_image, cv::COLOR_RGB2RGBA);
+    diff_source_size = planned_source_size;
+    diff_image_size = cv_image.size();
+    diff_scale = memory_plan.scale;
+    
+    if (keep_reroll_state) {
+        working_image = cv_image;
+    } else {
+        // 工作缓冲区即输出缓冲区，不保留reroll_diff状态
+        label_map.clear();
+        memory_governor.release(label_bytes);
+    }
+    return true;
+}
+
+// 记录由文件解码得到的工作缓冲区：转换为RGB顺序前的解码结果与其短暂并存（灰度时为同一缓冲区）
+static void account_decoded_working(MemoryGovernor& governor, const cv::Mat& working) {
+    size_t bytes = MemoryGovernor::mat_bytes(working);
+    governor.acquire(working.channels() == 1 ? bytes : bytes * 2);
+    governor.release(working.channels() == 1 ? 0 : bytes);
+}
+
+Ref<Image> DiffDetector::generate_diff_from_buffer(const PackedByteArray& buffer, int count, int diff, double time_budget_ms) {
+    if (buffer.is_empty()) {
+        UtilityFunctions::print_error("Image buffer is empty");
+        return Ref<Image>();
     }
     
-    // 创建修改后的Godot图像
-    Ref<Image> modified_image = source_image->duplicate();
-    PackedByteArray modified_data;
-    modified_data.resize(image_data.size());
+    // 限制差异点数量
+    if (count < 5) count = 5;
+    if (count > 10) count = 10;
+    
+    auto start_time = std::chrono::steady_clock::now();
+    
+    set_diff_count(count);
+    set_difficulty(diff);
+    
+    // 直接引用调用方的缓冲区，函数返回前所有解码都已完成
+    const uint8_t* data = buffer.ptr();
+    size_t size = static_cast<size_t>(buffer.size());
+    cv::Mat encoded(1, static_cast<int>(size), CV_8UC1, const_cast<uint8_t*>(data));
+    
+    // JPEG和PNG从文件头读取尺寸，解码前即可按内存预算选择策略
+    int source_width = 0;
+    int source_height = 0;
+    int source_channels = 3;
+    bool is_jpeg = read_jpeg_size(data, size, source_width, source_height);
+    bool size_known = is_jpeg || read_png_size(data, size, source_width, source_height, source_channels);
+    
+    int full_flags = get_image_decode_flags(is_jpeg);
+    
+    // 其它格式只能先完整解码再选择策略
+    cv::Mat decoded;
+    if (!size_known) {
+        decoded = cv::imdecode(encoded, full_flags);
+        if (decoded.empty()) {
+            UtilityFunctions::print_error("Cannot decode image buffer");
+            return Ref<Image>();
+        }
+        source_width = decoded.cols;
+        source_height = decoded.rows;
+        source_channels = decoded.channels();
+    }
+    
+    // 被拒绝时保留上次生成的reroll_diff状态，通过后才释放
+    MemoryPlanInput plan_input = { source_width, source_height, source_channels, false, true, is_jpeg };
+    if (!plan_memory(plan_input)) {
+        return Ref<Image>();
+    }
+    release_generation_state();
+    memory_governor.begin_call();
+    memory_governor.acquire(MemoryGovernor::mat_bytes(decoded));
+    
+    cv::Mat cv_image;
+    DetectionSet detections;
+    PackedByteArray output_data;
+    if (memory_plan.strategy == MEMORY_STRATEGY_STANDARD) {
+        // JPEG可在DCT阶段按1/2、1/4、1/8缩小解码，选择长边仍不低于检测输入的最大倍数
+        int reduce_factor = is_jpeg ? get_reduced_decode_factor(source_width, source_height) : 1;
+        int reduce_flag = get_reduced_decode_flags(reduce_factor);
+        
+        if (reduce_factor > 1) {
+            // 全分辨率解码与缩小图像上的检测并行进行
+            std::future<bool> full_decode = std::async(std::launch::async, [&encoded, full_flags, &cv_image]() {
+                return decode_image_buffer(encoded, full_flags, cv_image);
+            });
+            
+            cv::Mat reduced;
+            bool detected = decode_image_buffer(encoded, reduce_flag, reduced) && run_detection(reduced, detections);
+            bool decoded_full = full_decode.get();
+            if (!decoded_full) {
+                UtilityFunctions::print_error("Cannot decode image buffer");
+                return Ref<Image>();
+            }
+            if (!detected) {
+                UtilityFunctions::print_error("YOLO detection failed");
+                return Ref<Image>();
+            }
+            
+            // 按实际尺寸换算，解码器不支持缩小解码时比例为1
+            detections.scale(static_cast<double>(cv_image.cols) / reduced.cols,
+                             static_cast<double>(cv_image.rows) / reduced.rows, cv_image.size());
+            account_decoded_working(memory_governor, cv_image);
+        } else {
+            if (decoded.empty()) {
+                if (!decode_image_buffer(encoded, full_flags, cv_image)) {
+                    UtilityFunctions::print_error("Cannot decode image buffer");
+                    return Ref<Image>();
+                }
+                account_decoded_working(memory_governor, cv_image);
+            } else {
+                size_t decoded_bytes = MemoryGovernor::mat_bytes(decoded);
+                if (!convert_decoded_image(decoded, cv_image)) {
+                    UtilityFunctions::print_error("Cannot decode image buffer");
+                    return Ref<Image>();
+                }
+                decoded.release();
+                memory_governor.acquire(MemoryGovernor::mat_bytes(cv_image));
+                memory_governor.release(decoded_bytes);
+            }
+            if (!run_planned_detection(cv_image, detections)) {
+                UtilityFunctions::print_error("YOLO detection failed");
+                return Ref<Image>();
+            }
+        }
+    } else {
+        if (decoded.empty()) {
+            // 代理倍数只会是2、4、8，由解码器直接缩小解码
+            int flags = full_flags;
+            if (memory_plan.strategy == MEMORY_STRATEGY_PROXY) {
+                flags = get_reduced_decode_flags(memory_plan.scale);
+            }
+            decoded = cv::imdecode(encoded, flags);
+            if (decoded.empty()) {
+                UtilityFunctions::print_error("Cannot decode image buffer");
+                return Ref<Image>();
+            }
+            memory_governor.acquire(MemoryGovernor::mat_bytes(decoded));
+        }
+        
+        // 解码结果直接转换到输出缓冲区，之后在其上生成
+        size_t decoded_bytes = MemoryGovernor::mat_bytes(decoded);
+        output_data.resize(static_cast<int64_t>(decoded.total()) * decoded.channels());
+        cv_image = cv::Mat(decoded.size(), CV_8UC(decoded.channels()), output_data.ptrw());
+        memory_governor.acquire(MemoryGovernor::mat_bytes(cv_image));
+        if (!convert_decoded_image(decoded, cv_image)) {
+            UtilityFunctions::print_error("Cannot decode image buffer");
+            return Ref<Image>();
+        }
+        decoded.release();
+        memory_governor.release(decoded_bytes);
+        
+        if (!run_planned_detection(cv_image, detections)) {
+            UtilityFunctions::print_error("YOLO detection failed");
+            return Ref<Image>();
+        }
+    }
+    
+    if (!generate_on_working(cv_image, detections, get_channels_format(cv_image.channels()), start_time, time_budget_ms)) {
+        return Ref<Image>();
+    }
+    
+    if (memory_plan.strategy != MEMORY_STRATEGY_STANDARD) {
+        return Image::create_from_data(cv_image.cols, cv_image.rows, false, output_format, output_data);
+    }
+    memory_governor.acquire(MemoryGovernor::mat_bytes(working_image));
+    return create_output_image(working_image, cv::Rect(0, 0, working_image.cols, working_image.rows), output_format);
+}
+
+Dictionary DiffDetector::reroll_diff(int index, const Dictionary& options) {
+    Dictionary result;
+    
+    if (working_image.empty() || original_working.empty()) {
+        if (memory_plan.strategy != MEMORY_STRATEGY_STANDARD && !generated_diffs.empty()) {
+            UtilityFunctions::print_error("reroll_diff is not available after generating with memory strategy ",
+                                          MemoryGovernor::get_strategy_name(memory_plan.strategy));
+        } else {
+            UtilityFunctions::print_error("reroll_diff called before generate_diff_image");
+        }
+        return result;
+    }
+    if (index < 0 || index >= static_cast<int>(generated_diffs.size())) {
+        UtilityFunctions::print_error("Diff index out of range: ", index);
+        return result;
+    }
+    
+    // 解析选项
+    int reroll_difficulty = options.get("difficulty", difficulty);
+    int algorithm_id = options.get("algorithm_id", -1);
+    bool new_region = options.get("new_region", false);
+    bool full_image = options.get("full_image", false);
+    
+    reroll_difficulty = std::max(1, std::min(10, reroll_difficulty));
+    cv::Rect previous_region = generated_diffs[index].region;
+    
+    // 只恢复并重新生成该差异所在区域
+    if (!diff_generator->reroll_diff(working_image, original_working, cached_detections, index,
+                                     reroll_difficulty, algorithm_id, new_region, generated_diffs, &label_map)) {
+        UtilityFunctions::print_error("Failed to reroll diff ", index);
+        return result;
+    }
+    
+    const DiffInfo& info = generated_diffs[index];
     
-    // 复制OpenCV图像数据到Godot图像
-    memcpy(modified_data.ptrw(), cv_image.data, cv_image.total() * cv_image.elemSize());
-    modified_image->set_data(width, height, false, source_image->get_format(), modified_data);
+    result["index"] = index;
+    result["diff"] = create_diff_dictionary(info);
+    result["region"] = Rect2i(info.region.x, info.region.y, info.region.width, info.region.height);
+    result["patch"] = create_output_image(working_image, info.region, output_format);
+    
+    // 区域变化时，旧区域已恢复为原图像素
+    if (previous_region != info.region) {
+        result["previous_region"] = Rect2i(previous_region.x, previous_region.y, previous_region.width, previous_region.height);
+        result["restored_patch"] = create_output_image(working_image, previous_region, output_format);
+    }
+    
+    if (full_image) {
+        result["image"] = create_output_image(working_image, cv::Rect(0, 0, working_image.cols, working_image.rows), output_format);
+    }
+    
+    return result;
+}
+
+Dictionary DiffDetector::create_diff_dictionary(const DiffInfo& diff) {
+    Dictionary diff_dict;
+    diff_dict["position"] = Vector2(diff.position.x, diff.position.y);
+    diff_dict["size"] = (diff.size.width + diff.size.height) / 2.0f;
+    diff_dict["algorithm_id"] = diff.algorithm_id;
+    diff_dict["region"] = Rect2i(diff.region.x, diff.region.y, diff.region.width, diff.region.height);
+    diff_dict["perceptual_score"] = diff.perceptual_score;
+    diff_dict["intensity_scale"] = diff.intensity_scale;
+    return diff_dict;
+}
+
+void DiffDetector::acquire_detector(bool foreground) {
+    std::unique_lock<std::mutex> lock(detector_mutex);
+    if (foreground) {
+        // 登记等待中的前台请求，当前推理结束后预取线程不会再抢到检测器
+        foreground_waiting++;
+        detector_condition.wait(lock, [this] { return !detector_busy; });
+        foreground_waiting--;
+    } else {
+        detector_condition.wait(lock, [this] { return !detector_busy && foreground_waiting == 0; });
+    }
+    detector_busy = true;
+}
+
+void DiffDetector::release_detector() {
+    {
+        std::lock_guard<std::mutex> lock(detector_mutex);
+        detector_busy = false;
+    }
+    detector_condition.notify_all();
+}
+
+bool DiffDetector::run_detection(const cv::Mat& image, DetectionSet& detections, bool foreground) {
+    // 模型需要RGB输入，差异生成仍在原始布局上进行
+    cv::Mat detector_input;
+    if (!YoloDetector::prepare_input(image, detector_input)) {
+        return false;
+    }
+    
+    // 检测器在主线程与预取线程间共享，推理需串行执行
+    acquire_detector(foreground);
+    bool detected = yolo_detector->detect(detector_input);
+    if (detected) {
+        detections = yolo_detector->get_detections();
+    }
+    release_detector();
+    return detected;
+}
+
+int DiffDetector::get_format_channels(Image::Format format) {
+    // 只支持每通道8位、可直接按像素布局处理的格式
+    switch (format) {
+        case Image::FORMAT_L8: return 1;
+        case Image::FORMAT_LA8: return 2;
+        case Image::FORMAT_RGB8: return 3;
+        case Image::FORMAT_RGBA8: return 4;
+        default: return 0;
+    }
+}
+
+Image::Format DiffDetector::get_channels_format(int channels) {
+    switch (channels) {
+        case 1: return Image::FORMAT_L8;
+        case 2: return Image::FORMAT_LA8;
+        case 4: return Image::FORMAT_RGBA8;
+        default: return Image::FORMAT_RGB8;
+    }
+}
+
+bool DiffDetector::create_working_image(const Ref<Image>& image, cv::Mat& working) {
+    int channels = get_format_channels(image->get_format());
+    if (channels == 0) {
+        UtilityFunctions::print_error("Unsupported image format: ", image->get_format(), " (expected L8, LA8, RGB8 or RGBA8)");
+        return false;
+    }
+    
+    // 带mipmap时数据开头即为第0级；只读访问，不触发写时复制
+    PackedByteArray image_data = image->get_data();
+    cv::Mat view(image->get_height(), image->get_width(), CV_8UC(channels), const_cast<uint8_t*>(image_data.ptr()));
+    
+    // 工作缓冲区需要自有内存以便在调用结束后继续使用
+    working = view.clone();
+    return true;
+}
+
+Ref<Image> DiffDetector::create_output_image(const cv::Mat& image, const cv::Rect& region, Image::Format format) {
+    cv::Mat roi = image(region);
+    
+    // 逐行复制OpenCV图像数据到Godot图像，像素布局与源格式一致
+    size_t row_bytes = roi.cols * roi.elemSize();
+    PackedByteArray output_data;
+    output_data.resize(row_bytes * roi.rows);
+    for (int i = 0; i < roi.rows; i++) {
+        memcpy(output_data.ptrw() + i * row_bytes, roi.ptr(i), row_bytes);
+    }
+    
+    return Image::create_from_data(region.width, region.height, false, format, output_data);
+}
+
+bool DiffDetector::prefetch_level(int64_t level_id, const Ref<Image>& source_image, int count, int diff) {
+    if (source_image.is_null()) {
+        UtilityFunctions::print_error("Source image is null");
+        return false;
+    }
+    
+    // 图像复制在调用线程完成，工作线程只处理OpenCV数据
+    cv::Mat cv_image;
+    if (!create_working_image(source_image, cv_image)) {
+        return false;
+    }
+    
+    // 带上当前的自定义算法、启用状态、校准次数和贴纸，预取结果与generate_diff_image一致
+    return prefetcher->enqueue(level_id, cv_image, source_image->get_format(),
+                               std::max(5, std::min(10, count)), std::max(1, std::min(10, diff)),
+                               diff_generator->get_config());
+}
+
+Dictionary DiffDetector::take_prefetched(int64_t level_id) {
+    Dictionary result;
+    
+    PrefetchedPuzzle puzzle;
+    if (!prefetcher->take(level_id, puzzle)) {
+        return result;
+    }
+    
+    Array diffs;
+    Array patches;
+    for (size_t i = 0; i < puzzle.diffs.size(); i++) {
+        const DiffInfo& diff = puzzle.diffs[i];
+        
+        diffs.push_back(create_diff_dictionary(diff));
+        
+        Dictionary patch_dict;
+        patch_dict["region"] = Rect2i(diff.region.x, diff.region.y, diff.region.width, diff.region.height);
+        patch_dict["image"] = create_output_image(puzzle.patches[i], cv::Rect(0, 0, diff.region.width, diff.region.height),
+                                                  static_cast<Image::Format>(puzzle.format));
+        patches.push_back(patch_dict);
+    }
+    
+    result["level_id"] = level_id;
+    result["diffs"] = diffs;
+    result["patches"] = patches;
+    return result;
+}
+
+Ref<Image> DiffDetector::apply_puzzle_patches(const Ref<Image>& source_image, const Dictionary& puzzle) const {
+    if (source_image.is_null()) {
+        UtilityFunctions::print_error("Source image is null");
+        return source_image;
+    }
+    
+    Ref<Image> modified_image = source_image->duplicate();
+    Array patches = puzzle.get("patches", Array());
+    for (int i = 0; i < patches.size(); i++) {
+        Dictionary patch_dict = patches[i];
+        Ref<Image> patch = patch_dict["image"];
+        Rect2i region = patch_dict["region"];
+        if (patch.is_valid()) {
+            modified_image->blit_rect(patch, Rect2i(Vector2i(), region.size), region.position);
+        }
+    }
     
     return modified_image;
 }
 
+void DiffDetector::start_stream(int count, int diff, const Dictionary& options) {
+    // 流式会话在主线程上与generate_diff_image共享生成器（包括自定义算法）
+    stream_session = std::make_unique<StreamSession>(*diff_generator,
+        [this](const cv::Mat& image, DetectionSet& detections) {
+            return run_detection(image, detections);
+        });
+    
+    StreamOptions stream_options = stream_session->get_options();
+    stream_options.detect_interval = options.get("detect_interval", stream_options.detect_interval);
+    stream_options.scene_change_threshold = options.get("scene_change_threshold", stream_options.scene_change_threshold);
+    stream_options.search_margin = std::max(1, static_cast<int>(options.get("search_margin", stream_options.search_margin)));
+    stream_options.min_track_score = options.get("min_track_score", stream_options.min_track_score);
+    stream_session->set_options(stream_options);
+    
+    stream_session->start(std::max(5, std::min(10, count)), std::max(1, std::min(10, diff)));
+    stream_stats = StreamFrameStats();
+}
+
+Ref<Image> DiffDetector::process_stream_frame(const Ref<Image>& frame) {
+    if (frame.is_null()) {
+        UtilityFunctions::print_error("Frame image is null");
+        return frame;
+    }
+    if (!stream_session) {
+        UtilityFunctions::print_error("Stream not started, call start_stream first");
+        return frame;
+    }
+    
+    int channels = get_format_channels(frame->get_format());
+    if (channels == 0) {
+        UtilityFunctions::print_error("Unsupported image format: ", frame->get_format(), " (expected L8, LA8, RGB8 or RGBA8)");
+        return frame;
+    }
+    
+    // 每帧只复制一次：取得写指针时数据与输入图像分离，差异直接写入这份缓冲区，
+    // 输出图像与它共享数据。带mipmap时只保留第0级
+    int width = frame->get_width();
+    int height = frame->get_height();
+    PackedByteArray frame_data = frame->get_data();
+    frame_data.resize(static_cast<int64_t>(width) * height * channels);
+    cv::Mat cv_frame(height, width, CV_8UC(channels), frame_data.ptrw());
+    
+    if (!stream_session->process_frame(cv_frame, stream_stats)) {
+        UtilityFunctions::print_error("Failed to process stream frame");
+        return frame;
+    }
+    
+    return Image::create_from_data(width, height, false, frame->get_format(), frame_data);
+}
+
+Array DiffDetector::get_stream_diff_data() const {
+    Array result;
+    if (!stream_session) {
+        return result;
+    }
+    
+    for (const auto& diff : stream_session->get_diffs()) {
+        result.push_back(create_diff_dictionary(diff));
+    }
+    return result;
+}
+
+Dictionary DiffDetector::get_stream_stats() const {
+    Dictionary stats;
+    stats["frame_index"] = stream_stats.frame_index;
+    stats["detected"] = stream_stats.detected;
+    stats["scene_change"] = stream_stats.scene_change;
+    stats["lost_tracks"] = stream_stats.lost_tracks;
+    stats["detect_ms"] = stream_stats.detect_ms;
+    stats["track_ms"] = stream_stats.track_ms;
+    stats["apply_ms"] = stream_stats.apply_ms;
+    return stats;
+}
+
+void DiffDetector::stop_stream() {
+    stream_session.reset();
+}
+
+Dictionary DiffDetector::validate_puzzle(const Ref<Image>& original_image, const Ref<Image>& modified_image,
+                                         const Array& diff_data, const Dictionary& options) {
+    Dictionary result;
+    
+    if (original_image.is_null() || modified_image.is_null()) {
+        UtilityFunctions::print_error("Source image is null");
+        return result;
+    }
+    if (original_image->get_size() != modified_image->get_size() ||
+        original_image->get_format() != modified_image->get_format()) {
+        UtilityFunctions::print_error("validate_puzzle requires images of the same size and format");
+        return result;
+    }
+    
+    // 只支持每通道8位的非压缩格式（L8/LA8/R8/RG8/RGB8/RGBA8），直接在Godot数据上比较，不做格式转换
+    Image::Format format = original_image->get_format();
+    if (format > Image::FORMAT_RGBA8 || original_image->has_mipmaps() || modified_image->has_mipmaps()) {
+        UtilityFunctions::print_error("validate_puzzle only supports 8-bit formats without mipmaps");
+        return result;
+    }
+    
+    int width = original_image->get_width();
+    int height = original_image->get_height();
+    PackedByteArray original_data = original_image->get_data();
+    PackedByteArray modified_data = modified_image->get_data();
+    int channels = static_cast<int>(original_data.size() / (static_cast<int64_t>(width) * height));
+    
+    cv::Mat original(height, width, CV_8UC(channels), const_cast<uint8_t*>(original_data.ptr()));
+    cv::Mat modified(height, width, CV_8UC(channels), const_cast<uint8_t*>(modified_data.ptr()));
+    
+    // 差异区域：优先使用region，旧数据则由position和size推算
+    std::vector<cv::Rect> regions;
+    regions.reserve(diff_data.size());
+    for (int i = 0; i < diff_data.size(); i++) {
+        Dictionary diff_dict = diff_data[i];
+        if (diff_dict.has("region")) {
+            Rect2i region = diff_dict["region"];
+            regions.emplace_back(region.position.x, region.position.y, region.size.x, region.size.y);
+        } else {
+            Vector2 position = diff_dict.get("position", Vector2());
+            float size_value = diff_dict.get("size", 0.0f);
+            int size = static_cast<int>(size_value);
+            regions.emplace_back(static_cast<int>(position.x) - size / 2, static_cast<int>(position.y) - size / 2, size, size);
+        }
+    }
+    
+    // 应用校验参数
+    ValidationOptions validation_options = validator->get_options();
+    validation_options.change_threshold = options.get("change_threshold", validation_options.change_threshold);
+    validation_options.min_visibility = options.get("min_visibility", validation_options.min_visibility);
+    validation_options.min_stray_area = options.get("min_stray_area", validation_options.min_stray_area);
+    validator->set_options(validation_options);
+    
+    ValidationReport report;
+    if (!validator->validate(original, modified, regions, report)) {
+        UtilityFunctions::print_error("Failed to validate puzzle");
+        return result;
+    }
+    
+    Array diffs;
+    for (const auto& diff : report.diffs) {
+        Dictionary diff_dict;
+        diff_dict["changed_pixels"] = diff.changed_pixels;
+        diff_dict["changed_ratio"] = diff.changed_ratio;
+        diff_dict["mean_delta"] = diff.mean_delta;
+        diff_dict["visibility"] = diff.visibility;
+        diff_dict["visible"] = diff.visible;
+        
+        Array overlaps;
+        for (int other : diff.overlaps) {
+            overlaps.push_back(other);
+        }
+        diff_dict["overlaps"] = overlaps;
+        diffs.push_back(diff_dict);
+    }
+    
+    Array stray_components;
+    for (const auto& component : report.stray_components) {
+        stray_components.push_back(Rect2i(component.x, component.y, component.width, component.height));
+    }
+    
+    result["valid"] = report.valid;
+    result["diffs"] = diffs;
+    result["stray_pixels"] = report.stray_pixels;
+    result["stray_components"] = stray_components;
+    return result;
+}
+
+bool DiffDetector::is_prefetched(int64_t level_id) const {
+    return prefetcher->is_ready(level_id);
+}
+
+void DiffDetector::cancel_prefetch(int64_t level_id) {
+    prefetcher->cancel(level_id);
+}
+
+void DiffDetector::cancel_all_prefetch() {
+    prefetcher->cancel_all();
+}
+
+int DiffDetector::get_prefetch_pending_count() const {
+    return prefetcher->get_pending_count();
+}
+
+int64_t DiffDetector::get_prefetch_memory_usage() const {
+    return static_cast<int64_t>(prefetcher->get_memory_usage());
+}
+
+void DiffDetector::set_prefetch_memory_budget(int64_t bytes) {
+    prefetcher->set_memory_budget(static_cast<size_t>(std::max<int64_t>(0, bytes)));
+}
+
+int64_t DiffDetector::get_prefetch_memory_budget() const {
+    return static_cast<int64_t>(prefetcher->get_memory_budget());
+}
+
+void DiffDetector::set_memory_budget(int64_t bytes) {
+    memory_governor.set_budget(static_cast<size_t>(std::max<int64_t>(0, bytes)));
+}
+
+int64_t DiffDetector::get_memory_budget() const {
+    return static_cast<int64_t>(memory_governor.get_budget());
+}
+
+Dictionary DiffDetector::get_memory_report() const {
+    Dictionary report;
+    report["strategy"] = MemoryGovernor::get_strategy_name(memory_plan.strategy);
+    report["scale"] = memory_plan.scale;
+    report["budget"] = static_cast<int64_t>(memory_governor.get_budget());
+    report["estimated_peak"] = static_cast<int64_t>(memory_plan.estimated_peak);
+    report["accounted_peak"] = static_cast<int64_t>(memory_governor.get_accounted_peak());
+    report["accounted_retained"] = static_cast<int64_t>(memory_governor.get_accounted());
+    report["reroll_available"] = !working_image.empty();
+    return report;
+}
+
 Array DiffDetector::get_diff_data() const {
     Array result;
+    if (generated_diffs.empty()) {
+        return result;
+    }
+    
+    // 代理策略下输出图像和差异坐标为代理分辨率，另外给出换算回源图像的坐标
+    // 按实际尺寸之比换算：JPEG缩小解码向上取整，按块缩小向下取整
+    double scale_x = static_cast<double>(diff_source_size.width) / diff_image_size.width;
+    double scale_y = static_cast<double>(diff_source_size.height) / diff_image_size.height;
     
     for (const auto& diff : generated_diffs) {
-        Dictionary diff_dict;
-        diff_dict["position"] = diff.position;
-        diff_dict["size"] = diff.size;
-        diff_dict["algorithm_id"] = diff.algorithm_id;
+        Dictionary diff_dict = create_diff_dictionary(diff);
+        
+        int x0 = static_cast<int>(std::floor(diff.region.x * scale_x));
+        int y0 = static_cast<int>(std::floor(diff.region.y * scale_y));
+        int x1 = std::min(diff_source_size.width, static_cast<int>(std::ceil(diff.region.br().x * scale_x)));
+        int y1 = std::min(diff_source_size.height, static_cast<int>(std::ceil(diff.region.br().y * scale_y)));
+        
+        diff_dict["scale"] = diff_scale;
+        diff_dict["source_position"] = Vector2(diff.position.x * scale_x, diff.position.y * scale_y);
+        diff_dict["source_size"] = (diff.size.width * scale_x + diff.size.height * scale_y) / 2.0;
+        diff_dict["source_region"] = Rect2i(x0, y0, x1 - x0, y1 - y0);
         result.push_back(diff_dict);
     }
     
     return result;
 }
 
+Dictionary DiffDetector::get_detection_data() const {
+    // 按数组结构整体导出，供调试叠加层直接绘制
+    const DetectionSet& detections = cached_detections;
+    int count = static_cast<int>(detections.size());
+    
+    PackedInt32Array class_ids;
+    PackedFloat32Array confidences;
+    PackedInt32Array boxes;
+    class_ids.resize(count);
+    confidences.resize(count);
+    boxes.resize(count * 4);
+    
+    ConstSpan<int> ids = detections.get_class_ids();
+    ConstSpan<float> scores = detections.get_confidences();
+    ConstSpan<cv::Rect> rects = detections.get_boxes();
+    int32_t* box_data = boxes.ptrw();
+    for (int i = 0; i < count; i++) {
+        class_ids.set(i, ids[i]);
+        confidences.set(i, scores[i]);
+        box_data[i * 4 + 0] = rects[i].x;
+        box_data[i * 4 + 1] = rects[i].y;
+        box_data[i * 4 + 2] = rects[i].width;
+        box_data[i * 4 + 3] = rects[i].height;
+    }
+    
+    ConstSpan<cv::Point> points = detections.get_points();
+    PackedVector2Array point_data;
+    point_data.resize(static_cast<int64_t>(points.size()));
+    Vector2* point_ptr = point_data.ptrw();
+    for (size_t i = 0; i < points.size(); i++) {
+        point_ptr[i] = Vector2(points[i].x, points[i].y);
+    }
+    
+    ConstSpan<uint32_t> offsets = detections.get_point_offsets();
+    PackedInt32Array point_offsets;
+    point_offsets.resize(static_cast<int64_t>(offsets.size()));
+    for (size_t i = 0; i < offsets.size(); i++) {
+        point_offsets.set(static_cast<int64_t>(i), static_cast<int32_t>(offsets[i]));
+    }
+    
+    Dictionary result;
+    result["class_ids"] = class_ids;
+    result["confidences"] = confidences;
+    result["boxes"] = boxes;
+    result["points"] = point_data;
+    result["point_offsets"] = point_offsets;
+    return result;
+}
+
+int DiffDetector::register_diff_algorithm(const String& name, int min_difficulty, int max_difficulty, const Callable& kernel) {
+    if (!kernel.is_valid()) {
+        UtilityFunctions::print_error("Invalid callable for diff algorithm: ", name);
+        return -1;
+    }
+    
+    // GDScript算法以Image形式接收ROI：kernel(roi: Image, region: Rect2i, difficulty: int) -> Image
+    Callable callback = kernel;
+    CustomDiffKernel wrapper = [callback](cv::Mat& image, const cv::Rect& region, int diff, DiffInfo& info) {
+        cv::Mat roi = image(region);
+        
+        PackedByteArray roi_data;
+        roi_data.resize(roi.total() * roi.elemSize());
+        size_t row_bytes = roi.cols * roi.elemSize();
+        for (int i = 0; i < roi.rows; i++) {
+            memcpy(roi_data.ptrw() + i * row_bytes, roi.ptr(i), row_bytes);
+        }
+        
+        Image::Format roi_format = get_channels_format(roi.channels());
+        Ref<Image> roi_image = Image::create_from_data(roi.cols, roi.rows, false, roi_format, roi_data);
+        Ref<Image> result = callback.call(roi_image, Rect2i(region.x, region.y, region.width, region.height), diff);
+        
+        // 结果尺寸不符时保持原样
+        if (result.is_null() || result->get_width() != roi.cols || result->get_height() != roi.rows) {
+            return;
+        }
+        if (result->get_format() != roi_format) {
+            result->convert(roi_format);
+        }
+        
+        PackedByteArray result_data = result->get_data();
+        for (int i = 0; i < roi.rows; i++) {
+            memcpy(roi.ptr(i), result_data.ptr() + i * row_bytes, row_bytes);
+        }
+    };
+    
+    return diff_generator->register_algorithm(name.utf8().get_data(), min_difficulty, max_difficulty, 1.0f, wrapper);
+}
+
+bool DiffDetector::unregister_diff_algorithm(int algorithm_id) {
+    return diff_generator->unregister_algorithm(algorithm_id);
+}
+
+void DiffDetector::set_algorithm_enabled(int algorithm_id, bool enabled) {
+    diff_generator->set_algorithm_enabled(algorithm_id, enabled);
+}
+
+int DiffDetector::add_sticker(const Ref<Image>& sticker) {
+    if (sticker.is_null() || sticker->is_empty()) {
+        UtilityFunctions::print_error("Sticker image is null or empty");
+        return -1;
+    }
+    
+    // 贴纸统一保存为RGBA8，混合时按工作缓冲区的布局取颜色或亮度
+    Ref<Image> rgba;
+    rgba.instantiate();
+    rgba->copy_from(sticker);
+    if (rgba->is_compressed()) {
+        rgba->decompress();
+    }
+    if (rgba->get_format() != Image::FORMAT_RGBA8) {
+        rgba->convert(Image::FORMAT_RGBA8);
+    }
+    
+    cv::Mat sticker_mat;
+    if (!create_working_image(rgba, sticker_mat)) {
+        return -1;
+    }
+    return diff_generator->get_asset_cache().add_sticker(sticker_mat);
+}
+
+void DiffDetector::clear_stickers() {
+    diff_generator->get_asset_cache().clear_stickers();
+}
+
+int DiffDetector::get_sticker_count() const {
+    return diff_generator->get_asset_cache().get_sticker_count();
+}
+
+Dictionary DiffDetector::get_cpu_features() const {
+    const CpuFeatures& features = godot::get_cpu_features();
+    
+    Dictionary feature_dict;
+    feature_dict["avx2"] = features.avx2;
+    feature_dict["fma"] = features.fma;
+    feature_dict["neon"] = features.neon;
+    feature_dict["dotprod"] = features.dotprod;
+    feature_dict["fp16"] = features.fp16;
+    
+    Array available;
+    for (const CpuKernelTable* table : get_available_cpu_kernels()) {
+        available.push_back(String(table->name));
+    }
+    
+    Dictionary result;
+    result["active"] = String(get_cpu_kernels().name);
+    result["available"] = available;
+    result["features"] = feature_dict;
+    return result;
+}
+
+Array DiffDetector::get_algorithm_list() const {
+    Array result;
+    
+    for (int id = 0; id < diff_generator->get_algorithm_count(); id++) {
+        const DiffAlgorithmInfo* info = diff_generator->get_algorithm_info(id);
+        if (!info) {
+            continue;
+        }
+        
+        Dictionary algorithm_dict;
+        algorithm_dict["id"] = id;
+        algorithm_dict["name"] = String(info->name);
+        algorithm_dict["min_difficulty"] = info->min_difficulty;
+        algorithm_dict["max_difficulty"] = info->max_difficulty;
+        algorithm_dict["cost_per_pixel"] = info->cost_per_pixel;
+        algorithm_dict["needs_mask"] = info->needs_mask;
+        algorithm_dict["scalable"] = info->scalable;
+        algorithm_dict["measured_ns_per_pixel"] = diff_generator->get_measured_cost(id);
+        result.push_back(algorithm_dict);
+    }
+    
+    return result;
+}
+
 void DiffDetector::set_diff_count(int count) {
     diff_count = count;
     if (diff_count < 5) diff_count = 5;
@@ -139,21 +1059,69 @@ int DiffDetector::get_difficulty() const {
     return difficulty;
 }
 
+void DiffDetector::set_calibration_iterations(int iterations) {
+    diff_generator->set_calibration_iterations(iterations);
+}
+
+int DiffDetector::get_calibration_iterations() const {
+    return diff_generator->get_calibration_iterations();
+}
+
 void DiffDetector::_bind_methods() {
     // 注册方法
     ClassDB::bind_method(D_METHOD("initialize"), &DiffDetector::initialize);
-    ClassDB::bind_method(D_METHOD("generate_diff_image", "source_image", "diff_count", "difficulty"), &DiffDetector::generate_diff_image);
+    ClassDB::bind_method(D_METHOD("generate_diff_image", "source_image", "diff_count", "difficulty", "time_budget_ms"), &DiffDetector::generate_diff_image, DEFVAL(0.0));
+    ClassDB::bind_method(D_METHOD("generate_diff_from_buffer", "buffer", "diff_count", "difficulty", "time_budget_ms"), &DiffDetector::generate_diff_from_buffer, DEFVAL(0.0));
     ClassDB::bind_method(D_METHOD("get_diff_data"), &DiffDetector::get_diff_data);
+    ClassDB::bind_method(D_METHOD("get_detection_data"), &DiffDetector::get_detection_data);
+    ClassDB::bind_method(D_METHOD("reroll_diff", "index", "options"), &DiffDetector::reroll_diff, DEFVAL(Dictionary()));
+    ClassDB::bind_method(D_METHOD("validate_puzzle", "original_image", "modified_image", "diff_data", "options"), &DiffDetector::validate_puzzle, DEFVAL(Dictionary()));
+    
+    // 注册预取方法
+    ClassDB::bind_method(D_METHOD("prefetch_level", "level_id", "source_image", "diff_count", "difficulty"), &DiffDetector::prefetch_level);
+    ClassDB::bind_method(D_METHOD("take_prefetched", "level_id"), &DiffDetector::take_prefetched);
+    ClassDB::bind_method(D_METHOD("apply_puzzle_patches", "source_image", "puzzle"), &DiffDetector::apply_puzzle_patches);
+    ClassDB::bind_method(D_METHOD("is_prefetched", "level_id"), &DiffDetector::is_prefetched);
+    ClassDB::bind_method(D_METHOD("cancel_prefetch", "level_id"), &DiffDetector::cancel_prefetch);
+    ClassDB::bind_method(D_METHOD("cancel_all_prefetch"), &DiffDetector::cancel_all_prefetch);
+    ClassDB::bind_method(D_METHOD("get_prefetch_pending_count"), &DiffDetector::get_prefetch_pending_count);
+    ClassDB::bind_method(D_METHOD("get_prefetch_memory_usage"), &DiffDetector::get_prefetch_memory_usage);
+    ClassDB::bind_method(D_METHOD("set_prefetch_memory_budget", "bytes"), &DiffDetector::set_prefetch_memory_budget);
+    ClassDB::bind_method(D_METHOD("get_prefetch_memory_budget"), &DiffDetector::get_prefetch_memory_budget);
+    ClassDB::bind_method(D_METHOD("set_memory_budget", "bytes"), &DiffDetector::set_memory_budget);
+    ClassDB::bind_method(D_METHOD("get_memory_budget"), &DiffDetector::get_memory_budget);
+    ClassDB::bind_method(D_METHOD("get_memory_report"), &DiffDetector::get_memory_report);
+    
+    // 注册流式处理方法
+    ClassDB::bind_method(D_METHOD("start_stream", "diff_count", "difficulty", "options"), &DiffDetector::start_stream, DEFVAL(Dictionary()));
+    ClassDB::bind_method(D_METHOD("process_stream_frame", "frame"), &DiffDetector::process_stream_frame);
+    ClassDB::bind_method(D_METHOD("get_stream_diff_data"), &DiffDetector::get_stream_diff_data);
+    ClassDB::bind_method(D_METHOD("get_stream_stats"), &DiffDetector::get_stream_stats);
+    ClassDB::bind_method(D_METHOD("stop_stream"), &DiffDetector::stop_stream);
+    
+    ClassDB::bind_method(D_METHOD("register_diff_algorithm", "name", "min_difficulty", "max_difficulty", "kernel"), &DiffDetector::register_diff_algorithm);
+    ClassDB::bind_method(D_METHOD("unregister_diff_algorithm", "algorithm_id"), &DiffDetector::unregister_diff_algorithm);
+    ClassDB::bind_method(D_METHOD("set_algorithm_enabled", "algorithm_id", "enabled"), &DiffDetector::set_algorithm_enabled);
+    ClassDB::bind_method(D_METHOD("get_algorithm_list"), &DiffDetector::get_algorithm_list);
+    ClassDB::bind_method(D_METHOD("get_cpu_features"), &DiffDetector::get_cpu_features);
+    ClassDB::bind_method(D_METHOD("add_sticker", "sticker"), &DiffDetector::add_sticker);
+    ClassDB::bind_method(D_METHOD("clear_stickers"), &DiffDetector::clear_stickers);
+    ClassDB::bind_method(D_METHOD("get_sticker_count"), &DiffDetector::get_sticker_count);
     
     // 注册属性访问方法
     ClassDB::bind_method(D_METHOD("set_diff_count", "count"), &DiffDetector::set_diff_count);
     ClassDB::bind_method(D_METHOD("get_diff_count"), &DiffDetector::get_diff_count);
     ClassDB::bind_method(D_METHOD("set_difficulty", "difficulty"), &DiffDetector::set_difficulty);
     ClassDB::bind_method(D_METHOD("get_difficulty"), &DiffDetector::get_difficulty);
+    ClassDB::bind_method(D_METHOD("set_calibration_iterations", "iterations"), &DiffDetector::set_calibration_iterations);
+    ClassDB::bind_method(D_METHOD("get_calibration_iterations"), &DiffDetector::get_calibration_iterations);
     
     // 暴露属性
     ADD_PROPERTY(PropertyInfo(Variant::INT, "diff_count", PROPERTY_HINT_RANGE, "5,10,1"), "set_diff_count", "get_diff_count");
     ADD_PROPERTY(PropertyInfo(Variant::INT, "difficulty", PROPERTY_HINT_RANGE, "1,10,1"), "set_difficulty", "get_difficulty");
+    ADD_PROPERTY(PropertyInfo(Variant::INT, "calibration_iterations", PROPERTY_HINT_RANGE, "0,8,1"), "set_calibration_iterations", "get_calibration_iterations");
+    ADD_PROPERTY(PropertyInfo(Variant::INT, "prefetch_memory_budget"), "set_prefetch_memory_budget", "get_prefetch_memory_budget");
+    ADD_PROPERTY(PropertyInfo(Variant::INT, "memory_budget"), "set_memory_budget", "get_memory_budget");
 }
 
 } // namespace godot 
\ No newline at end of file
@@ -1,207 +1,403 @@
 #include "diff_generator.h"
 #include "yolo_detector.h"
+#include "cpu_kernels.h"
+#include "diff_log.h"
+#include "instance_label_map.h"
 
-#include <godot_cpp/variant/utility_functions.hpp>
 #include <opencv2/imgproc.hpp>
 #include <opencv2/photo.hpp>
 #include <algorithm>
 #include <random>
 #include <chrono>
+#include <cmath>
+#include <cstring>
 
 namespace godot {
 
-DiffGenerator::DiffGenerator() {
+namespace {
+
+// 像素布局：通道数、颜色通道数（不含alpha）以及像素类型
+template <int Channels>
+struct PixelLayout {
+    static constexpr int channels = Channels;
+    static constexpr bool has_alpha = Channels == 2 || Channels == 4;
+    static constexpr int color_channels = has_alpha ? Channels - 1 : Channels;
+    using Pixel = cv::Vec<uchar, Channels>;
+};
+
+using LayoutL8 = PixelLayout<1>;
+using LayoutLA8 = PixelLayout<2>;
+using LayoutRGB8 = PixelLayout<3>;
+using LayoutRGBA8 = PixelLayout<4>;
+
+// 几何类算法（变形、缩放、旋转、翻转、模糊）对整个像素操作，会移动或模糊alpha，
+// 边界填充还会写入alpha=0；写回前换回ROI原来的alpha
+template <typename Layout>
+cv::Mat save_alpha(const cv::Mat& roi) {
+    cv::Mat alpha;
+    if (Layout::has_alpha) {
+        cv::extractChannel(roi, alpha, Layout::channels - 1);
+    }
+    return alpha;
+}
+
+template <typename Layout>
+void restore_alpha(cv::Mat roi, const cv::Mat& alpha) {
+    if (Layout::has_alpha) {
+        cv::insertChannel(alpha, roi, Layout::channels - 1);
+    }
+}
+
+} // namespace
+
+// 生成按DiffType排列的某个像素布局的算法分发行
+#define DIFF_KERNEL_ROW(LAYOUT) {                        \
+    &DiffGenerator::apply_color_shift<LAYOUT>,           \
+    &DiffGenerator::apply_object_removal<LAYOUT>,        \
+    &DiffGenerator::apply_texture_change<LAYOUT>,        \
+    &DiffGenerator::apply_shape_deform<LAYOUT>,          \
+    &DiffGenerator::apply_subtle_pattern<LAYOUT>,        \
+    &DiffGenerator::apply_scale_change<LAYOUT>,          \
+    &DiffGenerator::apply_rotation<LAYOUT>,              \
+    &DiffGenerator::apply_flip<LAYOUT>,                  \
+    &DiffGenerator::apply_blur<LAYOUT>,                  \
+    &DiffGenerator::apply_addition<LAYOUT>               \
+}
+
+// 内置算法分发表，按像素布局和DiffType索引，编译期实例化所有组合
+constexpr DiffGenerator::DiffKernel DiffGenerator::builtin_kernels[PIXEL_LAYOUT_COUNT][DIFF_TYPE_COUNT] = {
+    DIFF_KERNEL_ROW(LayoutL8),      // PIXEL_LAYOUT_L8
+    DIFF_KERNEL_ROW(LayoutLA8),     // PIXEL_LAYOUT_LA8
+    DIFF_KERNEL_ROW(LayoutRGB8),    // PIXEL_LAYOUT_RGB8
+    DIFF_KERNEL_ROW(LayoutRGBA8)    // PIXEL_LAYOUT_RGBA8
+};
+
+#undef DIFF_KERNEL_ROW
+
+// 内置算法元数据：名称、难度范围、每像素相对开销、是否需要遮罩、强度是否可调
+// 难度范围对应原先的三档算法池：1-3明显、4-7中等、8-10微妙
+constexpr DiffAlgorithmInfo DiffGenerator::builtin_info[DIFF_TYPE_COUNT] = {
+    { "color_shift",    1, 3,  1.0f,  false, true  },
+    { "object_removal", 1, 3,  40.0f, true,  false },
+    { "texture_change", 4, 10, 2.0f,  false, true  },
+    { "shape_deform",   4, 10, 4.0f,  false, true  },
+    { "subtle_pattern", 8, 10, 1.5f,  false, true  },
+    { "scale_change",   4, 7,  3.0f,  false, true  },
+    { "rotation",       1, 3,  3.0f,  false, true  },
+    { "flip",           1, 3,  0.5f,  false, false },
+    { "blur",           4, 10, 2.0f,  false, true  },
+    { "addition",       1, 3,  1.5f,  true,  true  }
+};
+
+// 感知校准参数：目标ΔE的容差比例与强度系数范围
+constexpr float CALIBRATION_TOLERANCE = 0.3f;
+constexpr float MIN_INTENSITY_SCALE = 0.1f;
+constexpr float MAX_INTENSITY_SCALE = 4.0f;
+
+// 开销模型参数：元数据中的相对开销乘以此系数作为未采样时的初始估计
+constexpr double COST_NS_PER_UNIT = 4.0;
+constexpr int COST_WARMUP_SAMPLES = 5;
+constexpr double COST_EWMA_ALPHA = 0.2;
+
+DiffGenerator::DiffGenerator() : intensity_scale(1.0f), calibration_iterations(3), pixel_layout(PIXEL_LAYOUT_RGB8),
+                                 label_map(nullptr), object_label(0) {
     // 初始化随机数生成器
     unsigned seed = std::chrono::system_clock::now().time_since_epoch().count();
     rng = std::mt19937(seed);
     
-    // 初始化差异算法函数映射
-    diff_algorithms.resize(10);
-    diff_algorithms[DIFF_COLOR_SHIFT] = [this](cv::Mat& img, const cv::Rect& region, int difficulty, DiffInfo& info) {
-        this->apply_color_shift(img, region, difficulty, info);
-    };
-    diff_algorithms[DIFF_OBJECT_REMOVAL] = [this](cv::Mat& img, const cv::Rect& region, int difficulty, DiffInfo& info) {
-        this->apply_object_removal(img, region, difficulty, info);
-    };
-    diff_algorithms[DIFF_TEXTURE_CHANGE] = [this](cv::Mat& img, const cv::Rect& region, int difficulty, DiffInfo& info) {
-        this->apply_texture_change(img, region, difficulty, info);
-    };
-    diff_algorithms[DIFF_SHAPE_DEFORM] = [this](cv::Mat& img, const cv::Rect& region, int difficulty, DiffInfo& info) {
-        this->apply_shape_deform(img, region, difficulty, info);
-    };
-    diff_algorithms[DIFF_SUBTLE_PATTERN] = [this](cv::Mat& img, const cv::Rect& region, int difficulty, DiffInfo& info) {
-        this->apply_subtle_pattern(img, region, difficulty, info);
-    };
-    diff_algorithms[DIFF_SCALE_CHANGE] = [this](cv::Mat& img, const cv::Rect& region, int difficulty, DiffInfo& info) {
-        this->apply_scale_change(img, region, difficulty, info);
-    };
-    diff_algorithms[DIFF_ROTATION] = [this](cv::Mat& img, const cv::Rect& region, int difficulty, DiffInfo& info) {
-        this->apply_rotation(img, region, difficulty, info);
-    };
-    diff_algorithms[DIFF_FLIP] = [this](cv::Mat& img, const cv::Rect& region, int difficulty, DiffInfo& info) {
-        this->apply_flip(img, region, difficulty, info);
-    };
-    diff_algorithms[DIFF_BLUR] = [this](cv::Mat& img, const cv::Rect& region, int difficulty, DiffInfo& info) {
-        this->apply_blur(img, region, difficulty, info);
-    };
-    diff_algorithms[DIFF_ADDITION] = [this](cv::Mat& img, const cv::Rect& region, int difficulty, DiffInfo& info) {
-        this->apply_addition(img, region, difficulty, info);
-    };
+    // 默认启用所有内置算法
+    algorithm_enabled.assign(DIFF_TYPE_COUNT, true);
+    
+    // 以元数据中的相对开销初始化开销模型
+    for (int id = 0; id < DIFF_TYPE_COUNT; id++) {
+        algorithm_costs.push_back({builtin_info[id].cost_per_pixel * COST_NS_PER_UNIT, 0});
+    }
 }
 
 DiffGenerator::~DiffGenerator() {
     // 无需特殊清理
 }
 
+void DiffGenerator::set_seed(uint32_t seed) {
+    rng.seed(seed);
+}
+
 std::vector<cv::Rect> DiffGenerator::select_diff_regions(const cv::Mat& image, 
-                                                        const std::vector<DetectedObject>& objects,
+                                                        const DetectionSet& objects,
                                                         int count) {
     std::vector<cv::Rect> regions;
+    const cv::Rect image_rect(0, 0, image.cols, image.rows);
     
-    // 如果检测到了对象，优先选择对象区域
-    if (!objects.empty()) {
-        // 复制所有检测到的边界框
-        for (const auto& obj : objects) {
-            regions.push_back(obj.bbox);
-        }
-        
-        // 如果检测到的对象不够，添加随机区域
-        if (regions.size() < static_cast<size_t>(count)) {
-            std::uniform_int_distribution<int> distrib_w(0, image.cols - 50);
-            std::uniform_int_distribution<int> distrib_h(0, image.rows - 50);
-            std::uniform_int_distribution<int> distrib_size(30, 100);
-            
-            while (regions.size() < static_cast<size_t>(count)) {
-                int x = distrib_w(rng);
-                int y = distrib_h(rng);
-                int size = distrib_size(rng);
-                
-                // 确保区域在图像内
-                size = std::min(size, std::min(image.cols - x, image.rows - y));
-                cv::Rect random_region(x, y, size, size);
-                
-                // 检查是否与已有区域重叠
-                bool overlaps = false;
-                for (const auto& existing : regions) {
-                    if ((random_region & existing).area() > 0) {
-                        overlaps = true;
-                        break;
-                    }
-                }
-                
-                if (!overlaps) {
-                    regions.push_back(random_region);
-                }
+    // 差异区域互不重叠，reroll_diff从原图恢复一个区域时不会抹掉其它差异
+    auto overlaps_existing = [&regions](const cv::Rect& candidate) {
+        for (const auto& existing : regions) {
+            if ((candidate & existing).area() > 0) {
+                return true;
             }
         }
-    } else {
-        // 如果没有检测到对象，创建随机区域
-        std::uniform_int_distribution<int> distrib_w(0, image.cols - 50);
-        std::uniform_int_distribution<int> distrib_h(0, image.rows - 50);
-        std::uniform_int_distribution<int> distrib_size(30, 100);
-        
-        while (regions.size() < static_cast<size_t>(count)) {
-            int x = distrib_w(rng);
-            int y = distrib_h(rng);
-            int size = distrib_size(rng);
-            
-            // 确保区域在图像内
-            size = std::min(size, std::min(image.cols - x, image.rows - y));
-            cv::Rect random_region(x, y, size, size);
-            
-            // 检查是否与已有区域重叠
-            bool overlaps = false;
-            for (const auto& existing : regions) {
-                if ((random_region & existing).area() > 0) {
-                    overlaps = true;
-                    break;
-                }
-            }
-            
-            if (!overlaps) {
-                regions.push_back(random_region);
-            }
+        return false;
+    };
+    
+    // 优先选择对象区域：裁剪到图像内，按随机顺序选取互不重叠的检测框
+    std::vector<cv::Rect> boxes;
+    for (const auto& obj : objects) {
+        cv::Rect box = obj.bounding_box & image_rect;
+        if (box.area() > 0) {
+            boxes.push_back(box);
+        }
+    }
+    std::shuffle(boxes.begin(), boxes.end(), rng);
+    for (const cv::Rect& box : boxes) {
+        if (regions.size() >= static_cast<size_t>(count)) {
+            break;
+        }
+        if (!overlaps_existing(box)) {
+            regions.push_back(box);
         }
     }
     
-    // 如果区域太多，随机选择所需数量
-    if (regions.size() > static_cast<size_t>(count)) {
-        std::shuffle(regions.begin(), regions.end(), rng);
-        regions.resize(count);
+    // 对象不够时添加随机区域，图像被占满时尝试有限次数后放弃
+    std::uniform_int_distribution<int> distrib_w(0, std::max(0, image.cols - 50));
+    std::uniform_int_distribution<int> distrib_h(0, std::max(0, image.rows - 50));
+    std::uniform_int_distribution<int> distrib_size(30, 100);
+    
+    for (int attempt = 0; attempt < 1000 && regions.size() < static_cast<size_t>(count); attempt++) {
+        int x = distrib_w(rng);
+        int y = distrib_h(rng);
+        int size = distrib_size(rng);
+        
+        // 确保区域在图像内
+        size = std::min(size, std::min(image.cols - x, image.rows - y));
+        cv::Rect random_region(x, y, size, size);
+        
+        if (random_region.area() > 0 && !overlaps_existing(random_region)) {
+            regions.push_back(random_region);
+        }
     }
     
     return regions;
 }
 
-bool DiffGenerator::generate_diffs(cv::Mat& image, const std::vector<DetectedObject>& objects, 
-                                  int count, int difficulty, std::vector<DiffInfo>& diff_info) {
+double DiffGenerator::remaining_time_budget(double time_budget_ms, double elapsed_ms) {
+    if (time_budget_ms <= 0.0) {
+        return 0.0;
+    }
+    return std::max(time_budget_ms - elapsed_ms, 0.001);
+}
+
+bool DiffGenerator::generate_diffs(cv::Mat& image, const DetectionSet& objects, 
+                                  int count, int difficulty, std::vector<DiffInfo>& diff_info,
+                                  double time_budget_ms, const InstanceLabelMap* labels) {
     // 参数验证
     if (image.empty()) {
-        godot::UtilityFunctions::print_error("Empty image in generate_diffs");
+        log_error("Empty image in generate_diffs");
+        return false;
+    }
+    if (!get_pixel_layout(image, pixel_layout)) {
+        log_error("Unsupported pixel layout in generate_diffs");
+        return false;
+    }
+    
+    if (labels && labels->get_labels().size() != image.size()) {
+        log_error("Label map size does not match image in generate_diffs");
         return false;
     }
     
+    auto start_time = std::chrono::steady_clock::now();
+    double budget_ns = time_budget_ms * 1e6;
+    
     // 获取可以应用差异的区域
     std::vector<cv::Rect> regions = select_diff_regions(image, objects, count);
     
     if (regions.empty()) {
-        godot::UtilityFunctions::print_error("No suitable regions found for differences");
+        log_error("No suitable regions found for differences");
         return false;
     }
     
     // 为每个区域应用差异
-    for (const auto& region : regions) {
+    label_map = labels;
+    for (size_t i = 0; i < regions.size(); i++) {
+        const cv::Rect& region = regions[i];
         DiffInfo info;
         
-        // 选择适合难度的算法
-        int algorithm_id = select_algorithm_for_difficulty(difficulty);
+        // 将剩余预算平均分给尚未生成的差异
+        double max_cost_ns = -1.0;
+        if (budget_ns > 0.0) {
+            double elapsed_ns = std::chrono::duration<double, std::nano>(
+                std::chrono::steady_clock::now() - start_time).count();
+            max_cost_ns = std::max(0.0, budget_ns - elapsed_ns) / (regions.size() - i);
+        }
+        
+        // 选择适合难度的算法，记录的ID与实际应用的算法一致
+        int algorithm_id = select_algorithm_for_difficulty(difficulty, region.area(), max_cost_ns);
         
-        // 应用差异
-        apply_diff_algorithm(image, region, difficulty, info);
+        // 应用差异（含感知校准）并更新开销模型
+        apply_calibrated(image, region, difficulty, algorithm_id, info);
         
         // 设置差异信息
-        info.algorithm_id = algorithm_id;
-        info.position = Vector2(region.x + region.width/2, region.y + region.height/2);
-        info.size = (region.width + region.height) / 2.0f;
+        info.position = cv::Point(region.x + region.width / 2, region.y + region.height / 2);
+        info.size = region.size();
+        info.region = region;
         
         // 添加到结果
         diff_info.push_back(info);
     }
+    label_map = nullptr;
     
     return true;
 }
 
-int DiffGenerator::select_algorithm_for_difficulty(int difficulty) {
+bool DiffGenerator::reroll_diff(cv::Mat& image, const cv::Mat& original,
+                                const DetectionSet& objects,
+                                int index, int difficulty, int algorithm_id, bool new_region,
+                                std::vector<DiffInfo>& diff_info, const InstanceLabelMap* labels) {
+    // 参数验证
+    if (image.empty() || image.size() != original.size() || image.type() != original.type() ||
+        !get_pixel_layout(image, pixel_layout)) {
+        log_error("Mismatched buffers in reroll_diff");
+        return false;
+    }
+    if (index < 0 || index >= static_cast<int>(diff_info.size())) {
+        return false;
+    }
+    if (algorithm_id >= 0 && !get_algorithm_info(algorithm_id)) {
+        log_error("Unknown algorithm id in reroll_diff: ", algorithm_id);
+        return false;
+    }
+    if (labels && labels->get_labels().size() != image.size()) {
+        log_error("Label map size does not match image in reroll_diff");
+        return false;
+    }
+    
+    DiffInfo& info = diff_info[index];
+    int previous_algorithm = info.algorithm_id;
+    
+    // 从原图恢复该区域
+    original(info.region).copyTo(image(info.region));
+    
+    // 需要时换一个区域
+    cv::Rect region = info.region;
+    if (new_region) {
+        cv::Rect replacement = select_replacement_region(image, objects, diff_info, index);
+        if (replacement.area() > 0) {
+            region = replacement;
+        }
+    }
+    
+    // 随机选择时尽量避开之前被拒绝的算法
+    if (algorithm_id < 0) {
+        algorithm_id = select_algorithm_for_difficulty(difficulty, region.area());
+        for (int attempt = 0; attempt < 8 && algorithm_id == previous_algorithm; attempt++) {
+            algorithm_id = select_algorithm_for_difficulty(difficulty, region.area());
+        }
+    }
+    
+    // 应用差异（含感知校准）并更新开销模型
+    DiffInfo rerolled;
+    label_map = labels;
+    apply_calibrated(image, region, difficulty, algorithm_id, rerolled);
+    label_map = nullptr;
+    
+    // 设置差异信息
+    rerolled.position = cv::Point(region.x + region.width / 2, region.y + region.height / 2);
+    rerolled.size = region.size();
+    rerolled.region = region;
+    info = rerolled;
+    
+    return true;
+}
+
+cv::Rect DiffGenerator::select_replacement_region(const cv::Mat& image,
+                                                  const DetectionSet& objects,
+                                                  const std::vector<DiffInfo>& diff_info, int index) {
+    const cv::Rect image_rect(0, 0, image.cols, image.rows);
+    const cv::Rect& current = diff_info[index].region;
+    
+    // 检查是否与其他差异重叠
+    auto overlaps_others = [&](const cv::Rect& candidate) {
+        for (size_t i = 0; i < diff_info.size(); i++) {
+            if (static_cast<int>(i) != index && (candidate & diff_info[i].region).area() > 0) {
+                return true;
+            }
+        }
+        return false;
+    };
+    
+    // 优先选择未使用的检测框
+    std::vector<cv::Rect> candidates;
+    for (const auto& obj : objects) {
+        cv::Rect candidate = obj.bounding_box & image_rect;
+        if (candidate.area() > 0 && candidate != current && !overlaps_others(candidate)) {
+            candidates.push_back(candidate);
+        }
+    }
+    
+    if (!candidates.empty()) {
+        std::uniform_int_distribution<int> distrib(0, candidates.size() - 1);
+        return candidates[distrib(rng)];
+    }
+    
+    // 否则尝试随机区域
+    std::uniform_int_distribution<int> distrib_w(0, std::max(0, image.cols - 50));
+    std::uniform_int_distribution<int> distrib_h(0, std::max(0, image.rows - 50));
+    std::uniform_int_distribution<int> distrib_size(30, 100);
+    
+    for (int attempt = 0; attempt < 100; attempt++) {
+        int x = distrib_w(rng);
+        int y = distrib_h(rng);
+        int size = distrib_size(rng);
+        
+        // 确保区域在图像内
+        size = std::min(size, std::min(image.cols - x, image.rows - y));
+        cv::Rect random_region(x, y, size, size);
+        
+        if (random_region.area() > 0 && random_region != current && !overlaps_others(random_region)) {
+            return random_region;
+        }
+    }
+    
+    return cv::Rect();
+}
+
+int DiffGenerator::select_algorithm_for_difficulty(int difficulty, int area, double max_cost_ns) {
     // 根据难度选择算法
-    // 难度越高，越倾向于选择更微妙的算法
+    // 难度越高，越倾向于选择更微妙的算法；候选池由各算法元数据的难度范围决定
     
     std::vector<int> algorithm_pool;
+    algorithm_pool.reserve(get_algorithm_count());
     
-    if (difficulty <= 3) {
-        // 简单难度 - 明显的变化
-        algorithm_pool = {
-            DIFF_COLOR_SHIFT,
-            DIFF_OBJECT_REMOVAL,
-            DIFF_ROTATION,
-            DIFF_FLIP,
-            DIFF_ADDITION
-        };
-    } else if (difficulty <= 7) {
-        // 中等难度
-        algorithm_pool = {
-            DIFF_TEXTURE_CHANGE,
-            DIFF_SHAPE_DEFORM,
-            DIFF_SCALE_CHANGE,
-            DIFF_BLUR
-        };
-    } else {
-        // 高难度 - 微妙的变化
-        algorithm_pool = {
-            DIFF_SUBTLE_PATTERN,
-            DIFF_SHAPE_DEFORM,
-            DIFF_TEXTURE_CHANGE,
-            DIFF_BLUR
-        };
+    for (int id = 0; id < get_algorithm_count(); id++) {
+        const DiffAlgorithmInfo* info = get_algorithm_info(id);
+        if (info && algorithm_enabled[id] &&
+            difficulty >= info->min_difficulty && difficulty <= info->max_difficulty) {
+            algorithm_pool.push_back(id);
+        }
+    }
+    
+    // 没有可用算法时退回颜色变化
+    if (algorithm_pool.empty()) {
+        return DIFF_COLOR_SHIFT;
+    }
+    
+    // 有时间预算时，只在预测耗时不超出预算的算法中选择
+    if (max_cost_ns >= 0.0) {
+        std::vector<int> affordable;
+        int cheapest = algorithm_pool[0];
+        for (int id : algorithm_pool) {
+            double cost = estimate_cost_ns(id, area);
+            if (cost <= max_cost_ns) {
+                affordable.push_back(id);
+            }
+            if (cost < estimate_cost_ns(cheapest, area)) {
+                cheapest = id;
+            }
+        }
+        
+        // 都超出预算时，在难度范围内选最便宜的
+        if (affordable.empty()) {
+            return cheapest;
+        }
+        algorithm_pool.swap(affordable);
     }
     
     // 随机选择算法
@@ -209,48 +405,367 @@ int DiffGenerator::select_algorithm_for_difficulty(int difficulty) {
     return algorithm_pool[distrib(rng)];
 }
 
+void DiffGenerator::record_cost(int algorithm_id, int area, double elapsed_ns) {
+    if (algorithm_id < 0 || algorithm_id >= static_cast<int>(algorithm_costs.size()) || area <= 0) {
+        return;
+    }
+    
+    AlgorithmCost& cost = algorithm_costs[algorithm_id];
+    double sample = elapsed_ns / area;
+    
+    // 前几次采样直接取平均，之后使用指数滑动平均跟踪设备状态（如降频）
+    cost.samples++;
+    double weight = cost.samples < COST_WARMUP_SAMPLES ? 1.0 / cost.samples : COST_EWMA_ALPHA;
+    cost.ns_per_pixel += (sample - cost.ns_per_pixel) * weight;
+}
+
+double DiffGenerator::get_measured_cost(int algorithm_id) const {
+    if (algorithm_id < 0 || algorithm_id >= static_cast<int>(algorithm_costs.size())) {
+        return 0.0;
+    }
+    return algorithm_costs[algorithm_id].ns_per_pixel;
+}
+
+double DiffGenerator::estimate_cost_ns(int algorithm_id, int area) const {
+    return get_measured_cost(algorithm_id) * area;
+}
+
+float DiffGenerator::target_delta_e(int difficulty) {
+    // 难度1约为32（非常明显），难度10约为3.4（接近刚可察觉差异）
+    return 32.0f * std::pow(0.78f, static_cast<float>(std::max(1, std::min(10, difficulty)) - 1));
+}
+
+bool DiffGenerator::get_pixel_layout(const cv::Mat& image, PixelLayoutType& layout) {
+    if (image.depth() != CV_8U || image.channels() < 1 || image.channels() > PIXEL_LAYOUT_COUNT) {
+        return false;
+    }
+    layout = static_cast<PixelLayoutType>(image.channels() - 1);
+    return true;
+}
+
+// 将ROI转换为用于Lab计算的浮点RGB，去掉alpha，灰度扩展为三通道
+static void roi_to_float_rgb(const cv::Mat& roi, cv::Mat& rgb) {
+    cv::Mat color;
+    switch (roi.channels()) {
+        case 1: cv::cvtColor(roi, color, cv::COLOR_GRAY2RGB); break;
+        case 2: {
+            cv::Mat gray;
+            cv::extractChannel(roi, gray, 0);
+            cv::cvtColor(gray, color, cv::COLOR_GRAY2RGB);
+            break;
+        }
+        case 4: cv::cvtColor(roi, color, cv::COLOR_RGBA2RGB); break;
+        default: color = roi; break;
+    }
+    color.convertTo(rgb, CV_32F, 1.0 / 255.0);
+}
+
+float DiffGenerator::measure_delta_e(const cv::Mat& before, const cv::Mat& after) {
+    // 在ROI内转换到Lab空间并计算平均ΔE76
+    cv::Mat before_lab, after_lab;
+    roi_to_float_rgb(before, before_lab);
+    roi_to_float_rgb(after, after_lab);
+    cv::cvtColor(before_lab, before_lab, cv::COLOR_RGB2Lab);
+    cv::cvtColor(after_lab, after_lab, cv::COLOR_RGB2Lab);
+    
+    cv::Mat delta = before_lab - after_lab;
+    delta = delta.mul(delta);
+    
+    cv::Mat distance;
+    cv::transform(delta, distance, cv::Matx13f(1.0f, 1.0f, 1.0f));
+    cv::sqrt(distance, distance);
+    
+    return static_cast<float>(cv::mean(distance)[0]);
+}
+
+void DiffGenerator::apply_calibrated(cv::Mat& image, const cv::Rect& region, int difficulty,
+                                   int algorithm_id, DiffInfo& diff_info) {
+    auto apply_start = std::chrono::steady_clock::now();
+    
+    const DiffAlgorithmInfo* info = get_algorithm_info(algorithm_id);
+    bool calibrate = calibration_iterations > 0 && info && info->scalable;
+    
+    // 区域对应检测到的物体时，算法只修改该物体的像素
+    object_label = label_map ? label_map->find_label(region) : 0;
+    
+    // 保存ROI原始像素，并为该差异取独立的随机种子，重试时恢复，使每轮只改变强度
+    cv::Mat original_roi = image(region).clone();
+    uint32_t seed = static_cast<uint32_t>(rng());
+    std::mt19937 next_rng = rng;
+    rng.seed(seed);
+    
+    float target = target_delta_e(difficulty);
+    intensity_scale = 1.0f;
+    
+    apply_diff_algorithm(image, region, difficulty, algorithm_id, diff_info);
+    float score = measure_delta_e(original_roi, image(region));
+    
+    for (int iteration = 0; calibrate && iteration < calibration_iterations; iteration++) {
+        // 落在目标带内即停止
+        if (score >= target * (1.0f - CALIBRATION_TOLERANCE) && score <= target * (1.0f + CALIBRATION_TOLERANCE)) {
+            break;
+        }
+        
+        // ΔE与强度近似成正比，按比例调整并限制单步幅度
+        float ratio = score > 0.0f ? target / score : 4.0f;
+        float next_scale = intensity_scale * std::max(0.25f, std::min(4.0f, ratio));
+        next_scale = std::max(MIN_INTENSITY_SCALE, std::min(MAX_INTENSITY_SCALE, next_scale));
+        if (next_scale == intensity_scale) {
+            break;
+        }
+        intensity_scale = next_scale;
+        
+        original_roi.copyTo(image(region));
+        rng.seed(seed);
+        apply_diff_algorithm(image, region, difficulty, algorithm_id, diff_info);
+        score = measure_delta_e(original_roi, image(region));
+    }
+    
+    diff_info.perceptual_score = score;
+    diff_info.intensity_scale = intensity_scale;
+    diff_info.seed = seed;
+    intensity_scale = 1.0f;
+    object_label = 0;
+    rng = next_rng;
+    
+    double apply_ns = std::chrono::duration<double, std::nano>(
+        std::chrono::steady_clock::now() - apply_start).count();
+    record_cost(diff_info.algorithm_id, region.area(), apply_ns);
+}
+
+bool DiffGenerator::reapply_diff(cv::Mat& image, const DiffInfo& info, int difficulty) {
+    if (image.empty() || !get_pixel_layout(image, pixel_layout)) {
+        return false;
+    }
+    
+    const cv::Rect image_rect(0, 0, image.cols, image.rows);
+    if ((info.region & image_rect) != info.region || info.region.area() <= 0) {
+        return false;
+    }
+    
+    auto apply_start = std::chrono::steady_clock::now();
+    
+    // 使用记录的种子和强度系数，得到与首次生成相同的随机参数
+    std::mt19937 next_rng = rng;
+    rng.seed(info.seed);
+    intensity_scale = info.intensity_scale;
+    
+    DiffInfo replay = info;
+    apply_diff_algorithm(image, info.region, difficulty, info.algorithm_id, replay);
+    
+    intensity_scale = 1.0f;
+    rng = next_rng;
+    
+    double apply_ns = std::chrono::duration<double, std::nano>(
+        std::chrono::steady_clock::now() - apply_start).count();
+    record_cost(replay.algorithm_id, info.region.area(), apply_ns);
+    return true;
+}
+
+DiffAssetCache& DiffGenerator::get_asset_cache() {
+    return asset_cache;
+}
+
+const DiffAssetCache& DiffGenerator::get_asset_cache() const {
+    return asset_cache;
+}
+
+void DiffGenerator::set_calibration_iterations(int iterations) {
+    calibration_iterations = std::max(0, iterations);
+}
+
+int DiffGenerator::get_calibration_iterations() const {
+    return calibration_iterations;
+}
+
+DiffGeneratorConfig DiffGenerator::get_config() const {
+    DiffGeneratorConfig config;
+    config.custom_algorithms.reserve(custom_algorithms.size());
+    for (const auto& algorithm : custom_algorithms) {
+        config.custom_algorithms.push_back({ algorithm.name, algorithm.info.min_difficulty, algorithm.info.max_difficulty,
+                                             algorithm.info.cost_per_pixel, algorithm.kernel });
+    }
+    config.algorithm_enabled = algorithm_enabled;
+    config.calibration_iterations = calibration_iterations;
+    config.stickers = asset_cache.get_stickers();
+    return config;
+}
+
+void DiffGenerator::apply_config(const DiffGeneratorConfig& config) {
+    custom_algorithms.resize(config.custom_algorithms.size());
+    for (size_t i = 0; i < config.custom_algorithms.size(); i++) {
+        const auto& source = config.custom_algorithms[i];
+        CustomAlgorithm& algorithm = custom_algorithms[i];
+        algorithm.name = source.name;
+        algorithm.info.min_difficulty = source.min_difficulty;
+        algorithm.info.max_difficulty = source.max_difficulty;
+        algorithm.info.cost_per_pixel = source.cost_per_pixel;
+        algorithm.info.needs_mask = false;
+        algorithm.info.scalable = false;
+        algorithm.kernel = source.kernel;
+    }
+    for (auto& entry : custom_algorithms) {
+        entry.info.name = entry.name.c_str();
+    }
+    
+    size_t old_count = algorithm_costs.size();
+    algorithm_costs.resize(DIFF_TYPE_COUNT + custom_algorithms.size());
+    for (size_t id = old_count; id < algorithm_costs.size(); id++) {
+        algorithm_costs[id] = { custom_algorithms[id - DIFF_TYPE_COUNT].info.cost_per_pixel * COST_NS_PER_UNIT, 0 };
+    }
+    algorithm_enabled = config.algorithm_enabled;
+    algorithm_enabled.resize(algorithm_costs.size(), false);
+    calibration_iterations = config.calibration_iterations;
+    asset_cache.set_stickers(config.stickers);
+}
+
 void DiffGenerator::apply_diff_algorithm(cv::Mat& image, const cv::Rect& region, int difficulty, 
-                                       DiffInfo& diff_info) {
-    // 选择算法
-    int algorithm_id = select_algorithm_for_difficulty(difficulty);
-    
-    // 调用对应算法函数
-    if (algorithm_id >= 0 && algorithm_id < static_cast<int>(diff_algorithms.size())) {
-        diff_algorithms[algorithm_id](image, region, difficulty, diff_info);
-        diff_info.algorithm_id = algorithm_id;
+                                       int algorithm_id, DiffInfo& diff_info) {
+    diff_info.algorithm_id = algorithm_id;
+    
+    // 内置算法直接查表分发
+    if (algorithm_id >= 0 && algorithm_id < DIFF_TYPE_COUNT) {
+        (this->*builtin_kernels[pixel_layout][algorithm_id])(image, region, difficulty, diff_info);
+        return;
+    }
+    
+    // 自定义算法
+    int custom_index = algorithm_id - DIFF_TYPE_COUNT;
+    if (custom_index >= 0 && custom_index < static_cast<int>(custom_algorithms.size()) &&
+        custom_algorithms[custom_index].kernel) {
+        custom_algorithms[custom_index].kernel(image, region, difficulty, diff_info);
+        return;
+    }
+    
+    // 默认使用颜色变化
+    apply_color_shift(image, region, difficulty, diff_info);
+    diff_info.algorithm_id = DIFF_COLOR_SHIFT;
+}
+
+int DiffGenerator::register_algorithm(const std::string& name, int min_difficulty, int max_difficulty,
+                                    float cost_per_pixel, CustomDiffKernel kernel) {
+    if (!kernel || min_difficulty > max_difficulty) {
+        return -1;
+    }
+    
+    CustomAlgorithm algorithm;
+    algorithm.name = name;
+    algorithm.info.min_difficulty = std::max(1, min_difficulty);
+    algorithm.info.max_difficulty = std::min(10, max_difficulty);
+    algorithm.info.cost_per_pixel = std::max(0.0f, cost_per_pixel);
+    algorithm.info.needs_mask = false;
+    algorithm.info.scalable = false;
+    algorithm.kernel = std::move(kernel);
+    
+    // 复用已注销的槽位，保持已分配ID稳定
+    size_t index = 0;
+    while (index < custom_algorithms.size() && custom_algorithms[index].kernel) {
+        index++;
+    }
+    
+    if (index == custom_algorithms.size()) {
+        custom_algorithms.push_back(std::move(algorithm));
+        algorithm_enabled.push_back(true);
+        algorithm_costs.push_back({0.0, 0});
     } else {
-        // 默认使用颜色变化
-        apply_color_shift(image, region, difficulty, diff_info);
-        diff_info.algorithm_id = DIFF_COLOR_SHIFT;
+        custom_algorithms[index] = std::move(algorithm);
+        algorithm_enabled[DIFF_TYPE_COUNT + index] = true;
+    }
+    algorithm_costs[DIFF_TYPE_COUNT + index] = {custom_algorithms[index].info.cost_per_pixel * COST_NS_PER_UNIT, 0};
+    
+    // 名称指针在条目就位后再设置
+    for (auto& entry : custom_algorithms) {
+        entry.info.name = entry.name.c_str();
+    }
+    
+    return DIFF_TYPE_COUNT + static_cast<int>(index);
+}
+
+bool DiffGenerator::unregister_algorithm(int algorithm_id) {
+    int custom_index = algorithm_id - DIFF_TYPE_COUNT;
+    if (custom_index < 0 || custom_index >= static_cast<int>(custom_algorithms.size()) ||
+        !custom_algorithms[custom_index].kernel) {
+        return false;
+    }
+    
+    custom_algorithms[custom_index].kernel = nullptr;
+    algorithm_enabled[algorithm_id] = false;
+    return true;
+}
+
+void DiffGenerator::set_algorithm_enabled(int algorithm_id, bool enabled) {
+    if (algorithm_id >= 0 && algorithm_id < get_algorithm_count()) {
+        algorithm_enabled[algorithm_id] = enabled;
+    }
+}
+
+const DiffAlgorithmInfo* DiffGenerator::get_algorithm_info(int algorithm_id) const {
+    if (algorithm_id >= 0 && algorithm_id < DIFF_TYPE_COUNT) {
+        return &builtin_info[algorithm_id];
+    }
+    
+    int custom_index = algorithm_id - DIFF_TYPE_COUNT;
+    if (custom_index >= 0 && custom_index < static_cast<int>(custom_algorithms.size()) &&
+        custom_algorithms[custom_index].kernel) {
+        return &custom_algorithms[custom_index].info;
     }
+    
+    return nullptr;
+}
+
+int DiffGenerator::get_algorithm_count() const {
+    return DIFF_TYPE_COUNT + static_cast<int>(custom_algorithms.size());
 }
 
 // 差异算法实现
 
+template <typename Fn>
+void DiffGenerator::for_each_object_span(const cv::Rect& region, int row, Fn&& fn) const {
+    if (label_map && object_label > 0) {
+        label_map->for_each_span(region, row, object_label, fn);
+    } else {
+        fn(0, region.width);
+    }
+}
+
+template <typename Layout>
+void DiffGenerator::write_object_spans(cv::Mat& image, const cv::Rect& region, cv::Mat& transformed) {
+    cv::Mat roi = image(region);
+    restore_alpha<Layout>(transformed, save_alpha<Layout>(roi));
+    
+    // 变换会把物体边缘外的背景移入物体范围，但背景像素本身不被改写
+    for (int i = 0; i < roi.rows; i++) {
+        uchar* row = roi.ptr<uchar>(i);
+        const uchar* transformed_row = transformed.ptr<uchar>(i);
+        for_each_object_span(region, i, [&](int x0, int x1) {
+            memcpy(row + x0 * Layout::channels, transformed_row + x0 * Layout::channels, (x1 - x0) * Layout::channels);
+        });
+    }
+}
+
+template <typename Layout>
 void DiffGenerator::apply_color_shift(cv::Mat& image, const cv::Rect& region, int difficulty, DiffInfo& diff_info) {
     // 提取区域
     cv::Mat roi = image(region);
     
     // 根据难度计算颜色变化强度
-    float intensity = (11 - difficulty) * 2.5f;  // 难度越低，变化越明显
+    float intensity = (11 - difficulty) * 2.5f * intensity_scale;  // 难度越低，变化越明显
     
-    // 随机选择颜色通道
-    std::uniform_int_distribution<int> channel_dist(0, 2);
+    // 随机选择颜色通道（不修改alpha）
+    std::uniform_int_distribution<int> channel_dist(0, Layout::color_channels - 1);
     int channel = channel_dist(rng);
     
-    // 对选定通道应用变化
+    // 对选定通道逐行应用变化（按CPU特性分发的内核），只处理物体所在的像素段
+    const CpuKernelTable& kernels = get_cpu_kernels();
     for (int i = 0; i < roi.rows; i++) {
-        for (int j = 0; j < roi.cols; j++) {
-            cv::Vec3b& pixel = roi.at<cv::Vec3b>(i, j);
-            
-            // 应用颜色变化
-            int new_value = pixel[channel] + intensity;
-            new_value = std::max(0, std::min(255, new_value));
-            pixel[channel] = static_cast<uchar>(new_value);
-        }
+        uchar* row = roi.ptr<uchar>(i);
+        for_each_object_span(region, i, [&](int x0, int x1) {
+            kernels.add_channel_saturate(row + x0 * Layout::channels, x1 - x0, Layout::channels, channel, static_cast<int>(intensity));
+        });
     }
 }
 
+template <typename Layout>
 void DiffGenerator::apply_object_removal(cv::Mat& image, const cv::Rect& region, int difficulty, DiffInfo& diff_info) {
     // 从区域周围选择填充源
     cv::Point2i source;
@@ -263,62 +778,60 @@ void DiffGenerator::apply_object_removal(cv::Mat& image, const cv::Rect& region,
     source.x = std::max(0, std::min(image.cols - 1, source.x));
     source.y = std::max(0, std::min(image.rows - 1, source.y));
     
-    // 创建填充遮罩
-    cv::Mat mask = cv::Mat::zeros(region.height, region.width, CV_8UC1);
-    cv::ellipse(mask, cv::Point(region.width/2, region.height/2), 
-               cv::Size(region.width/2, region.height/2), 0, 0, 360, 
-               cv::Scalar(255), -1);
+    // 创建填充遮罩：有对应物体时取物体自身的像素，否则使用区域内切椭圆
+    cv::Mat mask;
+    if (label_map && object_label > 0) {
+        cv::compare(label_map->get_labels()(region), cv::Scalar(object_label), mask, cv::CMP_EQ);
+    } else {
+        mask = cv::Mat::zeros(region.height, region.width, CV_8UC1);
+        cv::ellipse(mask, cv::Point(region.width/2, region.height/2), 
+                   cv::Size(region.width/2, region.height/2), 0, 0, 360, 
+                   cv::Scalar(255), -1);
+    }
     
-    // 应用修复算法
+    // 应用修复算法（inpaint只支持1或3通道，带alpha时只修复颜色通道）
     cv::Mat roi = image(region);
-    cv::inpaint(roi, mask, roi, 3, cv::INPAINT_TELEA);
+    if (Layout::has_alpha) {
+        cv::Mat color(roi.size(), CV_8UC(Layout::color_channels));
+        const int to_color[] = {0, 0, 1, 1, 2, 2};
+        cv::mixChannels(&roi, 1, &color, 1, to_color, Layout::color_channels);
+        cv::inpaint(color, mask, color, 3, cv::INPAINT_TELEA);
+        cv::mixChannels(&color, 1, &roi, 1, to_color, Layout::color_channels);
+    } else {
+        cv::inpaint(roi, mask, roi, 3, cv::INPAINT_TELEA);
+    }
 }
 
+template <typename Layout>
 void DiffGenerator::apply_texture_change(cv::Mat& image, const cv::Rect& region, int difficulty, DiffInfo& diff_info) {
     // 提取区域
     cv::Mat roi = image(region);
     
-    // 创建纹理掩码
-    cv::Mat texture = cv::Mat::zeros(region.height, region.width, CV_8UC1);
-    
-    // 根据难度生成不同复杂度的纹理
-    int pattern_size = 10 - difficulty / 2;  // 难度越高，纹理越细腻
-    pattern_size = std::max(2, pattern_size);
-    
-    // 生成网格或随机点纹理
-    for (int i = 0; i < roi.rows; i += pattern_size) {
-        for (int j = 0; j < roi.cols; j += pattern_size) {
-            cv::Rect pattern_rect(j, i, pattern_size, pattern_size);
-            pattern_rect &= cv::Rect(0, 0, roi.cols, roi.rows); // 确保在ROI内
-            
-            if (pattern_rect.area() > 0) {
-                std::uniform_int_distribution<int> pattern_dist(0, 255);
-                cv::rectangle(texture, pattern_rect, cv::Scalar(pattern_dist(rng)), -1);
-            }
-        }
-    }
+    // 从缓存取难度对应的纹理块（难度越高方格越细），随机选择变体和偏移
+    int variant = std::uniform_int_distribution<int>(0, DiffAssetCache::VARIANT_COUNT - 1)(rng);
+    const cv::Mat& tile = asset_cache.get_texture_tile(std::max(roi.cols, roi.rows), difficulty, variant);
+    int offset_x = std::uniform_int_distribution<int>(0, tile.cols - roi.cols)(rng);
+    int offset_y = std::uniform_int_distribution<int>(0, tile.rows - roi.rows)(rng);
     
     // 应用纹理变化
-    float alpha = 0.2f; // 混合强度
+    float alpha = std::min(1.0f, 0.2f * intensity_scale); // 混合强度
+    const CpuKernelTable& kernels = get_cpu_kernels();
     for (int i = 0; i < roi.rows; i++) {
-        for (int j = 0; j < roi.cols; j++) {
-            cv::Vec3b& pixel = roi.at<cv::Vec3b>(i, j);
-            uchar tex_value = texture.at<uchar>(i, j);
-            
-            for (int c = 0; c < 3; c++) {
-                float new_value = (1 - alpha) * pixel[c] + alpha * tex_value;
-                pixel[c] = static_cast<uchar>(std::max(0.0f, std::min(255.0f, new_value)));
-            }
-        }
+        uchar* row = roi.ptr<uchar>(i);
+        const uchar* texture_row = tile.ptr<uchar>(offset_y + i) + offset_x;
+        for_each_object_span(region, i, [&](int x0, int x1) {
+            kernels.blend_gray(row + x0 * Layout::channels, texture_row + x0, x1 - x0, Layout::channels, alpha);
+        });
     }
 }
 
+template <typename Layout>
 void DiffGenerator::apply_shape_deform(cv::Mat& image, const cv::Rect& region, int difficulty, DiffInfo& diff_info) {
     // 提取区域
     cv::Mat roi = image(region).clone();
     
     // 计算变形参数
-    float strength = (11 - difficulty) * 0.05f;  // 难度越低，变形越明显
+    float strength = (11 - difficulty) * 0.05f * intensity_scale;  // 难度越低，变形越明显
     
     // 创建变形映射
     cv::Mat map_x(roi.size(), CV_32FC1);
@@ -337,43 +850,44 @@ void DiffGenerator::apply_shape_deform(cv::Mat& image, const cv::Rect& region, i
     cv::Mat deformed;
     cv::remap(roi, deformed, map_x, map_y, cv::INTER_LINEAR, cv::BORDER_CONSTANT);
     
-    // 复制回原图
-    deformed.copyTo(image(region));
+    // 只把物体像素写回原图，alpha保持原值
+    write_object_spans<Layout>(image, region, deformed);
 }
 
+template <typename Layout>
 void DiffGenerator::apply_subtle_pattern(cv::Mat& image, const cv::Rect& region, int difficulty, DiffInfo& diff_info) {
     // 提取区域
     cv::Mat roi = image(region);
     
-    // 根据难度选择图案复杂度
-    int pattern_complexity = difficulty;
-    float intensity = 0.1f + (1.0f - difficulty / 10.0f) * 0.2f;  // 难度越高，强度越低
+    // 根据难度计算强度，难度越高，强度越低
+    float intensity = (0.1f + (1.0f - difficulty / 10.0f) * 0.2f) * intensity_scale;
+    int delta = static_cast<int>(intensity * 50);
     
-    // 创建一个随机模式
-    std::uniform_int_distribution<int> pattern_dist(0, pattern_complexity);
+    // 从缓存取难度对应的随机图案遮罩（难度越高，被选中的像素越稀疏）
+    int variant = std::uniform_int_distribution<int>(0, DiffAssetCache::VARIANT_COUNT - 1)(rng);
+    const cv::Mat& mask = asset_cache.get_pattern_mask(std::max(roi.cols, roi.rows), difficulty, variant);
+    int offset_x = std::uniform_int_distribution<int>(0, mask.cols - roi.cols)(rng);
+    int offset_y = std::uniform_int_distribution<int>(0, mask.rows - roi.rows)(rng);
     
+    // 只修改遮罩选中的像素，颜色通道向远离中间灰的方向移动
+    const CpuKernelTable& kernels = get_cpu_kernels();
     for (int i = 0; i < roi.rows; i++) {
-        for (int j = 0; j < roi.cols; j++) {
-            // 只修改满足模式的像素
-            if ((i + j) % (pattern_complexity + 1) == pattern_dist(rng)) {
-                cv::Vec3b& pixel = roi.at<cv::Vec3b>(i, j);
-                
-                for (int c = 0; c < 3; c++) {
-                    float change = (pixel[c] < 128) ? intensity * 50 : -intensity * 50;
-                    int new_value = pixel[c] + change;
-                    pixel[c] = static_cast<uchar>(std::max(0, std::min(255, new_value)));
-                }
-            }
-        }
+        uchar* row = roi.ptr<uchar>(i);
+        const uchar* mask_row = mask.ptr<uchar>(offset_y + i) + offset_x;
+        for_each_object_span(region, i, [&](int x0, int x1) {
+            kernels.push_contrast_masked(row + x0 * Layout::channels, mask_row + x0, x1 - x0,
+                                         Layout::channels, delta);
+        });
     }
 }
 
+template <typename Layout>
 void DiffGenerator::apply_scale_change(cv::Mat& image, const cv::Rect& region, int difficulty, DiffInfo& diff_info) {
     // 提取区域
     cv::Mat roi = image(region).clone();
     
     // 根据难度计算缩放因子
-    float scale_factor = 1.0f + (11 - difficulty) * 0.03f;
+    float scale_factor = 1.0f + (11 - difficulty) * 0.03f * intensity_scale;
     if (std::uniform_int_distribution<int>(0, 1)(rng) == 0) {
         scale_factor = 1.0f / scale_factor;  // 有时缩小而不是放大
     }
@@ -382,27 +896,24 @@ void DiffGenerator::apply_scale_change(cv::Mat& image, const cv::Rect& region, i
     cv::Mat scaled;
     cv::resize(roi, scaled, cv::Size(), scale_factor, scale_factor);
     
-    // 裁剪或填充以适应原始区域
-    cv::Mat result = cv::Mat::zeros(roi.size(), roi.type());
+    // 以中心对齐裁剪或填充以适应原始区域；缩小时空出的部分保留原像素，避免出现黑边
+    int copy_width = std::min(scaled.cols, roi.cols);
+    int copy_height = std::min(scaled.rows, roi.rows);
+    cv::Rect src_rect((scaled.cols - copy_width) / 2, (scaled.rows - copy_height) / 2, copy_width, copy_height);
+    cv::Rect dst_rect((roi.cols - copy_width) / 2, (roi.rows - copy_height) / 2, copy_width, copy_height);
     
-    cv::Rect src_rect(0, 0, 
-                     std::min(scaled.cols, result.cols), 
-                     std::min(scaled.rows, result.rows));
-    cv::Rect dst_rect(0, 0, src_rect.width, src_rect.height);
-    
-    // 将缩放后的图像复制到结果中
-    scaled(src_rect).copyTo(result(dst_rect));
-    
-    // 复制回原图
-    result.copyTo(image(region));
+    // 在区域副本上放入缩放结果，再只把物体像素写回原图，alpha保持原值
+    scaled(src_rect).copyTo(roi(dst_rect));
+    write_object_spans<Layout>(image, region, roi);
 }
 
+template <typename Layout>
 void DiffGenerator::apply_rotation(cv::Mat& image, const cv::Rect& region, int difficulty, DiffInfo& diff_info) {
     // 提取区域
     cv::Mat roi = image(region).clone();
     
     // 根据难度计算旋转角度
-    float angle = (11 - difficulty) * 3.0f;  // 难度越低，旋转越明显
+    float angle = (11 - difficulty) * 3.0f * intensity_scale;  // 难度越低，旋转越明显
     if (std::uniform_int_distribution<int>(0, 1)(rng) == 0) {
         angle = -angle;  // 随机方向
     }
@@ -417,10 +928,11 @@ void DiffGenerator::apply_rotation(cv::Mat& image, const cv::Rect& region, int d
     cv::Mat rotated;
     cv::warpAffine(roi, rotated, rotation_matrix, roi.size());
     
-    // 复制回原图
-    rotated.copyTo(image(region));
+    // 只把物体像素写回原图，alpha保持原值
+    write_object_spans<Layout>(image, region, rotated);
 }
 
+template <typename Layout>
 void DiffGenerator::apply_flip(cv::Mat& image, const cv::Rect& region, int difficulty, DiffInfo& diff_info) {
     // 提取区域
     cv::Mat roi = image(region);
@@ -435,28 +947,43 @@ void DiffGenerator::apply_flip(cv::Mat& image, const cv::Rect& region, int diffi
         flip_code = std::uniform_int_distribution<int>(-1, 1)(rng);
     }
     
-    // 应用翻转
-    cv::flip(roi, roi, flip_code);
+    // 翻转后只把物体像素写回原图，alpha保持原值
+    cv::Mat flipped;
+    cv::flip(roi, flipped, flip_code);
+    write_object_spans<Layout>(image, region, flipped);
 }
 
+template <typename Layout>
 void DiffGenerator::apply_blur(cv::Mat& image, const cv::Rect& region, int difficulty, DiffInfo& diff_info) {
     // 提取区域
     cv::Mat roi = image(region);
     
     // 根据难度计算模糊程度
-    int kernel_size = std::max(3, 11 - difficulty);
+    int kernel_size = std::max(3, static_cast<int>(std::lround((11 - difficulty) * intensity_scale)));
     if (kernel_size % 2 == 0) kernel_size++; // 确保奇数
     
-    // 应用高斯模糊
-    cv::GaussianBlur(roi, roi, cv::Size(kernel_size, kernel_size), 0);
+    // 应用高斯模糊，alpha保持原值
+    if (!label_map || object_label == 0) {
+        cv::Mat alpha = save_alpha<Layout>(roi);
+        cv::GaussianBlur(roi, roi, cv::Size(kernel_size, kernel_size), 0);
+        restore_alpha<Layout>(roi, alpha);
+        return;
+    }
+    
+    // 有对应物体时只把物体像素段写回，背景保持清晰
+    cv::Mat blurred;
+    cv::GaussianBlur(roi, blurred, cv::Size(kernel_size, kernel_size), 0);
+    write_object_spans<Layout>(image, region, blurred);
 }
 
+template <typename Layout>
 void DiffGenerator::apply_addition(cv::Mat& image, const cv::Rect& region, int difficulty, DiffInfo& diff_info) {
     // 提取区域
     cv::Mat roi = image(region);
     
-    // 根据难度选择添加图案的复杂度
-    int shape_type = std::uniform_int_distribution<int>(0, 2)(rng);
+    // 随机选择内置形状或用户贴纸
+    int sticker_count = asset_cache.get_sticker_count();
+    int shape_type = std::uniform_int_distribution<int>(0, DIFF_SHAPE_COUNT - 1 + sticker_count)(rng);
     cv::Scalar color;
     
     // 随机选择颜色
@@ -465,43 +992,28 @@ void DiffGenerator::apply_addition(cv::Mat& image, const cv::Rect& region, int d
     }
     
     // 根据难度调整不透明度
-    float alpha = 0.5f + (10 - difficulty) * 0.05f;  // 难度越高，越透明
-    
-    // 计算形状位置和大小
-    int shape_size = region.width / 4;
-    cv::Point center(roi.cols / 2, roi.rows / 2);
-    
-    // 创建遮罩
-    cv::Mat shape_mask = cv::Mat::zeros(roi.size(), CV_8UC1);
-    
-    // 绘制形状
-    switch (shape_type) {
-        case 0: // 圆形
-            cv::circle(shape_mask, center, shape_size, cv::Scalar(255), -1);
-            break;
-        case 1: // 矩形
-            cv::rectangle(shape_mask, cv::Point(center.x - shape_size, center.y - shape_size), 
-                         cv::Point(center.x + shape_size, center.y + shape_size), 
-                         cv::Scalar(255), -1);
-            break;
-        case 2: // 三角形
-            std::vector<cv::Point> triangle;
-            triangle.push_back(cv::Point(center.x, center.y - shape_size));
-            triangle.push_back(cv::Point(center.x - shape_size, center.y + shape_size));
-            triangle.push_back(cv::Point(center.x + shape_size, center.y + shape_size));
-            cv::fillPoly(shape_mask, std::vector<std::vector<cv::Point>>{triangle}, cv::Scalar(255));
-            break;
-    }
-    
-    // 将形状添加到ROI中
-    for (int i = 0; i < roi.rows; i++) {
-        for (int j = 0; j < roi.cols; j++) {
-            if (shape_mask.at<uchar>(i, j) > 0) {
-                cv::Vec3b& pixel = roi.at<cv::Vec3b>(i, j);
-                for (int c = 0; c < 3; c++) {
-                    pixel[c] = static_cast<uchar>(pixel[c] * (1 - alpha) + color[c] * alpha);
-                }
-            }
+    float alpha = std::min(1.0f, (0.5f + (10 - difficulty) * 0.05f) * intensity_scale);  // 难度越高，越透明
+    
+    // 从缓存取抗锯齿形状精灵或缩放后的贴纸，边长约为区域宽度的一半
+    int shape_size = region.width / 4 * 2 + 1;
+    bool is_sticker = shape_type >= DIFF_SHAPE_COUNT;
+    const cv::Mat& sprite = is_sticker ? asset_cache.get_sticker(shape_type - DIFF_SHAPE_COUNT, shape_size)
+                                       : asset_cache.get_shape_sprite(shape_type, shape_size);
+    
+    // 以ROI中心对齐并裁剪到ROI内
+    cv::Rect placement((roi.cols - sprite.cols) / 2, (roi.rows - sprite.rows) / 2, sprite.cols, sprite.rows);
+    cv::Rect visible = placement & cv::Rect(0, 0, roi.cols, roi.rows);
+    
+    // 将形状逐行混合到ROI中
+    const float blend_color[3] = { static_cast<float>(color[0]), static_cast<float>(color[1]), static_cast<float>(color[2]) };
+    const CpuKernelTable& kernels = get_cpu_kernels();
+    for (int i = 0; i < visible.height; i++) {
+        uchar* row = roi.ptr<uchar>(visible.y + i) + visible.x * Layout::channels;
+        const uchar* sprite_row = sprite.ptr<uchar>(visible.y - placement.y + i) + (visible.x - placement.x) * sprite.channels();
+        if (is_sticker) {
+            kernels.blend_sprite(row, sprite_row, visible.width, Layout::channels, alpha);
+        } else {
+            kernels.blend_color_coverage(row, sprite_row, visible.width, Layout::channels, blend_color, alpha);
         }
     }
 }
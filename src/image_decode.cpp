@@ -0,0 +1,132 @@
+#include "image_decode.h"
+
+#include <opencv2/imgcodecs.hpp>
+#include <opencv2/imgproc.hpp>
+#include <algorithm>
+#include <cstring>
+
+namespace godot {
+
+// 检测模型的输入边长，缩小解码后的长边不低于此尺寸
+constexpr int DETECTOR_INPUT_SIZE = 640;
+
+bool read_jpeg_size(const uint8_t* data, size_t size, int& width, int& height) {
+    if (size < 4 || data[0] != 0xFF || data[1] != 0xD8) {
+        return false;
+    }
+    
+    size_t pos = 2;
+    while (pos + 4 <= size) {
+        if (data[pos] != 0xFF) {
+            return false;
+        }
+        uint8_t marker = data[pos + 1];
+        if (marker == 0xFF) {
+            // 填充字节
+            pos++;
+            continue;
+        }
+        if (marker == 0x01 || (marker >= 0xD0 && marker <= 0xD8)) {
+            // 无长度字段的标记
+            pos += 2;
+            continue;
+        }
+        
+        size_t length = (static_cast<size_t>(data[pos + 2]) << 8) | data[pos + 3];
+        if (length < 2) {
+            return false;
+        }
+        // SOF0-SOF15，排除同一区间内的DHT、JPG和DAC
+        if (marker >= 0xC0 && marker <= 0xCF && marker != 0xC4 && marker != 0xC8 && marker != 0xCC) {
+            if (pos + 9 > size) {
+                return false;
+            }
+            height = (data[pos + 5] << 8) | data[pos + 6];
+            width = (data[pos + 7] << 8) | data[pos + 8];
+            return width > 0 && height > 0;
+        }
+        pos += 2 + length;
+    }
+    return false;
+}
+
+bool read_png_size(const uint8_t* data, size_t size, int& width, int& height, int& channels) {
+    static const uint8_t signature[8] = { 0x89, 'P', 'N', 'G', 0x0D, 0x0A, 0x1A, 0x0A };
+    if (size < 26 || memcmp(data, signature, sizeof(signature)) != 0 || memcmp(data + 12, "IHDR", 4) != 0) {
+        return false;
+    }
+    
+    uint32_t png_width = (static_cast<uint32_t>(data[16]) << 24) | (data[17] << 16) | (data[18] << 8) | data[19];
+    uint32_t png_height = (static_cast<uint32_t>(data[20]) << 24) | (data[21] << 16) | (data[22] << 8) | data[23];
+    if (png_width == 0 || png_height == 0 || png_width > INT32_MAX || png_height > INT32_MAX) {
+        return false;
+    }
+    width = static_cast<int>(png_width);
+    height = static_cast<int>(png_height);
+    
+    // 灰度为1通道，真彩色为3通道；调色板可能带透明，和灰度+透明一样按4通道估算
+    uint8_t color_type = data[25];
+    channels = color_type == 0 ? 1 : (color_type == 2 ? 3 : 4);
+    return true;
+}
+
+int get_image_decode_flags(bool is_jpeg) {
+    // 与Godot的load_jpg_from_buffer一致不应用EXIF方向，文件头读出的尺寸也因此与解码结果一致
+    return (is_jpeg ? cv::IMREAD_ANYCOLOR : cv::IMREAD_UNCHANGED) | cv::IMREAD_IGNORE_ORIENTATION;
+}
+
+int get_reduced_decode_factor(int width, int height) {
+    int long_side = std::max(width, height);
+    for (int factor = 8; factor > 1; factor /= 2) {
+        if (long_side / factor >= DETECTOR_INPUT_SIZE) {
+            return factor;
+        }
+    }
+    return 1;
+}
+
+int get_reduced_decode_flags(int factor) {
+    int flags = cv::IMREAD_COLOR;
+    switch (factor) {
+        case 2: flags = cv::IMREAD_REDUCED_COLOR_2; break;
+        case 4: flags = cv::IMREAD_REDUCED_COLOR_4; break;
+        case 8: flags = cv::IMREAD_REDUCED_COLOR_8; break;
+        default: break;
+    }
+    return flags | cv::IMREAD_IGNORE_ORIENTATION;
+}
+
+bool convert_decoded_image(cv::Mat& decoded, cv::Mat& working) {
+    if (decoded.depth() == CV_16U) {
+        decoded.convertTo(decoded, CV_8U, 1.0 / 257.0);
+    } else if (decoded.depth() != CV_8U) {
+        return false;
+    }
+    
+    switch (decoded.channels()) {
+        case 1:
+            if (working.empty()) {
+                working = decoded;
+            } else {
+                decoded.copyTo(working);
+            }
+            return true;
+        case 3: cv::cvtColor(decoded, working, cv::COLOR_BGR2RGB); return true;
+        case 4: cv::cvtColor(decoded, working, cv::COLOR_BGRA2RGBA); return true;
+        default: return false;
+    }
+}
+
+bool decode_image_buffer(const cv::Mat& encoded, int flags, cv::Mat& working) {
+    cv::Mat decoded = cv::imdecode(encoded, flags);
+    return !decoded.empty() && convert_decoded_image(decoded, working);
+}
+
+bool decode_image_buffer(const uint8_t* data, size_t size, cv::Mat& working) {
+    int width = 0;
+    int height = 0;
+    cv::Mat encoded(1, static_cast<int>(size), CV_8UC1, const_cast<uint8_t*>(data));
+    return decode_image_buffer(encoded, get_image_decode_flags(read_jpeg_size(data, size, width, height)), working);
+}
+
+} // namespace godot
@@ -0,0 +1,163 @@
+#include "instance_label_map.h"
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+
+namespace godot {
+
+// 标签图支持的最大物体数量（16位标签，0保留给背景）
+constexpr int MAX_LABELED_OBJECTS = 65535;
+
+// 扫描线填充的多边形边，y_start <= y < y_end的行与该边相交
+struct ScanEdge {
+    int y_start;
+    int y_end;
+    double x;       // 在当前行的交点横坐标
+    double dx;      // 每行横坐标增量
+};
+
+// 用活动边表按奇偶规则填充多边形，只写入多边形覆盖的像素
+template <typename T>
+static void fill_polygon(cv::Mat& labels, ConstSpan<cv::Point> points, T value) {
+    const int rows = labels.rows;
+    const int cols = labels.cols;
+
+    // 按起始行分桶，水平边不参与求交
+    std::vector<std::vector<ScanEdge>> edge_table;
+    int first_row = rows;
+    int last_row = -1;
+    for (size_t i = 0; i < points.size(); i++) {
+        cv::Point p0 = points[i];
+        cv::Point p1 = points[(i + 1) % points.size()];
+        if (p0.y == p1.y) {
+            continue;
+        }
+        if (p0.y > p1.y) {
+            std::swap(p0, p1);
+        }
+
+        ScanEdge edge;
+        edge.dx = static_cast<double>(p1.x - p0.x) / (p1.y - p0.y);
+        edge.y_start = std::max(p0.y, 0);
+        edge.y_end = std::min(p1.y, rows);
+        if (edge.y_start >= edge.y_end) {
+            continue;
+        }
+        edge.x = p0.x + (edge.y_start - p0.y) * edge.dx;
+
+        if (edge_table.empty()) {
+            edge_table.resize(rows);
+        }
+        edge_table[edge.y_start].push_back(edge);
+        first_row = std::min(first_row, edge.y_start);
+        last_row = std::max(last_row, edge.y_end);
+    }
+
+    std::vector<ScanEdge> active;
+    std::vector<double> crossings;
+    for (int y = first_row; y < last_row; y++) {
+        // 移除已结束的边，加入从本行开始的边
+        active.erase(std::remove_if(active.begin(), active.end(),
+                                    [y](const ScanEdge& edge) { return edge.y_end <= y; }),
+                     active.end());
+        active.insert(active.end(), edge_table[y].begin(), edge_table[y].end());
+
+        crossings.clear();
+        for (ScanEdge& edge : active) {
+            crossings.push_back(edge.x);
+            edge.x += edge.dx;
+        }
+        std::sort(crossings.begin(), crossings.end());
+
+        // 成对的交点之间为多边形内部，包含落在边上的像素
+        T* row = labels.ptr<T>(y);
+        for (size_t i = 0; i + 1 < crossings.size(); i += 2) {
+            int x0 = std::max(static_cast<int>(std::ceil(crossings[i])), 0);
+            int x1 = std::min(static_cast<int>(std::floor(crossings[i + 1])), cols - 1);
+            if (x0 <= x1) {
+                std::fill(row + x0, row + x1 + 1, value);
+            }
+        }
+    }
+}
+
+InstanceLabelMap::InstanceLabelMap() {
+}
+
+InstanceLabelMap::~InstanceLabelMap() {
+}
+
+void InstanceLabelMap::build(const cv::Size& size, const DetectionSet& objects) {
+    int count = std::min(static_cast<int>(objects.size()), MAX_LABELED_OBJECTS);
+    labels.create(size, count <= 255 ? CV_8UC1 : CV_16UC1);
+    labels.setTo(cv::Scalar(0));
+    boxes.assign(count, cv::Rect());
+
+    // 按置信度从低到高绘制，重叠处保留置信度更高的物体
+    std::vector<int> order(count);
+    std::iota(order.begin(), order.end(), 0);
+    ConstSpan<float> confidences = objects.get_confidences();
+    std::stable_sort(order.begin(), order.end(), [&confidences](int a, int b) {
+        return confidences[a] < confidences[b];
+    });
+
+    const cv::Rect image_rect(0, 0, size.width, size.height);
+    for (int index : order) {
+        DetectionView obj = objects[index];
+        int label = index + 1;
+        boxes[index] = obj.bounding_box & image_rect;
+
+        if (obj.points.size() < 3) {
+            if (boxes[index].area() > 0) {
+                labels(boxes[index]).setTo(cv::Scalar(label));
+            }
+        } else if (labels.depth() == CV_8U) {
+            fill_polygon<uint8_t>(labels, obj.points, static_cast<uint8_t>(label));
+        } else {
+            fill_polygon<uint16_t>(labels, obj.points, static_cast<uint16_t>(label));
+        }
+    }
+}
+
+void InstanceLabelMap::clear() {
+    labels.release();
+    boxes.clear();
+}
+
+bool InstanceLabelMap::empty() const {
+    return labels.empty();
+}
+
+const cv::Mat& InstanceLabelMap::get_labels() const {
+    return labels;
+}
+
+int InstanceLabelMap::get_object_count() const {
+    return static_cast<int>(boxes.size());
+}
+
+int InstanceLabelMap::find_label(const cv::Rect& region) const {
+    if (labels.empty()) {
+        return 0;
+    }
+
+    // 差异区域通常直接取自检测框，按IoU匹配以容忍裁剪和对齐带来的偏差
+    const cv::Rect clipped = region & cv::Rect(0, 0, labels.cols, labels.rows);
+    int best_label = 0;
+    double best_iou = 0.5;
+    for (size_t i = 0; i < boxes.size(); i++) {
+        int intersection = (clipped & boxes[i]).area();
+        if (intersection == 0) {
+            continue;
+        }
+        double iou = static_cast<double>(intersection) / (clipped.area() + boxes[i].area() - intersection);
+        if (iou >= best_iou) {
+            best_iou = iou;
+            best_label = static_cast<int>(i) + 1;
+        }
+    }
+    return best_label;
+}
+
+} // namespace godot
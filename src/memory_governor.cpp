@@ -0,0 +1,148 @@
+#include "memory_governor.h"
+
+#include <opencv2/imgproc.hpp>
+#include <algorithm>
+
+namespace godot {
+
+// 检测模型的输入边长，缩小检测输入和代理图像的长边不低于此尺寸
+constexpr int DETECTOR_INPUT_SIZE = 640;
+
+MemoryGovernor::MemoryGovernor() : budget(0), current(0), peak(0) {
+}
+
+MemoryGovernor::~MemoryGovernor() {
+}
+
+void MemoryGovernor::set_budget(size_t bytes) {
+    budget = bytes;
+}
+
+size_t MemoryGovernor::get_budget() const {
+    return budget;
+}
+
+int MemoryGovernor::get_detection_reduce_factor(int width, int height) {
+    return std::max(1, std::max(width, height) / DETECTOR_INPUT_SIZE);
+}
+
+size_t MemoryGovernor::estimate_peak(const MemoryPlanInput& input, MemoryStrategy strategy, int scale) {
+    if (strategy != MEMORY_STRATEGY_PROXY) {
+        scale = 1;
+    }
+    size_t width = static_cast<size_t>(std::max(1, input.width / scale));
+    size_t height = static_cast<size_t>(std::max(1, input.height / scale));
+    size_t pixels = width * height;
+
+    size_t working = pixels * input.channels;                       // 工作缓冲区
+    size_t labels = pixels;                                         // 8位实例标签图
+    size_t decoded = input.compressed ? working : 0;                // 转换前的解码结果
+    size_t mipmaps = input.mipmaps ? working * 4 / 3 : 0;           // 生成mipmap时重新分配的输出
+
+    // 检测输入：全分辨率转换为RGB（灰度+透明需要额外的单通道），或由源布局缩小后转换
+    size_t full_detection = input.channels == 3 ? 0 : pixels * (input.channels == 2 ? 4 : 3);
+    int factor = get_detection_reduce_factor(static_cast<int>(width), static_cast<int>(height));
+    size_t reduced_pixels = (width / factor) * (height / factor);
+    size_t reduced_detection = reduced_pixels * (input.channels + 3);
+
+    // 各阶段同时存在的缓冲区：解码、检测、生成与输出
+    size_t decode_phase = decoded + working;
+    switch (strategy) {
+        case MEMORY_STRATEGY_STANDARD:
+            // 工作缓冲区、原图副本、标签图与输出副本同时存在
+            return std::max({ decode_phase, working + full_detection, working * 3 + labels + mipmaps });
+        case MEMORY_STRATEGY_IN_PLACE:
+            return std::max({ decode_phase, working + full_detection, working + labels + mipmaps });
+        case MEMORY_STRATEGY_REDUCED_DETECTION:
+        case MEMORY_STRATEGY_PROXY:
+            return std::max({ decode_phase, working + reduced_detection, working + labels + mipmaps });
+        default:
+            return 0;
+    }
+}
+
+MemoryPlan MemoryGovernor::plan(const MemoryPlanInput& input) const {
+    MemoryPlan result = { MEMORY_STRATEGY_STANDARD, 1, estimate_peak(input, MEMORY_STRATEGY_STANDARD) };
+    if (budget == 0 || result.estimated_peak <= budget) {
+        return result;
+    }
+
+    // 依次尝试占用更低的全分辨率策略
+    const MemoryStrategy full_resolution[] = { MEMORY_STRATEGY_IN_PLACE, MEMORY_STRATEGY_REDUCED_DETECTION };
+    for (MemoryStrategy strategy : full_resolution) {
+        size_t estimate = estimate_peak(input, strategy);
+        result.estimated_peak = std::min(result.estimated_peak, estimate);
+        if (estimate <= budget) {
+            result.strategy = strategy;
+            return result;
+        }
+    }
+
+    // 代理图像：取满足预算的最小缩小倍数，长边不低于检测输入
+    int long_side = std::max(input.width, input.height);
+    bool proxy_allowed = !input.compressed || input.reduced_decode;
+    for (int scale = 2; proxy_allowed && long_side / scale >= DETECTOR_INPUT_SIZE; scale++) {
+        if (input.reduced_decode && scale != 2 && scale != 4 && scale != 8) {
+            continue;
+        }
+        size_t estimate = estimate_peak(input, MEMORY_STRATEGY_PROXY, scale);
+        result.estimated_peak = std::min(result.estimated_peak, estimate);
+        if (estimate <= budget) {
+            result.strategy = MEMORY_STRATEGY_PROXY;
+            result.scale = scale;
+            return result;
+        }
+    }
+
+    result.strategy = MEMORY_STRATEGY_REJECT;
+    return result;
+}
+
+void MemoryGovernor::downscale(const cv::Mat& src, int factor, cv::Mat& dst) {
+    // 整数倍INTER_AREA直接按块求平均，不分配全分辨率的中间缓冲区
+    cv::Size size(std::max(1, src.cols / factor), std::max(1, src.rows / factor));
+    if (factor <= 1) {
+        src.copyTo(dst);
+        return;
+    }
+    cv::resize(src(cv::Rect(0, 0, std::min(src.cols, size.width * factor), std::min(src.rows, size.height * factor))),
+               dst, size, 0, 0, cv::INTER_AREA);
+}
+
+const char* MemoryGovernor::get_strategy_name(MemoryStrategy strategy) {
+    switch (strategy) {
+        case MEMORY_STRATEGY_STANDARD: return "standard";
+        case MEMORY_STRATEGY_IN_PLACE: return "in_place";
+        case MEMORY_STRATEGY_REDUCED_DETECTION: return "reduced_detection";
+        case MEMORY_STRATEGY_PROXY: return "proxy";
+        default: return "reject";
+    }
+}
+
+void MemoryGovernor::begin_call() {
+    current = 0;
+    peak = 0;
+}
+
+void MemoryGovernor::acquire(size_t bytes) {
+    current += bytes;
+    peak = std::max(peak, current);
+}
+
+void MemoryGovernor::release(size_t bytes) {
+    current -= std::min(bytes, current);
+}
+
+size_t MemoryGovernor::get_accounted() const {
+    return current;
+}
+
+size_t MemoryGovernor::get_accounted_peak() const {
+    return peak;
+}
+
+size_t MemoryGovernor::mat_bytes(const cv::Mat& mat) {
+    return mat.total() * mat.elemSize();
+}
+
+} // namespace godot
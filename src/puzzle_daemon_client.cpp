@@ -0,0 +1,208 @@
+#include "puzzle_daemon_client.h"
+#include "daemon_protocol.h"
+#include "diff_detector.h"
+#include "diff_generator.h"
+
+#include <godot_cpp/classes/json.hpp>
+#include <godot_cpp/core/class_db.hpp>
+#include <godot_cpp/variant/utility_functions.hpp>
+
+#include <algorithm>
+#include <cstring>
+
+namespace godot {
+
+PuzzleDaemonClient::PuzzleDaemonClient() : socket_fd(-1), next_request_id(1) {
+    replay_generator = std::make_unique<DiffGenerator>();
+}
+
+PuzzleDaemonClient::~PuzzleDaemonClient() {
+    disconnect_from_daemon();
+}
+
+bool PuzzleDaemonClient::connect_to_daemon(const String& socket_path) {
+    disconnect_from_daemon();
+    socket_fd = daemon_connect(socket_path.utf8().get_data());
+    if (socket_fd < 0) {
+        UtilityFunctions::print_error("Failed to connect to puzzle daemon: ", socket_path);
+        return false;
+    }
+    return true;
+}
+
+void PuzzleDaemonClient::disconnect_from_daemon() {
+    daemon_close(socket_fd);
+    socket_fd = -1;
+}
+
+bool PuzzleDaemonClient::is_connected_to_daemon() const {
+    return socket_fd >= 0;
+}
+
+bool PuzzleDaemonClient::send_request(uint32_t type, const std::vector<uint8_t>& payload, std::vector<uint8_t>& response) {
+    if (socket_fd < 0) {
+        UtilityFunctions::print_error("Not connected to puzzle daemon");
+        return false;
+    }
+
+    uint32_t request_id = next_request_id++;
+    DaemonMessageHeader header;
+    // 守护进程满载时发送BUSY后即关闭连接，写入可能因此失败，仍读取已到达的BUSY消息
+    bool sent = daemon_write_message(socket_fd, type, request_id, payload.data(), payload.size());
+    bool received = daemon_read_message(socket_fd, header, response);
+    if (received && header.type == DAEMON_MESSAGE_BUSY) {
+        UtilityFunctions::print_error("Puzzle daemon busy: ",
+            String::utf8(reinterpret_cast<const char*>(response.data()), static_cast<int>(response.size())));
+        disconnect_from_daemon();
+        return false;
+    }
+    if (!sent || !received || header.request_id != request_id) {
+        UtilityFunctions::print_error("Puzzle daemon connection lost");
+        disconnect_from_daemon();
+        return false;
+    }
+
+    if (header.type == DAEMON_MESSAGE_ERROR) {
+        UtilityFunctions::print_error("Puzzle daemon error: ",
+            String::utf8(reinterpret_cast<const char*>(response.data()), static_cast<int>(response.size())));
+        return false;
+    }
+    if (header.type != type && !(type == DAEMON_MESSAGE_GENERATE && header.type == DAEMON_MESSAGE_PUZZLE)) {
+        UtilityFunctions::print_error("Unexpected puzzle daemon response: ", header.type);
+        return false;
+    }
+    return true;
+}
+
+Dictionary PuzzleDaemonClient::generate(const PackedByteArray& buffer, int count, int diff, const Dictionary& options) {
+    Dictionary result;
+    if (buffer.is_empty()) {
+        UtilityFunctions::print_error("Image buffer is empty");
+        return result;
+    }
+
+    String mode = options.get("mode", "recipe");
+    DaemonGenerateRequest request;
+    memset(&request, 0, sizeof(request));
+    request.diff_count = static_cast<uint32_t>(std::max(5, std::min(10, count)));
+    request.difficulty = static_cast<uint32_t>(std::max(1, std::min(10, diff)));
+    request.result_mode = mode == "patches" ? DAEMON_RESULT_PATCHES : DAEMON_RESULT_RECIPE;
+    request.time_budget_ms = static_cast<float>(double(options.get("time_budget_ms", 0.0)));
+    if (options.has("seed")) {
+        request.flags |= DAEMON_REQUEST_SEED;
+        request.seed = static_cast<uint32_t>(int64_t(options["seed"]));
+    }
+
+    std::vector<uint8_t> payload(sizeof(request) + buffer.size());
+    memcpy(payload.data(), &request, sizeof(request));
+    memcpy(payload.data() + sizeof(request), buffer.ptr(), buffer.size());
+
+    std::vector<uint8_t> response;
+    DaemonPuzzle puzzle;
+    if (!send_request(DAEMON_MESSAGE_GENERATE, payload, response)) {
+        return result;
+    }
+    if (!decode_daemon_puzzle(response, puzzle)) {
+        UtilityFunctions::print_error("Malformed puzzle daemon response");
+        return result;
+    }
+
+    const DaemonPuzzleHeader& header = puzzle.header;
+    Image::Format format = DiffDetector::get_channels_format(static_cast<int>(header.channels));
+    Array diffs;
+    Array patches;
+    for (size_t i = 0; i < puzzle.diffs.size(); i++) {
+        const DiffInfo& info = puzzle.diffs[i];
+        Dictionary diff_dict = DiffDetector::create_diff_dictionary(info);
+        diff_dict["seed"] = static_cast<int64_t>(info.seed);
+        diffs.push_back(diff_dict);
+
+        if (i < puzzle.patches.size()) {
+            const cv::Mat& patch = puzzle.patches[i];
+            Dictionary patch_dict;
+            patch_dict["region"] = Rect2i(info.region.x, info.region.y, info.region.width, info.region.height);
+            patch_dict["image"] = patch.empty() ? Ref<Image>()
+                : DiffDetector::create_output_image(patch, cv::Rect(0, 0, patch.cols, patch.rows), format);
+            patches.push_back(patch_dict);
+        }
+    }
+
+    result["level_id"] = static_cast<int64_t>(next_request_id - 1);
+    result["diffs"] = diffs;
+    result["patches"] = patches;
+    result["mode"] = header.result_mode == DAEMON_RESULT_PATCHES ? "patches" : "recipe";
+    result["width"] = header.width;
+    result["height"] = header.height;
+    result["format"] = format;
+    result["difficulty"] = header.difficulty;
+    result["detected"] = (header.flags & DAEMON_PUZZLE_DETECTED) != 0;
+    result["detection_cached"] = (header.flags & DAEMON_PUZZLE_DETECTION_CACHED) != 0;
+    result["decode_ms"] = header.decode_ms;
+    result["detect_ms"] = header.detect_ms;
+    result["generate_ms"] = header.generate_ms;
+    return result;
+}
+
+Ref<Image> PuzzleDaemonClient::apply_recipe(const Ref<Image>& source_image, const Dictionary& puzzle) {
+    if (source_image.is_null()) {
+        UtilityFunctions::print_error("Source image is null");
+        return source_image;
+    }
+
+    // 配方在守护进程解码后的像素布局上生成，源图像需与之一致
+    Image::Format format = source_image->get_format();
+    int channels = DiffDetector::get_format_channels(format);
+    if (channels == 0 || format != static_cast<Image::Format>(int(puzzle.get("format", format))) ||
+        source_image->get_width() != int(puzzle.get("width", source_image->get_width())) ||
+        source_image->get_height() != int(puzzle.get("height", source_image->get_height()))) {
+        UtilityFunctions::print_error("Source image does not match the puzzle (size or format)");
+        return Ref<Image>();
+    }
+
+    PackedByteArray image_data = source_image->get_data();
+    cv::Mat working = cv::Mat(source_image->get_height(), source_image->get_width(), CV_8UC(channels),
+                              const_cast<uint8_t*>(image_data.ptr())).clone();
+
+    int difficulty = puzzle.get("difficulty", 5);
+    Array diffs = puzzle.get("diffs", Array());
+    for (int i = 0; i < diffs.size(); i++) {
+        Dictionary diff_dict = diffs[i];
+        Rect2i region = diff_dict["region"];
+        DiffInfo info;
+        info.region = cv::Rect(region.position.x, region.position.y, region.size.x, region.size.y);
+        info.position = cv::Point(info.region.x + info.region.width / 2, info.region.y + info.region.height / 2);
+        info.size = info.region.size();
+        info.algorithm_id = diff_dict["algorithm_id"];
+        info.perceptual_score = diff_dict.get("perceptual_score", 0.0);
+        info.intensity_scale = diff_dict.get("intensity_scale", 1.0);
+        info.seed = static_cast<uint32_t>(int64_t(diff_dict.get("seed", 0)));
+        if (!replay_generator->reapply_diff(working, info, difficulty)) {
+            UtilityFunctions::print_error("Failed to replay diff ", i);
+            return Ref<Image>();
+        }
+    }
+
+    return DiffDetector::create_output_image(working, cv::Rect(0, 0, working.cols, working.rows), format);
+}
+
+Dictionary PuzzleDaemonClient::get_daemon_stats() {
+    std::vector<uint8_t> response;
+    if (!send_request(DAEMON_MESSAGE_STATS, std::vector<uint8_t>(), response)) {
+        return Dictionary();
+    }
+    String json = String::utf8(reinterpret_cast<const char*>(response.data()), static_cast<int>(response.size()));
+    return JSON::parse_string(json);
+}
+
+void PuzzleDaemonClient::_bind_methods() {
+    ClassDB::bind_method(D_METHOD("connect_to_daemon", "socket_path"), &PuzzleDaemonClient::connect_to_daemon,
+                         DEFVAL(String(DAEMON_DEFAULT_SOCKET)));
+    ClassDB::bind_method(D_METHOD("disconnect_from_daemon"), &PuzzleDaemonClient::disconnect_from_daemon);
+    ClassDB::bind_method(D_METHOD("is_connected_to_daemon"), &PuzzleDaemonClient::is_connected_to_daemon);
+    ClassDB::bind_method(D_METHOD("generate", "buffer", "diff_count", "difficulty", "options"), &PuzzleDaemonClient::generate,
+                         DEFVAL(Dictionary()));
+    ClassDB::bind_method(D_METHOD("apply_recipe", "source_image", "puzzle"), &PuzzleDaemonClient::apply_recipe);
+    ClassDB::bind_method(D_METHOD("get_daemon_stats"), &PuzzleDaemonClient::get_daemon_stats);
+}
+
+} // namespace godot
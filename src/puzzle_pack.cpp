@@ -0,0 +1,526 @@
+#include "puzzle_pack.h"
+
+#include <opencv2/imgcodecs.hpp>
+#include <algorithm>
+#include <cstring>
+
+#if defined(WIN32) || defined(_WIN32)
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace godot {
+
+constexpr uint64_t PACK_ALIGNMENT = 16;
+
+static_assert(sizeof(PackHeader) == 72, "PackHeader layout changed");
+static_assert(sizeof(PackPuzzleEntry) == 64, "PackPuzzleEntry layout changed");
+static_assert(sizeof(PackDiffRecord) == 80, "PackDiffRecord layout changed");
+
+// ---------------------------------------------------------------------------
+// 写入
+
+PuzzlePackWriter::PuzzlePackWriter() : file(nullptr), offset(0) {
+}
+
+PuzzlePackWriter::~PuzzlePackWriter() {
+    if (file) {
+        fclose(file);
+    }
+}
+
+bool PuzzlePackWriter::encode_puzzle(const std::string& name, const cv::Mat& original, const cv::Mat& modified,
+                                     const std::vector<DiffInfo>& diffs, std::vector<uint8_t> original_file,
+                                     const std::string& source, bool compress_patches, EncodedPuzzle& puzzle) {
+    if (original.empty() || original.depth() != CV_8U || original.channels() > 4 ||
+        original.size() != modified.size() || original.type() != modified.type()) {
+        return false;
+    }
+
+    puzzle.name = name;
+    puzzle.width = original.cols;
+    puzzle.height = original.rows;
+    puzzle.channels = original.channels();
+    puzzle.original_mode = original_file.empty() ? PACK_ORIGINAL_REFERENCE : PACK_ORIGINAL_EMBEDDED;
+    puzzle.source = source;
+    puzzle.original_data = std::move(original_file);
+    puzzle.diffs.clear();
+    puzzle.patches.clear();
+    puzzle.patch_encodings.clear();
+    puzzle.masks.clear();
+
+    // OpenCV的PNG编码不支持双通道，LA8补丁存原始像素
+    bool use_png = compress_patches && puzzle.channels != 2;
+    const cv::Rect image_rect(0, 0, original.cols, original.rows);
+
+    for (const DiffInfo& diff : diffs) {
+        // 完全落在图像外的差异没有可保存的像素，validate()也不接受空区域，不写入
+        cv::Rect region = diff.region & image_rect;
+        if (region.area() <= 0) {
+            continue;
+        }
+        puzzle.diffs.push_back(diff);
+        puzzle.diffs.back().region = region;
+
+        cv::Mat patch = modified(region);
+        cv::Mat before = original(region);
+
+        // 补丁：PNG按字节无损保存，读取时不做通道交换即可还原源布局
+        puzzle.patches.emplace_back();
+        std::vector<uint8_t>& patch_data = puzzle.patches.back();
+        if (use_png) {
+            cv::imencode(".png", patch, patch_data);
+            puzzle.patch_encodings.push_back(PACK_ENCODING_PNG);
+        } else {
+            size_t row_bytes = region.width * patch.elemSize();
+            patch_data.resize(row_bytes * region.height);
+            for (int y = 0; y < region.height; y++) {
+                memcpy(patch_data.data() + y * row_bytes, patch.ptr(y), row_bytes);
+            }
+            puzzle.patch_encodings.push_back(PACK_ENCODING_RAW);
+        }
+
+        // 掩码：任一通道不同即视为改变
+        size_t mask_row_bytes = (region.width + 7) / 8;
+        puzzle.masks.emplace_back();
+        std::vector<uint8_t>& mask = puzzle.masks.back();
+        mask.assign(mask_row_bytes * region.height, 0);
+        size_t pixel_bytes = patch.elemSize();
+        for (int y = 0; y < region.height; y++) {
+            const uint8_t* a = before.ptr<uint8_t>(y);
+            const uint8_t* b = patch.ptr<uint8_t>(y);
+            uint8_t* bits = mask.data() + y * mask_row_bytes;
+            for (int x = 0; x < region.width; x++) {
+                if (memcmp(a + x * pixel_bytes, b + x * pixel_bytes, pixel_bytes) != 0) {
+                    bits[x >> 3] |= static_cast<uint8_t>(0x80 >> (x & 7));
+                }
+            }
+        }
+    }
+
+    return true;
+}
+
+bool PuzzlePackWriter::open(const std::string& path) {
+    file = fopen(path.c_str(), "wb");
+    if (!file) {
+        return false;
+    }
+
+    // 头部在finish时回填
+    PackHeader placeholder = {};
+    offset = 0;
+    entries.clear();
+    return write_bytes(&placeholder, sizeof(placeholder)) && align();
+}
+
+bool PuzzlePackWriter::add_puzzle(const EncodedPuzzle& puzzle) {
+    if (!file) {
+        return false;
+    }
+
+    PendingEntry pending;
+    pending.name = puzzle.name;
+    pending.entry = {};
+    pending.entry.width = puzzle.width;
+    pending.entry.height = puzzle.height;
+    pending.entry.channels = puzzle.channels;
+    pending.entry.original_mode = puzzle.original_mode;
+    pending.entry.diff_count = static_cast<uint32_t>(puzzle.diffs.size());
+
+    if (puzzle.original_mode == PACK_ORIGINAL_EMBEDDED &&
+        !write_blob(puzzle.original_data, PACK_ENCODING_FILE, pending.entry.original)) {
+        return false;
+    }
+
+    for (size_t i = 0; i < puzzle.diffs.size(); i++) {
+        const DiffInfo& diff = puzzle.diffs[i];
+        PackDiffRecord record = {};
+        record.region[0] = diff.region.x;
+        record.region[1] = diff.region.y;
+        record.region[2] = diff.region.width;
+        record.region[3] = diff.region.height;
+        record.algorithm_id = diff.algorithm_id;
+        record.perceptual_score = diff.perceptual_score;
+        record.intensity_scale = diff.intensity_scale;
+        record.seed = diff.seed;
+
+        if (puzzle.patch_encodings[i] != PACK_ENCODING_NONE &&
+            (!write_blob(puzzle.patches[i], puzzle.patch_encodings[i], record.patch) ||
+             !write_blob(puzzle.masks[i], PACK_ENCODING_BITS, record.mask))) {
+            return false;
+        }
+        pending.diffs.push_back(record);
+    }
+
+    // 名称与源路径在finish时写入字符串表
+    pending.source = puzzle.source;
+    entries.push_back(std::move(pending));
+    return true;
+}
+
+bool PuzzlePackWriter::finish() {
+    if (!file) {
+        return false;
+    }
+
+    // 索引按名称排序，读取时可二分查找，且与写入顺序（线程完成顺序）无关
+    std::vector<size_t> order(entries.size());
+    for (size_t i = 0; i < order.size(); i++) {
+        order[i] = i;
+    }
+    std::sort(order.begin(), order.end(), [this](size_t a, size_t b) {
+        return entries[a].name < entries[b].name;
+    });
+
+    // 字符串表：名称与源路径
+    std::string strings;
+    std::vector<PackPuzzleEntry> index;
+    std::vector<PackDiffRecord> diffs;
+    for (size_t i : order) {
+        PackPuzzleEntry entry = entries[i].entry;
+        entry.name_offset = static_cast<uint32_t>(strings.size());
+        entry.name_length = static_cast<uint32_t>(entries[i].name.size());
+        strings += entries[i].name;
+        entry.source_offset = static_cast<uint32_t>(strings.size());
+        entry.source_length = static_cast<uint32_t>(entries[i].source.size());
+        strings += entries[i].source;
+        entry.first_diff = static_cast<uint32_t>(diffs.size());
+        diffs.insert(diffs.end(), entries[i].diffs.begin(), entries[i].diffs.end());
+        index.push_back(entry);
+    }
+
+    PackHeader header = {};
+    memcpy(header.magic, PUZZLE_PACK_MAGIC, sizeof(header.magic));
+    header.version = PUZZLE_PACK_VERSION;
+    header.puzzle_count = static_cast<uint32_t>(index.size());
+    header.diff_record_count = static_cast<uint32_t>(diffs.size());
+
+    bool ok = true;
+    header.index_offset = offset;
+    ok = ok && write_bytes(index.data(), index.size() * sizeof(PackPuzzleEntry)) && align();
+    header.diffs_offset = offset;
+    ok = ok && write_bytes(diffs.data(), diffs.size() * sizeof(PackDiffRecord)) && align();
+    header.strings_offset = offset;
+    header.strings_size = strings.size();
+    ok = ok && write_bytes(strings.data(), strings.size());
+    header.file_size = offset;
+
+    ok = ok && fseek(file, 0, SEEK_SET) == 0 && fwrite(&header, sizeof(header), 1, file) == 1;
+    ok = fclose(file) == 0 && ok;
+    file = nullptr;
+    entries.clear();
+    return ok;
+}
+
+bool PuzzlePackWriter::write_blob(const std::vector<uint8_t>& data, uint32_t encoding, PackBlob& blob) {
+    blob.offset = offset;
+    blob.size = data.size();
+    blob.encoding = encoding;
+    blob.reserved = 0;
+    return write_bytes(data.data(), data.size()) && align();
+}
+
+bool PuzzlePackWriter::write_bytes(const void* data, size_t size) {
+    if (size > 0 && fwrite(data, 1, size, file) != size) {
+        return false;
+    }
+    offset += size;
+    return true;
+}
+
+bool PuzzlePackWriter::align() {
+    static const uint8_t padding[PACK_ALIGNMENT] = {};
+    size_t remainder = offset % PACK_ALIGNMENT;
+    return remainder == 0 || write_bytes(padding, PACK_ALIGNMENT - remainder);
+}
+
+// ---------------------------------------------------------------------------
+// 读取
+
+PuzzlePack::PuzzlePack() : data(nullptr), size(0), mapping(nullptr), mapped_data(nullptr) {
+}
+
+PuzzlePack::~PuzzlePack() {
+    close();
+}
+
+bool PuzzlePack::open(const std::string& path) {
+    close();
+
+#if defined(WIN32) || defined(_WIN32)
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                              FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+    LARGE_INTEGER file_size;
+    if (!GetFileSizeEx(file, &file_size) || file_size.QuadPart == 0) {
+        CloseHandle(file);
+        return false;
+    }
+    HANDLE handle = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    CloseHandle(file);
+    if (!handle) {
+        return false;
+    }
+    void* view = MapViewOfFile(handle, FILE_MAP_READ, 0, 0, 0);
+    if (!view) {
+        CloseHandle(handle);
+        return false;
+    }
+    mapping = handle;
+    mapped_data = view;
+    size = static_cast<size_t>(file_size.QuadPart);
+#else
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size == 0) {
+        ::close(fd);
+        return false;
+    }
+    void* view = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (view == MAP_FAILED) {
+        return false;
+    }
+    mapped_data = view;
+    size = static_cast<size_t>(info.st_size);
+#endif
+
+    data = static_cast<const uint8_t*>(mapped_data);
+    if (!validate()) {
+        close();
+        return false;
+    }
+    return true;
+}
+
+bool PuzzlePack::open_memory(std::vector<uint8_t>&& bytes) {
+    close();
+    owned = std::move(bytes);
+    data = owned.data();
+    size = owned.size();
+    if (!validate()) {
+        close();
+        return false;
+    }
+    return true;
+}
+
+void PuzzlePack::close() {
+    if (mapped_data) {
+#if defined(WIN32) || defined(_WIN32)
+        UnmapViewOfFile(mapped_data);
+        CloseHandle(static_cast<HANDLE>(mapping));
+#else
+        munmap(mapped_data, size);
+#endif
+    }
+    mapped_data = nullptr;
+    mapping = nullptr;
+    owned.clear();
+    owned.shrink_to_fit();
+    data = nullptr;
+    size = 0;
+}
+
+bool PuzzlePack::is_open() const {
+    return data != nullptr;
+}
+
+const PackHeader* PuzzlePack::header() const {
+    return reinterpret_cast<const PackHeader*>(data);
+}
+
+bool PuzzlePack::blob_in_range(const PackBlob& blob) const {
+    return blob.offset <= size && blob.size <= size - blob.offset;
+}
+
+bool PuzzlePack::validate() {
+    if (!data || size < sizeof(PackHeader)) {
+        return false;
+    }
+
+    const PackHeader* h = header();
+    if (memcmp(h->magic, PUZZLE_PACK_MAGIC, sizeof(h->magic)) != 0 ||
+        h->version != PUZZLE_PACK_VERSION || h->file_size != size) {
+        return false;
+    }
+
+    // 表的位置与大小
+    auto table_in_range = [this](uint64_t table_offset, uint64_t count, uint64_t element_size) {
+        return table_offset <= size && count <= (size - table_offset) / element_size;
+    };
+    if (!table_in_range(h->index_offset, h->puzzle_count, sizeof(PackPuzzleEntry)) ||
+        !table_in_range(h->diffs_offset, h->diff_record_count, sizeof(PackDiffRecord)) ||
+        h->strings_offset > size || h->strings_size > size - h->strings_offset) {
+        return false;
+    }
+
+    // 索引中的引用，打开时一次性校验，之后的访问无需再检查
+    const PackPuzzleEntry* entries = reinterpret_cast<const PackPuzzleEntry*>(data + h->index_offset);
+    const PackDiffRecord* records = reinterpret_cast<const PackDiffRecord*>(data + h->diffs_offset);
+    for (uint32_t i = 0; i < h->puzzle_count; i++) {
+        const PackPuzzleEntry& entry = entries[i];
+        if (entry.name_length > h->strings_size || entry.name_offset > h->strings_size - entry.name_length ||
+            entry.source_length > h->strings_size || entry.source_offset > h->strings_size - entry.source_length ||
+            entry.first_diff > h->diff_record_count || entry.diff_count > h->diff_record_count - entry.first_diff ||
+            entry.channels < 1 || entry.channels > 4 || !blob_in_range(entry.original)) {
+            return false;
+        }
+
+        for (uint32_t d = 0; d < entry.diff_count; d++) {
+            const PackDiffRecord& record = records[entry.first_diff + d];
+            const int32_t* r = record.region;
+            if (r[0] < 0 || r[1] < 0 || r[2] < 0 || r[3] < 0 ||
+                static_cast<uint64_t>(r[0]) + r[2] > entry.width || static_cast<uint64_t>(r[1]) + r[3] > entry.height ||
+                !blob_in_range(record.patch) || !blob_in_range(record.mask)) {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+int PuzzlePack::get_puzzle_count() const {
+    return is_open() ? static_cast<int>(header()->puzzle_count) : 0;
+}
+
+const PackPuzzleEntry* PuzzlePack::get_entry(int index) const {
+    if (index < 0 || index >= get_puzzle_count()) {
+        return nullptr;
+    }
+    return reinterpret_cast<const PackPuzzleEntry*>(data + header()->index_offset) + index;
+}
+
+std::string PuzzlePack::get_name(int index) const {
+    const PackPuzzleEntry* entry = get_entry(index);
+    if (!entry) {
+        return std::string();
+    }
+    const char* strings = reinterpret_cast<const char*>(data + header()->strings_offset);
+    return std::string(strings + entry->name_offset, entry->name_length);
+}
+
+std::string PuzzlePack::get_source(int index) const {
+    const PackPuzzleEntry* entry = get_entry(index);
+    if (!entry) {
+        return std::string();
+    }
+    const char* strings = reinterpret_cast<const char*>(data + header()->strings_offset);
+    return std::string(strings + entry->source_offset, entry->source_length);
+}
+
+int PuzzlePack::find_puzzle(const std::string& name) const {
+    int low = 0;
+    int high = get_puzzle_count() - 1;
+    const char* strings = is_open() ? reinterpret_cast<const char*>(data + header()->strings_offset) : nullptr;
+
+    while (low <= high) {
+        int middle = (low + high) / 2;
+        const PackPuzzleEntry* entry = get_entry(middle);
+        int order = name.compare(0, std::string::npos, strings + entry->name_offset, entry->name_length);
+        if (order == 0) {
+            return middle;
+        }
+        if (order < 0) {
+            high = middle - 1;
+        } else {
+            low = middle + 1;
+        }
+    }
+    return -1;
+}
+
+const PackDiffRecord* PuzzlePack::get_diffs(int index) const {
+    const PackPuzzleEntry* entry = get_entry(index);
+    if (!entry) {
+        return nullptr;
+    }
+    return reinterpret_cast<const PackDiffRecord*>(data + header()->diffs_offset) + entry->first_diff;
+}
+
+const PackDiffRecord* PuzzlePack::get_diff_record(int index, int diff_index) const {
+    const PackPuzzleEntry* entry = get_entry(index);
+    if (!entry || diff_index < 0 || diff_index >= static_cast<int>(entry->diff_count)) {
+        return nullptr;
+    }
+    return get_diffs(index) + diff_index;
+}
+
+bool PuzzlePack::get_original_file(int index, const uint8_t*& file_data, size_t& file_size) const {
+    const PackPuzzleEntry* entry = get_entry(index);
+    if (!entry || entry->original_mode != PACK_ORIGINAL_EMBEDDED || entry->original.encoding != PACK_ENCODING_FILE) {
+        return false;
+    }
+    file_data = data + entry->original.offset;
+    file_size = static_cast<size_t>(entry->original.size);
+    return true;
+}
+
+bool PuzzlePack::decode_patch(int index, int diff_index, cv::Mat& patch) const {
+    const PackPuzzleEntry* entry = get_entry(index);
+    const PackDiffRecord* record = get_diff_record(index, diff_index);
+    if (!record) {
+        return false;
+    }
+
+    int width = record->region[2];
+    int height = record->region[3];
+    int type = CV_8UC(entry->channels);
+    const uint8_t* blob = data + record->patch.offset;
+
+    switch (record->patch.encoding) {
+        case PACK_ENCODING_RAW: {
+            if (record->patch.size != static_cast<uint64_t>(width) * height * entry->channels) {
+                return false;
+            }
+            // 复制一份，避免调用方修改映射内存
+            cv::Mat(height, width, type, const_cast<uint8_t*>(blob)).copyTo(patch);
+            return true;
+        }
+        case PACK_ENCODING_PNG: {
+            cv::Mat encoded(1, static_cast<int>(record->patch.size), CV_8UC1, const_cast<uint8_t*>(blob));
+            patch = cv::imdecode(encoded, cv::IMREAD_UNCHANGED);
+            return !patch.empty() && patch.cols == width && patch.rows == height && patch.type() == type;
+        }
+        default:
+            return false;
+    }
+}
+
+bool PuzzlePack::decode_mask(int index, int diff_index, cv::Mat& mask) const {
+    const PackDiffRecord* record = get_diff_record(index, diff_index);
+    if (!record || record->mask.encoding != PACK_ENCODING_BITS) {
+        return false;
+    }
+
+    int width = record->region[2];
+    int height = record->region[3];
+    size_t row_bytes = (width + 7) / 8;
+    if (record->mask.size != row_bytes * height) {
+        return false;
+    }
+
+    const uint8_t* bits = data + record->mask.offset;
+    mask.create(height, width, CV_8UC1);
+    for (int y = 0; y < height; y++) {
+        const uint8_t* row_bits = bits + y * row_bytes;
+        uint8_t* row = mask.ptr<uint8_t>(y);
+        for (int x = 0; x < width; x++) {
+            row[x] = (row_bits[x >> 3] & (0x80 >> (x & 7))) ? 255 : 0;
+        }
+    }
+    return true;
+}
+
+} // namespace godot
@@ -0,0 +1,218 @@
+#include "puzzle_pack_loader.h"
+#include "puzzle_pack.h"
+#include "diff_detector.h"
+
+#include <godot_cpp/classes/file_access.hpp>
+#include <godot_cpp/classes/project_settings.hpp>
+#include <godot_cpp/core/class_db.hpp>
+#include <godot_cpp/variant/utility_functions.hpp>
+
+#include <cstring>
+
+namespace godot {
+
+// 将包内的差异记录转换为DiffInfo
+static DiffInfo record_to_diff_info(const PackDiffRecord& record) {
+    DiffInfo info;
+    info.region = cv::Rect(record.region[0], record.region[1], record.region[2], record.region[3]);
+    info.position = cv::Point(info.region.x + info.region.width / 2, info.region.y + info.region.height / 2);
+    info.size = info.region.size();
+    info.algorithm_id = record.algorithm_id;
+    info.perceptual_score = record.perceptual_score;
+    info.intensity_scale = record.intensity_scale;
+    info.seed = record.seed;
+    return info;
+}
+
+PuzzlePackLoader::PuzzlePackLoader() {
+    pack = std::make_unique<PuzzlePack>();
+}
+
+PuzzlePackLoader::~PuzzlePackLoader() {
+    // 析构时自动解除映射
+}
+
+bool PuzzlePackLoader::open(const String& path) {
+    close();
+    pack_directory = path.get_base_dir();
+
+    // 能转换为本地路径时直接映射（编辑器、桌面导出和user://）
+    String global_path = ProjectSettings::get_singleton()->globalize_path(path);
+    if (!global_path.is_empty() && pack->open(global_path.utf8().get_data())) {
+        return true;
+    }
+
+    // 位于APK或PCK内的文件无法映射，整体读入内存
+    Ref<FileAccess> file = FileAccess::open(path, FileAccess::READ);
+    if (file.is_null()) {
+        UtilityFunctions::print_error("Cannot open puzzle pack: ", path);
+        return false;
+    }
+    PackedByteArray bytes = file->get_buffer(file->get_length());
+    std::vector<uint8_t> data(bytes.size());
+    if (bytes.size() > 0) {
+        memcpy(data.data(), bytes.ptr(), bytes.size());
+    }
+    if (!pack->open_memory(std::move(data))) {
+        UtilityFunctions::print_error("Invalid or unsupported puzzle pack: ", path);
+        return false;
+    }
+    return true;
+}
+
+void PuzzlePackLoader::close() {
+    pack->close();
+    pack_directory = String();
+}
+
+bool PuzzlePackLoader::is_open() const {
+    return pack->is_open();
+}
+
+int PuzzlePackLoader::get_puzzle_count() const {
+    return pack->get_puzzle_count();
+}
+
+PackedStringArray PuzzlePackLoader::get_puzzle_names() const {
+    PackedStringArray names;
+    int count = pack->get_puzzle_count();
+    names.resize(count);
+    for (int i = 0; i < count; i++) {
+        names.set(i, String::utf8(pack->get_name(i).c_str()));
+    }
+    return names;
+}
+
+int PuzzlePackLoader::find_puzzle(const String& name) const {
+    return pack->find_puzzle(name.utf8().get_data());
+}
+
+Dictionary PuzzlePackLoader::get_puzzle_info(int index) const {
+    Dictionary info;
+    const PackPuzzleEntry* entry = pack->get_entry(index);
+    if (!entry) {
+        return info;
+    }
+
+    Array diffs;
+    const PackDiffRecord* records = pack->get_diffs(index);
+    for (uint32_t i = 0; i < entry->diff_count; i++) {
+        diffs.push_back(DiffDetector::create_diff_dictionary(record_to_diff_info(records[i])));
+    }
+
+    info["name"] = String::utf8(pack->get_name(index).c_str());
+    info["width"] = static_cast<int64_t>(entry->width);
+    info["height"] = static_cast<int64_t>(entry->height);
+    info["format"] = DiffDetector::get_channels_format(entry->channels);
+    info["embedded"] = entry->original_mode == PACK_ORIGINAL_EMBEDDED;
+    info["source"] = String::utf8(pack->get_source(index).c_str());
+    info["diffs"] = diffs;
+    return info;
+}
+
+Ref<Image> PuzzlePackLoader::load_original(int index) const {
+    const PackPuzzleEntry* entry = pack->get_entry(index);
+    if (!entry) {
+        return Ref<Image>();
+    }
+
+    Ref<Image> image;
+    const uint8_t* data = nullptr;
+    size_t size = 0;
+    if (pack->get_original_file(index, data, size)) {
+        // 按文件头识别嵌入的格式
+        PackedByteArray buffer;
+        buffer.resize(size);
+        memcpy(buffer.ptrw(), data, size);
+
+        image.instantiate();
+        Error error = ERR_FILE_UNRECOGNIZED;
+        if (size >= 8 && data[0] == 0x89 && data[1] == 'P' && data[2] == 'N' && data[3] == 'G') {
+            error = image->load_png_from_buffer(buffer);
+        } else if (size >= 3 && data[0] == 0xFF && data[1] == 0xD8 && data[2] == 0xFF) {
+            error = image->load_jpg_from_buffer(buffer);
+        } else if (size >= 12 && memcmp(data, "RIFF", 4) == 0 && memcmp(data + 8, "WEBP", 4) == 0) {
+            error = image->load_webp_from_buffer(buffer);
+        } else if (size >= 2 && data[0] == 'B' && data[1] == 'M') {
+            error = image->load_bmp_from_buffer(buffer);
+        }
+        if (error != OK) {
+            UtilityFunctions::print_error("Cannot decode embedded original for puzzle ", index);
+            return Ref<Image>();
+        }
+    } else {
+        String source = pack_directory.path_join(String::utf8(pack->get_source(index).c_str())).simplify_path();
+        image = Image::load_from_file(source);
+        if (image.is_null()) {
+            UtilityFunctions::print_error("Cannot load referenced original: ", source);
+            return image;
+        }
+    }
+
+    // 补丁按生成时的像素布局保存，原图转换为相同格式以便直接贴补丁
+    Image::Format format = DiffDetector::get_channels_format(entry->channels);
+    if (image->get_format() != format) {
+        image->convert(format);
+    }
+    return image;
+}
+
+Ref<Image> PuzzlePackLoader::get_patch(int index, int diff_index) const {
+    cv::Mat patch;
+    if (!pack->decode_patch(index, diff_index, patch)) {
+        return Ref<Image>();
+    }
+    return DiffDetector::create_output_image(patch, cv::Rect(0, 0, patch.cols, patch.rows),
+                                             DiffDetector::get_channels_format(patch.channels()));
+}
+
+Ref<Image> PuzzlePackLoader::get_mask(int index, int diff_index) const {
+    cv::Mat mask;
+    if (!pack->decode_mask(index, diff_index, mask)) {
+        return Ref<Image>();
+    }
+    return DiffDetector::create_output_image(mask, cv::Rect(0, 0, mask.cols, mask.rows), Image::FORMAT_L8);
+}
+
+Dictionary PuzzlePackLoader::get_puzzle(int index) const {
+    Dictionary result;
+    const PackPuzzleEntry* entry = pack->get_entry(index);
+    if (!entry) {
+        return result;
+    }
+
+    Array diffs;
+    Array patches;
+    const PackDiffRecord* records = pack->get_diffs(index);
+    for (uint32_t i = 0; i < entry->diff_count; i++) {
+        DiffInfo info = record_to_diff_info(records[i]);
+        diffs.push_back(DiffDetector::create_diff_dictionary(info));
+
+        Dictionary patch_dict;
+        patch_dict["region"] = Rect2i(info.region.x, info.region.y, info.region.width, info.region.height);
+        patch_dict["image"] = get_patch(index, static_cast<int>(i));
+        patches.push_back(patch_dict);
+    }
+
+    result["level_id"] = index;
+    result["name"] = String::utf8(pack->get_name(index).c_str());
+    result["diffs"] = diffs;
+    result["patches"] = patches;
+    return result;
+}
+
+void PuzzlePackLoader::_bind_methods() {
+    ClassDB::bind_method(D_METHOD("open", "path"), &PuzzlePackLoader::open);
+    ClassDB::bind_method(D_METHOD("close"), &PuzzlePackLoader::close);
+    ClassDB::bind_method(D_METHOD("is_open"), &PuzzlePackLoader::is_open);
+    ClassDB::bind_method(D_METHOD("get_puzzle_count"), &PuzzlePackLoader::get_puzzle_count);
+    ClassDB::bind_method(D_METHOD("get_puzzle_names"), &PuzzlePackLoader::get_puzzle_names);
+    ClassDB::bind_method(D_METHOD("find_puzzle", "name"), &PuzzlePackLoader::find_puzzle);
+    ClassDB::bind_method(D_METHOD("get_puzzle_info", "index"), &PuzzlePackLoader::get_puzzle_info);
+    ClassDB::bind_method(D_METHOD("load_original", "index"), &PuzzlePackLoader::load_original);
+    ClassDB::bind_method(D_METHOD("get_patch", "index", "diff_index"), &PuzzlePackLoader::get_patch);
+    ClassDB::bind_method(D_METHOD("get_mask", "index", "diff_index"), &PuzzlePackLoader::get_mask);
+    ClassDB::bind_method(D_METHOD("get_puzzle", "index"), &PuzzlePackLoader::get_puzzle);
+}
+
+} // namespace godot
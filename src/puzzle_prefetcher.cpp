@@ -0,0 +1,255 @@
+#include "puzzle_prefetcher.h"
+#include "instance_label_map.h"
+
+#include <algorithm>
+
+#if defined(__ANDROID__) || defined(__linux__)
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#elif defined(__APPLE__)
+#include <pthread.h>
+#elif defined(WIN32)
+#include <windows.h>
+#endif
+
+namespace godot {
+
+// 默认内存预算：64MB
+constexpr size_t DEFAULT_PREFETCH_MEMORY_BUDGET = 64 * 1024 * 1024;
+
+size_t PrefetchedPuzzle::byte_size() const {
+    size_t size = sizeof(PrefetchedPuzzle) + diffs.size() * sizeof(DiffInfo);
+    for (const auto& patch : patches) {
+        size += patch.total() * patch.elemSize();
+    }
+    return size;
+}
+
+PuzzlePrefetcher::PuzzlePrefetcher(PrefetchDetectFunction detect)
+    : detect_function(std::move(detect)),
+      stopping(false),
+      memory_budget(DEFAULT_PREFETCH_MEMORY_BUDGET),
+      memory_usage(0)
+{
+}
+
+PuzzlePrefetcher::~PuzzlePrefetcher() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+        queue.clear();
+        for (auto& entry : running) {
+            entry.second->store(true);
+        }
+    }
+    queue_condition.notify_all();
+
+    for (auto& worker : workers) {
+        if (worker.joinable()) {
+            worker.join();
+        }
+    }
+}
+
+bool PuzzlePrefetcher::enqueue(int64_t level_id, const cv::Mat& image, int format,
+                               int diff_count, int difficulty, const DiffGeneratorConfig& config) {
+    if (image.empty()) {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+
+    if (ready.count(level_id) || running.count(level_id)) {
+        return false;
+    }
+    for (const auto& job : queue) {
+        if (job.level_id == level_id) {
+            return false;
+        }
+    }
+
+    PrefetchJob job;
+    job.level_id = level_id;
+    job.image = image;
+    job.format = format;
+    job.diff_count = diff_count;
+    job.difficulty = difficulty;
+    job.config = config;
+    job.cancelled = std::make_shared<std::atomic<bool>>(false);
+    queue.push_back(std::move(job));
+
+    ensure_workers();
+    queue_condition.notify_one();
+    return true;
+}
+
+bool PuzzlePrefetcher::take(int64_t level_id, PrefetchedPuzzle& puzzle) {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    auto it = ready.find(level_id);
+    if (it == ready.end()) {
+        return false;
+    }
+
+    memory_usage -= it->second.byte_size();
+    puzzle = std::move(it->second);
+    ready.erase(it);
+    return true;
+}
+
+bool PuzzlePrefetcher::is_ready(int64_t level_id) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return ready.count(level_id) > 0;
+}
+
+void PuzzlePrefetcher::cancel(int64_t level_id) {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    queue.erase(std::remove_if(queue.begin(), queue.end(),
+                               [level_id](const PrefetchJob& job) { return job.level_id == level_id; }),
+                queue.end());
+
+    auto it = running.find(level_id);
+    if (it != running.end()) {
+        it->second->store(true);
+    }
+}
+
+void PuzzlePrefetcher::cancel_all() {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    queue.clear();
+    for (auto& entry : running) {
+        entry.second->store(true);
+    }
+}
+
+void PuzzlePrefetcher::set_memory_budget(size_t bytes) {
+    std::lock_guard<std::mutex> lock(mutex);
+    memory_budget = bytes;
+
+    // 预算缩小时淘汰关卡ID最大的谜题
+    while (memory_usage > memory_budget && !ready.empty()) {
+        auto last = std::prev(ready.end());
+        memory_usage -= last->second.byte_size();
+        ready.erase(last);
+    }
+}
+
+size_t PuzzlePrefetcher::get_memory_budget() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return memory_budget;
+}
+
+size_t PuzzlePrefetcher::get_memory_usage() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return memory_usage;
+}
+
+int PuzzlePrefetcher::get_pending_count() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return static_cast<int>(queue.size() + running.size());
+}
+
+void PuzzlePrefetcher::ensure_workers() {
+    if (!workers.empty()) {
+        return;
+    }
+
+    // 预取只需少量线程，避免与游戏主循环争抢CPU
+    unsigned hardware_threads = std::thread::hardware_concurrency();
+    unsigned worker_count = std::max(1u, std::min(2u, hardware_threads > 1 ? hardware_threads - 1 : 1u));
+
+    for (unsigned i = 0; i < worker_count; i++) {
+        workers.emplace_back(&PuzzlePrefetcher::worker_loop, this);
+    }
+}
+
+void PuzzlePrefetcher::worker_loop() {
+    lower_thread_priority();
+
+    // 每个工作线程使用独立的生成器，避免共享随机数和开销模型状态；配置随任务应用
+    DiffGenerator generator;
+
+    while (true) {
+        PrefetchJob job;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            queue_condition.wait(lock, [this] { return stopping || !queue.empty(); });
+            if (stopping) {
+                return;
+            }
+
+            job = std::move(queue.front());
+            queue.pop_front();
+            running[job.level_id] = job.cancelled;
+        }
+
+        // 运行检测并生成差异
+        PrefetchedPuzzle puzzle;
+        puzzle.level_id = job.level_id;
+        puzzle.format = job.format;
+
+        DetectionSet detections;
+        bool success = !job.cancelled->load() && detect_function(job.image, detections);
+
+        if (success && !job.cancelled->load()) {
+            // 任务图像是入队时的私有副本，直接在其上生成
+            generator.apply_config(job.config);
+            InstanceLabelMap labels;
+            labels.build(job.image.size(), detections);
+            success = generator.generate_diffs(job.image, detections, job.diff_count, job.difficulty, puzzle.diffs,
+                                               0.0, &labels);
+
+            // 只保留差异区域的补丁
+            if (success) {
+                puzzle.patches.reserve(puzzle.diffs.size());
+                for (const auto& diff : puzzle.diffs) {
+                    puzzle.patches.push_back(job.image(diff.region).clone());
+                }
+            }
+        }
+
+        std::lock_guard<std::mutex> lock(mutex);
+        running.erase(job.level_id);
+        if (success && !job.cancelled->load() && !stopping) {
+            store_ready(std::move(puzzle));
+        }
+    }
+}
+
+void PuzzlePrefetcher::store_ready(PrefetchedPuzzle&& puzzle) {
+    size_t size = puzzle.byte_size();
+
+    // 超出预算时淘汰比当前谜题更远的关卡
+    while (memory_usage + size > memory_budget && !ready.empty()) {
+        auto last = std::prev(ready.end());
+        if (last->first <= puzzle.level_id) {
+            break;
+        }
+        memory_usage -= last->second.byte_size();
+        ready.erase(last);
+    }
+
+    // 仍然放不下则丢弃当前谜题
+    if (memory_usage + size > memory_budget) {
+        return;
+    }
+
+    memory_usage += size;
+    ready[puzzle.level_id] = std::move(puzzle);
+}
+
+void PuzzlePrefetcher::lower_thread_priority() {
+#if defined(__ANDROID__) || defined(__linux__)
+    // Linux/Android上nice值按线程生效
+    setpriority(PRIO_PROCESS, static_cast<id_t>(syscall(SYS_gettid)), 10);
+#elif defined(__APPLE__)
+    pthread_set_qos_class_self_np(QOS_CLASS_UTILITY, 0);
+#elif defined(WIN32)
+    SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_BELOW_NORMAL);
+#endif
+}
+
+} // namespace godot
@@ -0,0 +1,110 @@
+#include "puzzle_validator.h"
+#include "cpu_kernels.h"
+
+#include <opencv2/imgproc.hpp>
+#include <algorithm>
+
+namespace godot {
+
+PuzzleValidator::PuzzleValidator() {
+    // 默认参数：差值超过12视为改变，可见度至少2%，忽略小于16像素的杂散噪点
+    options.change_threshold = 12;
+    options.min_visibility = 0.02f;
+    options.min_stray_area = 16;
+}
+
+PuzzleValidator::~PuzzleValidator() {
+    // 无需特殊清理
+}
+
+bool PuzzleValidator::validate(const cv::Mat& original, const cv::Mat& modified,
+                               const std::vector<cv::Rect>& regions, ValidationReport& report) {
+    // 参数验证
+    if (original.empty() || original.size() != modified.size() || original.type() != modified.type() ||
+        original.depth() != CV_8U) {
+        return false;
+    }
+
+    report.diffs.assign(regions.size(), DiffValidation());
+    report.stray_components.clear();
+    report.stray_pixels = 0;
+    report.valid = true;
+
+    // 单次遍历求各通道绝对差的最大值（按CPU特性分发的SIMD内核）
+    max_diff.create(original.size(), CV_8UC1);
+    const CpuKernelTable& kernels = get_cpu_kernels();
+    for (int i = 0; i < original.rows; i++) {
+        kernels.max_abs_diff(original.ptr<uint8_t>(i), modified.ptr<uint8_t>(i), max_diff.ptr<uint8_t>(i),
+                             original.cols, original.channels());
+    }
+    cv::threshold(max_diff, change_mask, options.change_threshold, 255, cv::THRESH_BINARY);
+
+    // 逐个差异统计可见度
+    const cv::Rect image_rect(0, 0, original.cols, original.rows);
+    region_mask.create(original.size(), CV_8UC1);
+    region_mask.setTo(cv::Scalar(0));
+
+    for (size_t i = 0; i < regions.size(); i++) {
+        DiffValidation& result = report.diffs[i];
+        cv::Rect region = regions[i] & image_rect;
+
+        if (region.area() > 0) {
+            cv::Mat region_changes = change_mask(region);
+            result.changed_pixels = cv::countNonZero(region_changes);
+            result.changed_ratio = static_cast<float>(result.changed_pixels) / region.area();
+            result.mean_delta = result.changed_pixels > 0
+                ? static_cast<float>(cv::mean(max_diff(region), region_changes)[0])
+                : 0.0f;
+            result.visibility = result.changed_ratio * result.mean_delta / 255.0f;
+            region_mask(region).setTo(cv::Scalar(255));
+        }
+        result.visible = result.visibility >= options.min_visibility;
+
+        // 检查与其他差异的重叠
+        for (size_t j = 0; j < regions.size(); j++) {
+            if (j != i && (regions[i] & regions[j]).area() > 0) {
+                result.overlaps.push_back(static_cast<int>(j));
+            }
+        }
+
+        if (!result.visible || !result.overlaps.empty()) {
+            report.valid = false;
+        }
+    }
+
+    // 差异区域之外的改变：只对这部分做连通域标记
+    cv::bitwise_not(region_mask, region_mask);
+    cv::bitwise_and(change_mask, region_mask, change_mask);
+    report.stray_pixels = cv::countNonZero(change_mask);
+
+    if (report.stray_pixels > 0) {
+        int label_count = cv::connectedComponentsWithStats(change_mask, labels, stats, centroids, 8, CV_32S);
+
+        // 标签0为背景
+        for (int label = 1; label < label_count; label++) {
+            if (stats.at<int>(label, cv::CC_STAT_AREA) >= options.min_stray_area) {
+                report.stray_components.emplace_back(
+                    stats.at<int>(label, cv::CC_STAT_LEFT),
+                    stats.at<int>(label, cv::CC_STAT_TOP),
+                    stats.at<int>(label, cv::CC_STAT_WIDTH),
+                    stats.at<int>(label, cv::CC_STAT_HEIGHT));
+            }
+        }
+
+        if (!report.stray_components.empty()) {
+            report.valid = false;
+        }
+    }
+
+    return true;
+}
+
+void PuzzleValidator::set_options(const ValidationOptions& new_options) {
+    options = new_options;
+}
+
+const ValidationOptions& PuzzleValidator::get_options() const {
+    return options;
+}
+
+} // namespace godot
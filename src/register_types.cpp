@@ -1,5 +1,7 @@
 #include "register_types.h"
 #include "diff_detector.h"
+#include "puzzle_pack_loader.h"
+#include "puzzle_daemon_client.h"
 
 #include <gdextension_interface.h>
 #include <godot_cpp/core/defs.hpp>
@@ -14,6 +16,8 @@ void initialize_diff_detector_module(ModuleInitializationLevel p_level) {
     }
     
     ClassDB::register_class<DiffDetector>();
+    ClassDB::register_class<PuzzlePackLoader>();
+    ClassDB::register_class<PuzzleDaemonClient>();
 }
 
 void uninitialize_diff_detector_module(ModuleInitializationLevel p_level) {
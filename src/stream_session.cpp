@@ -0,0 +1,320 @@
+#include "stream_session.h"
+
+#include <opencv2/imgproc.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+namespace godot {
+
+// 跟踪在半分辨率灰度图上进行
+constexpr float TRACK_SCALE = 0.5f;
+// 场景切换检测的缩略图边长
+constexpr int THUMBNAIL_SIZE = 32;
+// 模板灰度标准差低于该值时（纯色区域）匹配不可靠，保持原位置
+constexpr double MIN_TEMPLATE_STDDEV = 2.0;
+// 跟踪区域与检测框的IoU达到该值时按检测框校正位置
+constexpr float SNAP_MIN_IOU = 0.3f;
+
+static double elapsed_ms(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// 抛物线拟合求相关峰的亚像素偏移
+static float subpixel_offset(float left, float center, float right) {
+    float denominator = left - 2.0f * center + right;
+    if (std::abs(denominator) < 1e-6f) {
+        return 0.0f;
+    }
+    return std::max(-0.5f, std::min(0.5f, 0.5f * (left - right) / denominator));
+}
+
+StreamSession::StreamSession(DiffGenerator& generator, StreamDetectFunction detect)
+    : generator(generator),
+      detect_function(std::move(detect)),
+      diff_count(5),
+      difficulty(1),
+      frame_index(0),
+      last_detect_frame(0)
+{
+    // 默认参数：每30帧检测一次，缩略图平均差超过20%视为场景切换
+    options.detect_interval = 30;
+    options.scene_change_threshold = 0.2f;
+    options.search_margin = 24;
+    options.min_track_score = 0.5f;
+}
+
+StreamSession::~StreamSession() {
+    // 无需特殊清理
+}
+
+void StreamSession::start(int count, int diff) {
+    diff_count = count;
+    difficulty = diff;
+    frame_index = 0;
+    last_detect_frame = 0;
+    frame_size = cv::Size();
+    diffs.clear();
+    tracks.clear();
+    detections.clear();
+    previous_thumbnail.release();
+}
+
+bool StreamSession::process_frame(cv::Mat& frame, StreamFrameStats& stats) {
+    PixelLayoutType layout;
+    if (frame.empty() || !DiffGenerator::get_pixel_layout(frame, layout)) {
+        return false;
+    }
+
+    stats = StreamFrameStats();
+    stats.frame_index = frame_index;
+
+    auto track_start = std::chrono::steady_clock::now();
+    prepare_frame(frame);
+
+    // 首帧、尺寸变化或场景切换时重新生成全部差异
+    stats.scene_change = !diffs.empty() && (frame.size() != frame_size || is_scene_change());
+    bool regenerate = diffs.empty() || stats.scene_change;
+    bool periodic = options.detect_interval > 0 && frame_index - last_detect_frame >= options.detect_interval;
+
+    // 先跟踪，使定期检测时可以用检测框校正漂移
+    std::vector<size_t> lost;
+    if (!regenerate) {
+        for (size_t i = 0; i < diffs.size(); i++) {
+            if (!track_region(i)) {
+                lost.push_back(i);
+            }
+        }
+    }
+    stats.track_ms = elapsed_ms(track_start);
+
+    // 检测只在需要时运行，其余帧的开销由区域内的差异算法决定
+    if (regenerate || periodic || !lost.empty()) {
+        auto detect_start = std::chrono::steady_clock::now();
+        if (!detect_function || !detect_function(frame, detections)) {
+            // 检测失败时生成器会退回随机区域
+            detections.clear();
+        }
+        last_detect_frame = frame_index;
+        stats.detected = true;
+        stats.detect_ms = elapsed_ms(detect_start);
+
+        if (!regenerate) {
+            auto snap_start = std::chrono::steady_clock::now();
+            snap_to_detections();
+            stats.track_ms += elapsed_ms(snap_start);
+        }
+    }
+
+    // 跟踪模板和检测都已取自未修改的帧，差异直接写入输入帧
+    auto apply_start = std::chrono::steady_clock::now();
+    if (regenerate) {
+        std::vector<DiffInfo> generated;
+        if (!generator.generate_diffs(frame, detections, diff_count, difficulty, generated)) {
+            diffs.clear();
+            tracks.clear();
+            return false;
+        }
+        diffs = std::move(generated);
+        tracks.assign(diffs.size(), Track());
+        for (size_t i = 0; i < diffs.size(); i++) {
+            tracks[i].position = cv::Point2f(diffs[i].region.x, diffs[i].region.y);
+            update_template(i);
+        }
+        frame_size = frame.size();
+    } else {
+        // 先把跟踪丢失的差异换到新区域重新生成。此时本帧还没有应用任何差异，
+        // 帧本身就是原图，reroll_diff从原图恢复旧区域这一步不需要单独的副本
+        std::vector<size_t> dropped;
+        for (size_t index : lost) {
+            bool applied = generator.reroll_diff(frame, frame, detections, static_cast<int>(index), difficulty, -1, true, diffs);
+            if (!applied) {
+                // 重新生成失败时在最后跟踪到的位置按原参数重放，仍失败则移除该差异，
+                // 避免get_stream_diff_data报告帧中不存在的差异
+                applied = generator.reapply_diff(frame, diffs[index], difficulty);
+            }
+            if (!applied) {
+                dropped.push_back(index);
+                continue;
+            }
+            tracks[index].position = cv::Point2f(diffs[index].region.x, diffs[index].region.y);
+            update_template(index);
+        }
+
+        // 以相同参数把跟踪成功的差异重放到新帧上（区域互不重叠，不受上面修改的影响）
+        for (size_t i = 0; i < diffs.size(); i++) {
+            if (std::find(lost.begin(), lost.end(), i) == lost.end()) {
+                generator.reapply_diff(frame, diffs[i], difficulty);
+                update_template(i);
+            }
+        }
+
+        // lost按下标升序排列，从后往前移除
+        for (auto it = dropped.rbegin(); it != dropped.rend(); ++it) {
+            diffs.erase(diffs.begin() + *it);
+            tracks.erase(tracks.begin() + *it);
+        }
+        stats.lost_tracks = static_cast<int>(lost.size());
+    }
+    stats.apply_ms = elapsed_ms(apply_start);
+
+    std::swap(previous_thumbnail, thumbnail);
+    frame_index++;
+    return true;
+}
+
+const std::vector<DiffInfo>& StreamSession::get_diffs() const {
+    return diffs;
+}
+
+void StreamSession::set_options(const StreamOptions& new_options) {
+    options = new_options;
+}
+
+const StreamOptions& StreamSession::get_options() const {
+    return options;
+}
+
+void StreamSession::prepare_frame(const cv::Mat& frame) {
+    // 先缩小再转灰度，减少转换的像素数
+    cv::resize(frame, scaled, cv::Size(), TRACK_SCALE, TRACK_SCALE, cv::INTER_AREA);
+    switch (scaled.channels()) {
+        case 1: gray = scaled; break;
+        case 2: cv::extractChannel(scaled, gray, 0); break;
+        case 3: cv::cvtColor(scaled, gray, cv::COLOR_RGB2GRAY); break;
+        case 4: cv::cvtColor(scaled, gray, cv::COLOR_RGBA2GRAY); break;
+    }
+    cv::resize(gray, thumbnail, cv::Size(THUMBNAIL_SIZE, THUMBNAIL_SIZE), 0, 0, cv::INTER_AREA);
+}
+
+bool StreamSession::is_scene_change() const {
+    if (previous_thumbnail.empty()) {
+        return false;
+    }
+
+    cv::Mat difference;
+    cv::absdiff(thumbnail, previous_thumbnail, difference);
+    return cv::mean(difference)[0] / 255.0 > options.scene_change_threshold;
+}
+
+bool StreamSession::track_region(size_t index) {
+    Track& track = tracks[index];
+    DiffInfo& diff = diffs[index];
+    if (track.template_gray.empty()) {
+        return false;
+    }
+
+    // 纯色区域无法可靠匹配，保持原位置
+    cv::Scalar mean, stddev;
+    cv::meanStdDev(track.template_gray, mean, stddev);
+    if (stddev[0] < MIN_TEMPLATE_STDDEV) {
+        return true;
+    }
+
+    // 在上一帧位置周围的搜索窗口内做归一化相关匹配
+    int margin = std::max(1, cvRound(options.search_margin * TRACK_SCALE));
+    cv::Rect window(cvRound(track.position.x * TRACK_SCALE) - margin,
+                    cvRound(track.position.y * TRACK_SCALE) - margin,
+                    track.template_gray.cols + 2 * margin,
+                    track.template_gray.rows + 2 * margin);
+    window &= cv::Rect(0, 0, gray.cols, gray.rows);
+    if (window.width < track.template_gray.cols || window.height < track.template_gray.rows) {
+        return false;
+    }
+
+    cv::matchTemplate(gray(window), track.template_gray, match_result, cv::TM_CCOEFF_NORMED);
+    double max_score = 0.0;
+    cv::Point max_loc;
+    cv::minMaxLoc(match_result, nullptr, &max_score, nullptr, &max_loc);
+    if (max_score < options.min_track_score) {
+        return false;
+    }
+
+    cv::Point2f peak(static_cast<float>(max_loc.x), static_cast<float>(max_loc.y));
+    if (max_loc.x > 0 && max_loc.x < match_result.cols - 1) {
+        peak.x += subpixel_offset(match_result.at<float>(max_loc.y, max_loc.x - 1),
+                                  match_result.at<float>(max_loc.y, max_loc.x),
+                                  match_result.at<float>(max_loc.y, max_loc.x + 1));
+    }
+    if (max_loc.y > 0 && max_loc.y < match_result.rows - 1) {
+        peak.y += subpixel_offset(match_result.at<float>(max_loc.y - 1, max_loc.x),
+                                  match_result.at<float>(max_loc.y, max_loc.x),
+                                  match_result.at<float>(max_loc.y + 1, max_loc.x));
+    }
+
+    // 换算回全分辨率，区域尺寸保持不变以保证重放结果稳定
+    cv::Point2f position((window.x + peak.x) / TRACK_SCALE, (window.y + peak.y) / TRACK_SCALE);
+    cv::Rect region(cvRound(position.x), cvRound(position.y), diff.region.width, diff.region.height);
+    if ((region & cv::Rect(0, 0, frame_size.width, frame_size.height)) != region) {
+        return false;
+    }
+
+    track.position = position;
+    diff.region = region;
+    diff.position = cv::Point(region.x + region.width / 2, region.y + region.height / 2);
+    return true;
+}
+
+void StreamSession::snap_to_detections() {
+    const cv::Rect frame_rect(0, 0, frame_size.width, frame_size.height);
+
+    for (size_t i = 0; i < diffs.size(); i++) {
+        DiffInfo& diff = diffs[i];
+
+        // 找到与当前区域IoU最大的检测框
+        float best_iou = 0.0f;
+        cv::Rect best_box;
+        for (const auto& obj : detections) {
+            int intersection = (diff.region & obj.bounding_box).area();
+            int union_area = diff.region.area() + obj.bounding_box.area() - intersection;
+            float iou = union_area > 0 ? static_cast<float>(intersection) / union_area : 0.0f;
+            if (iou > best_iou) {
+                best_iou = iou;
+                best_box = obj.bounding_box;
+            }
+        }
+        if (best_iou < SNAP_MIN_IOU) {
+            continue;
+        }
+
+        // 中心对齐到检测框，尺寸不变，并限制在画面内
+        cv::Rect snapped(best_box.x + best_box.width / 2 - diff.region.width / 2,
+                         best_box.y + best_box.height / 2 - diff.region.height / 2,
+                         diff.region.width, diff.region.height);
+        snapped.x = std::max(0, std::min(snapped.x, frame_size.width - snapped.width));
+        snapped.y = std::max(0, std::min(snapped.y, frame_size.height - snapped.height));
+        if ((snapped & frame_rect) != snapped) {
+            continue;
+        }
+
+        // 不能与其他差异重叠
+        bool overlaps = false;
+        for (size_t j = 0; j < diffs.size() && !overlaps; j++) {
+            overlaps = j != i && (snapped & diffs[j].region).area() > 0;
+        }
+        if (overlaps) {
+            continue;
+        }
+
+        diff.region = snapped;
+        diff.position = cv::Point(snapped.x + snapped.width / 2, snapped.y + snapped.height / 2);
+        tracks[i].position = cv::Point2f(snapped.x, snapped.y);
+    }
+}
+
+void StreamSession::update_template(size_t index) {
+    const cv::Rect& region = diffs[index].region;
+    cv::Rect scaled_region(cvRound(region.x * TRACK_SCALE), cvRound(region.y * TRACK_SCALE),
+                           std::max(1, cvRound(region.width * TRACK_SCALE)),
+                           std::max(1, cvRound(region.height * TRACK_SCALE)));
+    scaled_region &= cv::Rect(0, 0, gray.cols, gray.rows);
+
+    // 模板取自未修改的输入帧，避免差异本身影响匹配
+    if (scaled_region.area() > 0) {
+        gray(scaled_region).copyTo(tracks[index].template_gray);
+    } else {
+        tracks[index].template_gray.release();
+    }
+}
+
+} // namespace godot
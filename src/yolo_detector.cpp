@@ -1,4 +1,5 @@
 #include "yolo_detector.h"
+#include "cpu_kernels.h"
 #include <opencv2/imgproc.hpp>
 #include <stdexcept>
 
@@ -48,7 +49,7 @@ bool YoloDetector::detect(const cv::Mat& image) {
     }
     
     try {
-        // 清除之前的检测结果
+        // 清除之前的检测结果（保留容量）
         detections.clear();
         
         // 执行模型推理
@@ -59,28 +60,28 @@ bool YoloDetector::detect(const cv::Mat& image) {
         // 获取检测结果
         auto results = model->getDetectionResults();
         
-        // 将模型结果转换为DetectedObject结构
+        // 一次预留全部容量，分割点直接追加到共享的点数组
+        size_t point_count = 0;
         for (const auto& result : results) {
-            DetectedObject obj;
-            obj.class_id = result.class_id;
-            obj.confidence = result.confidence;
-            obj.bounding_box = cv::Rect(
+            point_count += result.segmentation_points.size() / 2;
+        }
+        detections.reserve(results.size(), point_count);
+        
+        for (const auto& result : results) {
+            detections.add(result.class_id, result.confidence, cv::Rect(
                 result.x, 
                 result.y, 
                 result.width, 
                 result.height
-            );
+            ));
             
             // 转换分割点
-            obj.points.reserve(result.segmentation_points.size() / 2);
-            for (size_t i = 0; i < result.segmentation_points.size(); i += 2) {
-                obj.points.emplace_back(
+            for (size_t i = 0; i + 1 < result.segmentation_points.size(); i += 2) {
+                detections.add_point(cv::Point(
                     result.segmentation_points[i], 
                     result.segmentation_points[i + 1]
-                );
+                ));
             }
-            
-            detections.push_back(obj);
         }
         
         return true;
@@ -90,7 +91,36 @@ bool YoloDetector::detect(const cv::Mat& image) {
     }
 }
 
-std::vector<DetectedObject> YoloDetector::get_detections() const {
+bool YoloDetector::prepare_input(const cv::Mat& image, cv::Mat& rgb) {
+    if (image.depth() != CV_8U) {
+        return false;
+    }
+    
+    // 非RGB布局只为检测单向转换一次
+    const CpuKernelTable& kernels = get_cpu_kernels();
+    switch (image.channels()) {
+        case 1:
+        case 2: {
+            // LA8直接跳过alpha，不需要先提取亮度通道
+            rgb.create(image.size(), CV_8UC3);
+            for (int i = 0; i < image.rows; i++) {
+                kernels.gray_to_rgb(image.ptr<uint8_t>(i), rgb.ptr<uint8_t>(i), image.cols, image.channels());
+            }
+            return true;
+        }
+        case 3: rgb = image; return true;
+        case 4: {
+            rgb.create(image.size(), CV_8UC3);
+            for (int i = 0; i < image.rows; i++) {
+                kernels.rgba_to_rgb(image.ptr<uint8_t>(i), rgb.ptr<uint8_t>(i), image.cols);
+            }
+            return true;
+        }
+        default: return false;
+    }
+}
+
+const DetectionSet& YoloDetector::get_detections() const {
     return detections;
 }
 
@@ -116,24 +146,4 @@ float YoloDetector::get_nms_threshold() const {
     return nms_threshold;
 }
 
-void YoloDetector::draw_detections(cv::Mat& image) {
-    // 在图像上绘制检测结果，用于调试
-    for (const auto& det : detections) {
-        // 绘制边界框
-        cv::rectangle(image, det.bounding_box, cv::Scalar(0, 255, 0), 2);
-        
-        // 绘制分割轮廓
-        std::vector<std::vector<cv::Point>> contours;
-        contours.push_back(det.points);
-        cv::drawContours(image, contours, 0, cv::Scalar(0, 0, 255), 2);
-        
-        // 绘制置信度文字
-        std::string text = "Class " + std::to_string(det.class_id) + 
-                          " (" + std::to_string(int(det.confidence * 100)) + "%)";
-        cv::putText(image, text, 
-                   cv::Point(det.bounding_box.x, det.bounding_box.y - 10),
-                   cv::FONT_HERSHEY_SIMPLEX, 0.5, cv::Scalar(0, 255, 0), 2);
-    }
-}
-
 } // namespace godot 
\ No newline at end of file
@@ -0,0 +1,218 @@
+// CPU内核一致性检查工具
+// 打印检测到的CPU特性和实际选中的变体（受环境变量DIFF_DETECTOR_CPU影响），
+// 并把每个可用变体的输出与通用变体逐字节比较，用于验证新编译的指令集变体。
+//
+// 用法: diff_cpu_kernel_check [选项]
+//   --pixels <N>     每个内核每次调用的像素数，默认4099（不是向量宽度的整数倍，覆盖尾部处理）
+//   --rounds <N>     随机输入的轮数，默认64
+//   --seed <N>       随机种子，默认1
+//
+// 整数内核要求完全一致；浮点混合内核允许1的差异（FMA收缩会改变舍入）。
+// 所有变体一致时退出码为0，存在差异时为1。
+
+#include "cpu_kernels.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace godot;
+
+namespace {
+
+struct CheckOptions {
+    int pixels = 4099;
+    int rounds = 64;
+    uint32_t seed = 1;
+};
+
+void print_usage() {
+    std::cerr << "usage: diff_cpu_kernel_check [--pixels N] [--rounds N] [--seed N]\n";
+}
+
+bool parse_options(int argc, char** argv, CheckOptions& options) {
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (i + 1 >= argc) {
+            std::cerr << "missing value for " << arg << "\n";
+            return false;
+        }
+        const char* value = argv[++i];
+        if (arg == "--pixels") options.pixels = std::atoi(value);
+        else if (arg == "--rounds") options.rounds = std::atoi(value);
+        else if (arg == "--seed") options.seed = static_cast<uint32_t>(std::strtoul(value, nullptr, 10));
+        else {
+            std::cerr << "unknown option " << arg << "\n";
+            return false;
+        }
+    }
+
+    if (options.pixels <= 0 || options.rounds <= 0) {
+        std::cerr << "--pixels and --rounds must be positive\n";
+        return false;
+    }
+    return true;
+}
+
+// 两个变体的输出差异
+struct Mismatch {
+    const char* kernel;
+    int channels;
+    int max_error;
+};
+
+int max_error(const std::vector<uint8_t>& a, const std::vector<uint8_t>& b) {
+    int result = 0;
+    for (size_t i = 0; i < a.size(); i++) {
+        result = std::max(result, std::abs(a[i] - b[i]));
+    }
+    return result;
+}
+
+void fill_random(std::vector<uint8_t>& data, std::mt19937& rng) {
+    std::uniform_int_distribution<int> byte(0, 255);
+    for (uint8_t& value : data) {
+        value = static_cast<uint8_t>(byte(rng));
+    }
+}
+
+// 在相同的随机输入上运行两个变体，记录超出容差的内核
+void compare_variants(const CpuKernelTable& reference, const CpuKernelTable& candidate,
+                      const CheckOptions& options, std::mt19937& rng, std::vector<Mismatch>& mismatches) {
+    const int count = options.pixels;
+    std::vector<uint8_t> source, aux, sprite, expected, actual;
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    std::uniform_int_distribution<int> delta_dist(-80, 80);
+
+    auto check = [&](const char* kernel, int channels, int tolerance) {
+        int error = max_error(expected, actual);
+        if (error > tolerance) {
+            mismatches.push_back({ kernel, channels, error });
+        }
+    };
+
+    for (int channels = 1; channels <= 4; channels++) {
+        source.resize(static_cast<size_t>(count) * channels);
+        aux.resize(static_cast<size_t>(count) * channels);
+        sprite.resize(static_cast<size_t>(count) * 4);
+        fill_random(source, rng);
+        fill_random(aux, rng);
+        fill_random(sprite, rng);
+
+        int delta = delta_dist(rng);
+        int channel = std::uniform_int_distribution<int>(0, channels - 1)(rng);
+        float alpha = unit(rng);
+        const float color[3] = { unit(rng) * 255.0f, unit(rng) * 255.0f, unit(rng) * 255.0f };
+
+        expected = source;
+        actual = source;
+        reference.add_channel_saturate(expected.data(), count, channels, channel, delta);
+        candidate.add_channel_saturate(actual.data(), count, channels, channel, delta);
+        check("add_channel_saturate", channels, 0);
+
+        expected = source;
+        actual = source;
+        reference.blend_gray(expected.data(), aux.data(), count, channels, alpha);
+        candidate.blend_gray(actual.data(), aux.data(), count, channels, alpha);
+        check("blend_gray", channels, 1);
+
+        expected = source;
+        actual = source;
+        reference.blend_color_coverage(expected.data(), aux.data(), count, channels, color, alpha);
+        candidate.blend_color_coverage(actual.data(), aux.data(), count, channels, color, alpha);
+        check("blend_color_coverage", channels, 1);
+
+        expected = source;
+        actual = source;
+        reference.blend_sprite(expected.data(), sprite.data(), count, channels, alpha);
+        candidate.blend_sprite(actual.data(), sprite.data(), count, channels, alpha);
+        check("blend_sprite", channels, 1);
+
+        expected = source;
+        actual = source;
+        reference.push_contrast_masked(expected.data(), aux.data(), count, channels, std::abs(delta));
+        candidate.push_contrast_masked(actual.data(), aux.data(), count, channels, std::abs(delta));
+        check("push_contrast_masked", channels, 0);
+
+        expected.assign(count, 0);
+        actual.assign(count, 0);
+        reference.max_abs_diff(source.data(), aux.data(), expected.data(), count, channels);
+        candidate.max_abs_diff(source.data(), aux.data(), actual.data(), count, channels);
+        check("max_abs_diff", channels, 0);
+
+        if (channels <= 2) {
+            expected.assign(static_cast<size_t>(count) * 3, 0);
+            actual.assign(static_cast<size_t>(count) * 3, 0);
+            reference.gray_to_rgb(source.data(), expected.data(), count, channels);
+            candidate.gray_to_rgb(source.data(), actual.data(), count, channels);
+            check("gray_to_rgb", channels, 0);
+        } else if (channels == 4) {
+            expected.assign(static_cast<size_t>(count) * 3, 0);
+            actual.assign(static_cast<size_t>(count) * 3, 0);
+            reference.rgba_to_rgb(source.data(), expected.data(), count);
+            candidate.rgba_to_rgb(source.data(), actual.data(), count);
+            check("rgba_to_rgb", channels, 0);
+        }
+    }
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    CheckOptions options;
+    if (!parse_options(argc, argv, options)) {
+        print_usage();
+        return 2;
+    }
+
+    const CpuFeatures& features = get_cpu_features();
+    std::cout << "features: avx2=" << features.avx2 << " fma=" << features.fma << " neon=" << features.neon
+              << " dotprod=" << features.dotprod << " fp16=" << features.fp16 << "\n";
+
+    const char* forced = std::getenv("DIFF_DETECTOR_CPU");
+    std::cout << "selected: " << get_cpu_kernels().name;
+    if (forced && forced[0] != '\0') {
+        std::cout << " (DIFF_DETECTOR_CPU=" << forced << ")";
+    }
+    std::cout << "\n";
+
+    std::vector<const CpuKernelTable*> available = get_available_cpu_kernels();
+    const CpuKernelTable& reference = *available.front();
+    bool consistent = true;
+
+    for (const CpuKernelTable* table : available) {
+        if (table == &reference) {
+            continue;
+        }
+
+        std::mt19937 rng(options.seed);
+        std::vector<Mismatch> mismatches;
+        for (int round = 0; round < options.rounds; round++) {
+            compare_variants(reference, *table, options, rng, mismatches);
+        }
+
+        if (mismatches.empty()) {
+            std::cout << table->name << ": matches " << reference.name << "\n";
+            continue;
+        }
+
+        consistent = false;
+        Mismatch worst = mismatches.front();
+        for (const Mismatch& mismatch : mismatches) {
+            if (mismatch.max_error > worst.max_error) {
+                worst = mismatch;
+            }
+        }
+        std::cout << table->name << ": " << mismatches.size() << " mismatches, worst "
+                  << worst.kernel << " (" << worst.channels << " channels, max error " << worst.max_error << ")\n";
+    }
+
+    if (available.size() == 1) {
+        std::cout << "only the " << reference.name << " variant is available on this CPU\n";
+    }
+    return consistent ? 0 : 1;
+}
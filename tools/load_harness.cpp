@@ -0,0 +1,940 @@
+// 持续负载测试工具（Linux）
+// 以可配置的并发数和请求速率，把一组图像反复送入与generate_diff_from_buffer标准策略相同的生成流程
+// （解码，大JPEG缩小解码后检测 → 共享检测器上串行推理 → 实例标签图 → 生成差异 → 复制输出缓冲区），
+// 长时间运行并输出可在不同构建之间比较的JSON报告。
+//
+// 用法: diff_load_harness --input <目录> [选项]
+//   --model <路径>            使用真实的YOLO模型；省略时使用桩检测器
+//   --stub-objects <N>        桩检测器每张图像返回的物体数，默认8
+//   --stub-latency <毫秒>     桩检测器模拟的推理耗时（持有检测器锁），默认0
+//   --concurrency <N>         并发的生成线程数（每个线程相当于一个DiffDetector实例），默认2
+//   --rate <次/秒>            开环请求速率，按固定间隔发出请求，排队时间计入延迟；0表示闭环（每个线程完成即发下一个），默认0
+//   --max-queue <N>           开环模式下的排队上限，超出的请求记为丢弃，默认1000
+//   --duration <秒>           测量时长，默认60
+//   --warmup <秒>             预热时长，不计入延迟统计，默认5
+//   --requests <N>            最多发出的请求数（含预热），0表示只按时长，默认0
+//   --sample-interval <秒>    时间序列采样间隔，默认1
+//   --diff-count <N>          差异数量 (5-10)，默认7
+//   --difficulty <N>          难度 (1-10)，默认5
+//   --time-budget <毫秒>      每次生成的时间预算，默认不限制
+//   --seed <N>                随机种子，默认按时间
+//   --report <路径>           报告输出路径，默认load_report.json
+//
+// 报告包含：各阶段（排队、解码、检测、生成、输出、总计）延迟的p50/p95/p99/最大值，吞吐量，
+// 起始/峰值/稳态RSS，以及按采样间隔记录的吞吐量、延迟、RSS、堆占用、分配次数和CPU频率。
+// 分配次数通过在本程序中替换malloc系列函数统计，包含OpenCV的cv::Mat缓冲区（仅glibc）。
+
+#include "diff_generator.h"
+#include "image_decode.h"
+#include "instance_label_map.h"
+#include "yolo_detector.h"
+#include "cpu_kernels.h"
+
+#include <opencv2/core.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cerrno>
+#include <cmath>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cctype>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <future>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(__GLIBC__)
+#include <malloc.h>
+#endif
+#include <unistd.h>
+
+using namespace godot;
+namespace fs = std::filesystem;
+
+// ---------------------------------------------------------------------------
+// 分配计数：替换malloc系列函数，转发给glibc的内部实现
+// ---------------------------------------------------------------------------
+
+namespace {
+
+std::atomic<uint64_t> allocation_count(0);
+std::atomic<uint64_t> free_count(0);
+
+} // namespace
+
+#if defined(__GLIBC__)
+#define HARNESS_TRACK_ALLOCATIONS 1
+
+extern "C" {
+void* __libc_malloc(size_t size);
+void __libc_free(void* ptr);
+void* __libc_calloc(size_t count, size_t size);
+void* __libc_realloc(void* ptr, size_t size);
+void* __libc_memalign(size_t alignment, size_t size);
+
+void* malloc(size_t size) {
+    allocation_count.fetch_add(1, std::memory_order_relaxed);
+    return __libc_malloc(size);
+}
+
+void free(void* ptr) {
+    if (ptr) {
+        free_count.fetch_add(1, std::memory_order_relaxed);
+    }
+    __libc_free(ptr);
+}
+
+void* calloc(size_t count, size_t size) {
+    allocation_count.fetch_add(1, std::memory_order_relaxed);
+    return __libc_calloc(count, size);
+}
+
+void* realloc(void* ptr, size_t size) {
+    // 原地调整大小不计数，只统计等价于分配或释放的调用
+    if (!ptr) {
+        allocation_count.fetch_add(1, std::memory_order_relaxed);
+    } else if (size == 0) {
+        free_count.fetch_add(1, std::memory_order_relaxed);
+    }
+    return __libc_realloc(ptr, size);
+}
+
+void* memalign(size_t alignment, size_t size) {
+    allocation_count.fetch_add(1, std::memory_order_relaxed);
+    return __libc_memalign(alignment, size);
+}
+
+void* aligned_alloc(size_t alignment, size_t size) {
+    allocation_count.fetch_add(1, std::memory_order_relaxed);
+    return __libc_memalign(alignment, size);
+}
+
+int posix_memalign(void** out, size_t alignment, size_t size) {
+    void* ptr = __libc_memalign(alignment, size);
+    if (!ptr) {
+        return ENOMEM;
+    }
+    allocation_count.fetch_add(1, std::memory_order_relaxed);
+    *out = ptr;
+    return 0;
+}
+} // extern "C"
+#else
+#define HARNESS_TRACK_ALLOCATIONS 0
+#endif
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+struct HarnessOptions {
+    fs::path input_dir;
+    std::string model_path;
+    int stub_objects = 8;
+    double stub_latency_ms = 0.0;
+    int concurrency = 2;
+    double rate = 0.0;
+    size_t max_queue = 1000;
+    double duration_s = 60.0;
+    double warmup_s = 5.0;
+    uint64_t max_requests = 0;
+    double sample_interval_s = 1.0;
+    int diff_count = 7;
+    int difficulty = 5;
+    double time_budget_ms = 0.0;
+    uint32_t seed = 0;
+    bool has_seed = false;
+    fs::path report_path = "load_report.json";
+};
+
+// 统计的阶段
+enum Stage {
+    STAGE_QUEUE = 0,
+    STAGE_DECODE,
+    STAGE_DETECT,
+    STAGE_GENERATE,
+    STAGE_OUTPUT,
+    STAGE_TOTAL,
+    STAGE_COUNT
+};
+
+const char* const STAGE_NAMES[STAGE_COUNT] = { "queue", "decode", "detect", "generate", "output", "total" };
+
+/**
+ * 对数分桶的延迟直方图
+ * 相邻桶相差2%，覆盖1微秒到约1小时，记录时不分配内存，便于长时间运行
+ */
+class LatencyHistogram {
+public:
+    LatencyHistogram() : buckets(BUCKET_COUNT, 0), count(0), sum_ms(0.0), max_ms(0.0) {}
+
+    void record(double ms) {
+        buckets[bucket_index(ms)]++;
+        count++;
+        sum_ms += ms;
+        max_ms = std::max(max_ms, ms);
+    }
+
+    void reset() {
+        std::fill(buckets.begin(), buckets.end(), 0);
+        count = 0;
+        sum_ms = 0.0;
+        max_ms = 0.0;
+    }
+
+    uint64_t get_count() const { return count; }
+    double get_mean() const { return count > 0 ? sum_ms / count : 0.0; }
+    double get_max() const { return max_ms; }
+
+    // 返回所在桶的上界（不超过实测最大值）
+    double percentile(double p) const {
+        if (count == 0) {
+            return 0.0;
+        }
+        uint64_t rank = static_cast<uint64_t>(std::ceil(p / 100.0 * count));
+        rank = std::max<uint64_t>(rank, 1);
+        uint64_t seen = 0;
+        for (int i = 0; i < BUCKET_COUNT; i++) {
+            seen += buckets[i];
+            if (seen >= rank) {
+                return std::min(bucket_upper_ms(i), max_ms);
+            }
+        }
+        return max_ms;
+    }
+
+private:
+    static constexpr int BUCKET_COUNT = 1120;
+    static constexpr double BUCKET_GROWTH = 1.02;
+    static constexpr double MIN_MS = 0.001;
+
+    std::vector<uint64_t> buckets;
+    uint64_t count;
+    double sum_ms;
+    double max_ms;
+
+    static int bucket_index(double ms) {
+        if (ms <= MIN_MS) {
+            return 0;
+        }
+        int index = static_cast<int>(std::log(ms / MIN_MS) / std::log(BUCKET_GROWTH)) + 1;
+        return std::min(index, BUCKET_COUNT - 1);
+    }
+
+    static double bucket_upper_ms(int index) {
+        return MIN_MS * std::pow(BUCKET_GROWTH, index);
+    }
+};
+
+// 时间序列中的一个采样点
+struct Sample {
+    double t_s;                 // 相对开始的时间
+    bool warmup;                // 是否处于预热阶段
+    uint64_t completed;         // 累计完成的请求数
+    double throughput;          // 本采样区间的吞吐量（次/秒）
+    double p50_ms;              // 本采样区间总延迟的p50
+    double p99_ms;
+    size_t rss_bytes;
+    size_t heap_bytes;          // malloc堆中正在使用的字节数（glibc）
+    uint64_t allocations;       // 累计分配次数
+    uint64_t frees;             // 累计释放次数
+    int cpu_mhz;                // cpu0当前频率，不可读时为0（用于观察降频）
+};
+
+// 所有线程共享的统计
+class HarnessStats {
+public:
+    HarnessStats() : completed(0), failed(0), dropped(0), measured(0) {}
+
+    void record(const double (&stage_ms)[STAGE_COUNT], bool measure) {
+        std::lock_guard<std::mutex> lock(mutex);
+        completed++;
+        interval.record(stage_ms[STAGE_TOTAL]);
+        if (measure) {
+            measured++;
+            last_measured = Clock::now();
+            for (int i = 0; i < STAGE_COUNT; i++) {
+                stages[i].record(stage_ms[i]);
+            }
+        }
+    }
+
+    void record_failure() {
+        std::lock_guard<std::mutex> lock(mutex);
+        failed++;
+    }
+
+    void record_drop() {
+        std::lock_guard<std::mutex> lock(mutex);
+        dropped++;
+    }
+
+    // 已结束（完成、失败或丢弃）的请求数
+    uint64_t get_finished() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return completed + failed + dropped;
+    }
+
+    // 取出并清空本采样区间的延迟
+    void take_interval(uint64_t& total_completed, double& p50, double& p99, uint64_t& interval_count) {
+        std::lock_guard<std::mutex> lock(mutex);
+        total_completed = completed;
+        interval_count = interval.get_count();
+        p50 = interval.percentile(50.0);
+        p99 = interval.percentile(99.0);
+        interval.reset();
+    }
+
+    std::mutex mutex;
+    LatencyHistogram stages[STAGE_COUNT];   // 预热后的各阶段延迟
+    LatencyHistogram interval;              // 当前采样区间的总延迟
+    uint64_t completed;
+    uint64_t failed;
+    uint64_t dropped;
+    uint64_t measured;
+    Clock::time_point last_measured;        // 最后一个计入统计的请求完成的时间
+};
+
+double elapsed_ms(Clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+size_t read_rss_bytes() {
+    FILE* file = std::fopen("/proc/self/statm", "r");
+    if (!file) {
+        return 0;
+    }
+    unsigned long size = 0;
+    unsigned long resident = 0;
+    int fields = std::fscanf(file, "%lu %lu", &size, &resident);
+    std::fclose(file);
+    return fields == 2 ? resident * static_cast<size_t>(sysconf(_SC_PAGESIZE)) : 0;
+}
+
+// /proc/self/status中的VmHWM（RSS峰值）
+size_t read_peak_rss_bytes() {
+    std::ifstream file("/proc/self/status");
+    std::string line;
+    while (std::getline(file, line)) {
+        if (line.compare(0, 6, "VmHWM:") == 0) {
+            return std::strtoull(line.c_str() + 6, nullptr, 10) * 1024;
+        }
+    }
+    return 0;
+}
+
+size_t read_heap_bytes() {
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33))
+    struct mallinfo2 info = mallinfo2();
+    return info.uordblks + info.hblkhd;
+#else
+    return 0;
+#endif
+}
+
+int read_cpu_mhz() {
+    FILE* file = std::fopen("/sys/devices/system/cpu/cpu0/cpufreq/scaling_cur_freq", "r");
+    if (!file) {
+        return 0;
+    }
+    unsigned long khz = 0;
+    int fields = std::fscanf(file, "%lu", &khz);
+    std::fclose(file);
+    return fields == 1 ? static_cast<int>(khz / 1000) : 0;
+}
+
+bool is_image_file(const fs::path& path) {
+    std::string extension = path.extension().string();
+    std::transform(extension.begin(), extension.end(), extension.begin(),
+                   [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+    return extension == ".jpg" || extension == ".jpeg" || extension == ".png" ||
+           extension == ".bmp" || extension == ".webp";
+}
+
+bool read_file(const fs::path& path, std::vector<uint8_t>& bytes) {
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    if (!file) {
+        return false;
+    }
+    std::streamsize length = file.tellg();
+    file.seekg(0);
+    bytes.resize(static_cast<size_t>(length));
+    return static_cast<bool>(file.read(reinterpret_cast<char*>(bytes.data()), length));
+}
+
+/**
+ * 检测器接口
+ * 与DiffDetector一样，所有生成线程共享一个检测器，推理串行执行
+ */
+class HarnessDetector {
+public:
+    virtual ~HarnessDetector() {}
+    virtual bool detect(const cv::Mat& image, DetectionSet& detections) = 0;
+};
+
+// 桩检测器：按网格返回带椭圆轮廓的物体，并在持有锁时等待指定时间模拟推理
+class StubDetector : public HarnessDetector {
+public:
+    StubDetector(int objects, double latency_ms) : objects(std::max(0, objects)), latency_ms(latency_ms) {}
+
+    bool detect(const cv::Mat& image, DetectionSet& detections) override {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (latency_ms > 0.0) {
+            std::this_thread::sleep_for(std::chrono::duration<double, std::milli>(latency_ms));
+        }
+
+        constexpr int OUTLINE_POINTS = 32;
+        int grid = static_cast<int>(std::ceil(std::sqrt(static_cast<double>(objects))));
+        detections.clear();
+        detections.reserve(objects, static_cast<size_t>(objects) * OUTLINE_POINTS);
+        for (int i = 0; i < objects; i++) {
+            int cell_w = image.cols / grid;
+            int cell_h = image.rows / grid;
+            cv::Rect box((i % grid) * cell_w + cell_w / 8, (i / grid) * cell_h + cell_h / 8,
+                         cell_w * 3 / 4, cell_h * 3 / 4);
+            if (box.area() <= 0) {
+                continue;
+            }
+            detections.add(i % 80, 0.5f + 0.5f * (i + 1) / (objects + 1), box);
+            cv::Point center(box.x + box.width / 2, box.y + box.height / 2);
+            for (int k = 0; k < OUTLINE_POINTS; k++) {
+                double angle = 2.0 * CV_PI * k / OUTLINE_POINTS;
+                detections.add_point(cv::Point(center.x + cvRound(std::cos(angle) * (box.width / 2 - 1)),
+                                               center.y + cvRound(std::sin(angle) * (box.height / 2 - 1))));
+            }
+        }
+        return true;
+    }
+
+private:
+    int objects;
+    double latency_ms;
+    std::mutex mutex;
+};
+
+// 真实检测器：与DiffDetector::run_detection相同，输入转换在锁外进行
+class ModelDetector : public HarnessDetector {
+public:
+    bool initialize(const std::string& model_path) {
+        return detector.initialize(model_path);
+    }
+
+    bool detect(const cv::Mat& image, DetectionSet& detections) override {
+        cv::Mat detector_input;
+        if (!YoloDetector::prepare_input(image, detector_input)) {
+            return false;
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!detector.detect(detector_input)) {
+            return false;
+        }
+        detections = detector.get_detections();
+        return true;
+    }
+
+private:
+    YoloDetector detector;
+    std::mutex mutex;
+};
+
+// 开环模式的请求队列：不阻塞发送方，超出上限的请求被丢弃
+struct Request {
+    size_t image;
+    Clock::time_point scheduled;
+};
+
+class RequestQueue {
+public:
+    explicit RequestQueue(size_t capacity) : capacity(capacity), closed(false) {}
+
+    bool push(const Request& request) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (items.size() >= capacity) {
+            return false;
+        }
+        items.push_back(request);
+        not_empty.notify_one();
+        return true;
+    }
+
+    bool pop(Request& request) {
+        std::unique_lock<std::mutex> lock(mutex);
+        not_empty.wait(lock, [this] { return closed || !items.empty(); });
+        if (items.empty()) {
+            return false;
+        }
+        request = items.front();
+        items.pop_front();
+        return true;
+    }
+
+    void close() {
+        std::lock_guard<std::mutex> lock(mutex);
+        closed = true;
+        not_empty.notify_all();
+    }
+
+private:
+    size_t capacity;
+    bool closed;
+    std::deque<Request> items;
+    std::mutex mutex;
+    std::condition_variable not_empty;
+};
+
+// 生成线程：拥有独立的生成器和标签图，相当于一个DiffDetector实例
+class HarnessWorker {
+public:
+    HarnessWorker(const HarnessOptions& options, HarnessDetector& detector, int index)
+        : options(options), detector(detector) {
+        if (options.has_seed) {
+            generator.set_seed(options.seed + static_cast<uint32_t>(index));
+        }
+    }
+
+    bool process(const std::vector<uint8_t>& bytes, Clock::time_point scheduled, double (&stage_ms)[STAGE_COUNT]) {
+        std::fill(stage_ms, stage_ms + STAGE_COUNT, 0.0);
+        auto start = Clock::now();
+        stage_ms[STAGE_QUEUE] = std::chrono::duration<double, std::milli>(start - scheduled).count();
+
+        // 与generate_diff_from_buffer的标准策略相同：足够大的JPEG缩小解码作为检测输入，
+        // 全分辨率解码在另一线程与检测并行；并行时等待全分辨率解码的时间计入检测阶段
+        cv::Mat encoded(1, static_cast<int>(bytes.size()), CV_8UC1, const_cast<uint8_t*>(bytes.data()));
+        int width = 0;
+        int height = 0;
+        bool is_jpeg = read_jpeg_size(bytes.data(), bytes.size(), width, height);
+        int reduce_factor = is_jpeg ? get_reduced_decode_factor(width, height) : 1;
+
+        cv::Mat image;
+        DetectionSet detections;
+        if (reduce_factor > 1) {
+            std::future<bool> full_decode = std::async(std::launch::async, [&encoded, &image]() {
+                return decode_image_buffer(encoded, get_image_decode_flags(true), image);
+            });
+            cv::Mat reduced;
+            bool decoded = decode_image_buffer(encoded, get_reduced_decode_flags(reduce_factor), reduced);
+            stage_ms[STAGE_DECODE] = elapsed_ms(start);
+
+            auto detect_start = Clock::now();
+            bool detected = decoded && detector.detect(reduced, detections);
+            if (!full_decode.get() || !detected) {
+                return false;
+            }
+            detections.scale(static_cast<double>(image.cols) / reduced.cols,
+                             static_cast<double>(image.rows) / reduced.rows, image.size());
+            stage_ms[STAGE_DETECT] = elapsed_ms(detect_start);
+        } else {
+            if (!decode_image_buffer(encoded, get_image_decode_flags(is_jpeg), image)) {
+                return false;
+            }
+            stage_ms[STAGE_DECODE] = elapsed_ms(start);
+
+            auto detect_start = Clock::now();
+            if (!detector.detect(image, detections)) {
+                return false;
+            }
+            stage_ms[STAGE_DETECT] = elapsed_ms(detect_start);
+        }
+
+        // 与generate_on_working相同：保留原始缓冲区、构建标签图，在扣除解码和检测耗时后的预算内生成差异
+        auto generate_start = Clock::now();
+        cv::Mat original = image.clone();
+        labels.build(image.size(), detections);
+        std::vector<DiffInfo> diffs;
+        double diff_budget_ms = DiffGenerator::remaining_time_budget(options.time_budget_ms, elapsed_ms(start));
+        if (!generator.generate_diffs(image, detections, options.diff_count, options.difficulty, diffs,
+                                      diff_budget_ms, &labels)) {
+            return false;
+        }
+        stage_ms[STAGE_GENERATE] = elapsed_ms(generate_start);
+
+        // 与create_output_image相同：逐行复制到新分配的输出缓冲区
+        auto output_start = Clock::now();
+        size_t row_bytes = image.cols * image.elemSize();
+        std::vector<uint8_t> output(row_bytes * image.rows);
+        for (int i = 0; i < image.rows; i++) {
+            std::memcpy(output.data() + i * row_bytes, image.ptr(i), row_bytes);
+        }
+        stage_ms[STAGE_OUTPUT] = elapsed_ms(output_start);
+
+        stage_ms[STAGE_TOTAL] = std::chrono::duration<double, std::milli>(Clock::now() - scheduled).count();
+        return true;
+    }
+
+private:
+    const HarnessOptions& options;
+    HarnessDetector& detector;
+    DiffGenerator generator;
+    InstanceLabelMap labels;
+};
+
+std::string json_escape(const std::string& text) {
+    std::string escaped;
+    escaped.reserve(text.size() + 2);
+    for (char c : text) {
+        switch (c) {
+            case '"': escaped += "\\\""; break;
+            case '\\': escaped += "\\\\"; break;
+            case '\n': escaped += "\\n"; break;
+            default:
+                if (static_cast<unsigned char>(c) < 0x20) {
+                    char buffer[8];
+                    std::snprintf(buffer, sizeof(buffer), "\\u%04x", c);
+                    escaped += buffer;
+                } else {
+                    escaped += c;
+                }
+        }
+    }
+    return escaped;
+}
+
+std::string report_to_json(const HarnessOptions& options, size_t image_count, HarnessStats& stats,
+                           const std::vector<Sample>& samples, double measured_s,
+                           size_t start_rss, size_t peak_rss, size_t final_rss) {
+    // 稳态RSS：测量阶段后半段采样的中位数
+    std::vector<size_t> steady;
+    double measured_start = options.warmup_s;
+    double steady_start = measured_start + measured_s / 2.0;
+    for (const Sample& sample : samples) {
+        if (!sample.warmup && sample.t_s >= steady_start) {
+            steady.push_back(sample.rss_bytes);
+        }
+    }
+    size_t steady_rss = 0;
+    if (!steady.empty()) {
+        std::nth_element(steady.begin(), steady.begin() + steady.size() / 2, steady.end());
+        steady_rss = steady[steady.size() / 2];
+    }
+
+    // 测量阶段首尾的分配次数
+    uint64_t measured_allocations = 0;
+    int64_t live_growth = 0;
+    const Sample* first = nullptr;
+    for (const Sample& sample : samples) {
+        if (!sample.warmup) {
+            first = &sample;
+            break;
+        }
+    }
+    if (first && !samples.empty()) {
+        const Sample& last = samples.back();
+        measured_allocations = last.allocations - first->allocations;
+        live_growth = static_cast<int64_t>(last.allocations - last.frees) -
+                      static_cast<int64_t>(first->allocations - first->frees);
+    }
+
+    std::lock_guard<std::mutex> lock(stats.mutex);
+    std::ostringstream json;
+    json << "{\n"
+         << "  \"config\": {"
+         << "\"detector\": \"" << (options.model_path.empty() ? "stub" : "model") << "\", "
+         << "\"model\": \"" << json_escape(options.model_path) << "\", "
+         << "\"stub_objects\": " << options.stub_objects << ", "
+         << "\"stub_latency_ms\": " << options.stub_latency_ms << ", "
+         << "\"images\": " << image_count << ", "
+         << "\"concurrency\": " << options.concurrency << ", "
+         << "\"rate\": " << options.rate << ", "
+         << "\"duration_s\": " << options.duration_s << ", "
+         << "\"warmup_s\": " << options.warmup_s << ", "
+         << "\"diff_count\": " << options.diff_count << ", "
+         << "\"difficulty\": " << options.difficulty << ", "
+         << "\"time_budget_ms\": " << options.time_budget_ms << ", "
+         << "\"cpu_kernels\": \"" << get_cpu_kernels().name << "\", "
+         << "\"hardware_threads\": " << std::thread::hardware_concurrency() << ", "
+         << "\"compiler\": \"" << json_escape(__VERSION__) << "\"},\n"
+         << "  \"requests\": {\"completed\": " << stats.completed << ", \"measured\": " << stats.measured
+         << ", \"failed\": " << stats.failed << ", \"dropped\": " << stats.dropped << "},\n"
+         << "  \"throughput_rps\": " << (measured_s > 0.0 ? stats.measured / measured_s : 0.0) << ",\n"
+         << "  \"latency_ms\": {";
+    for (int i = 0; i < STAGE_COUNT; i++) {
+        const LatencyHistogram& histogram = stats.stages[i];
+        json << (i == 0 ? "\n" : ",\n")
+             << "    \"" << STAGE_NAMES[i] << "\": {\"count\": " << histogram.get_count()
+             << ", \"mean\": " << histogram.get_mean()
+             << ", \"p50\": " << histogram.percentile(50.0)
+             << ", \"p95\": " << histogram.percentile(95.0)
+             << ", \"p99\": " << histogram.percentile(99.0)
+             << ", \"max\": " << histogram.get_max() << "}";
+    }
+    json << "\n  },\n"
+         << "  \"memory\": {\"start_rss_bytes\": " << start_rss
+         << ", \"peak_rss_bytes\": " << peak_rss
+         << ", \"steady_rss_bytes\": " << steady_rss
+         << ", \"final_rss_bytes\": " << final_rss << "},\n"
+         << "  \"allocations\": {\"tracked\": " << (HARNESS_TRACK_ALLOCATIONS ? "true" : "false")
+         << ", \"measured\": " << measured_allocations
+         << ", \"per_request\": " << (stats.measured > 0 ? static_cast<double>(measured_allocations) / stats.measured : 0.0)
+         << ", \"live_growth\": " << live_growth << "},\n"
+         << "  \"samples\": [";
+    for (size_t i = 0; i < samples.size(); i++) {
+        const Sample& sample = samples[i];
+        json << (i == 0 ? "\n" : ",\n")
+             << "    {\"t\": " << sample.t_s
+             << ", \"warmup\": " << (sample.warmup ? "true" : "false")
+             << ", \"completed\": " << sample.completed
+             << ", \"throughput_rps\": " << sample.throughput
+             << ", \"p50_ms\": " << sample.p50_ms
+             << ", \"p99_ms\": " << sample.p99_ms
+             << ", \"rss_bytes\": " << sample.rss_bytes
+             << ", \"heap_bytes\": " << sample.heap_bytes
+             << ", \"allocations\": " << sample.allocations
+             << ", \"frees\": " << sample.frees
+             << ", \"cpu_mhz\": " << sample.cpu_mhz << "}";
+    }
+    json << "\n  ]\n}\n";
+    return json.str();
+}
+
+void print_usage() {
+    std::cerr << "usage: diff_load_harness --input <dir> [--model <tflite>] [--stub-objects N]\n"
+                 "                         [--stub-latency MS] [--concurrency N] [--rate RPS]\n"
+                 "                         [--max-queue N] [--duration S] [--warmup S] [--requests N]\n"
+                 "                         [--sample-interval S] [--diff-count N] [--difficulty N]\n"
+                 "                         [--time-budget MS] [--seed N] [--report FILE]\n";
+}
+
+bool parse_options(int argc, char** argv, HarnessOptions& options) {
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (i + 1 >= argc) {
+            std::cerr << "missing value for " << arg << "\n";
+            return false;
+        }
+        const char* value = argv[++i];
+        if (arg == "--input") options.input_dir = value;
+        else if (arg == "--model") options.model_path = value;
+        else if (arg == "--stub-objects") options.stub_objects = std::atoi(value);
+        else if (arg == "--stub-latency") options.stub_latency_ms = std::atof(value);
+        else if (arg == "--concurrency") options.concurrency = std::atoi(value);
+        else if (arg == "--rate") options.rate = std::atof(value);
+        else if (arg == "--max-queue") options.max_queue = static_cast<size_t>(std::strtoull(value, nullptr, 10));
+        else if (arg == "--duration") options.duration_s = std::atof(value);
+        else if (arg == "--warmup") options.warmup_s = std::atof(value);
+        else if (arg == "--requests") options.max_requests = std::strtoull(value, nullptr, 10);
+        else if (arg == "--sample-interval") options.sample_interval_s = std::atof(value);
+        else if (arg == "--diff-count") options.diff_count = std::atoi(value);
+        else if (arg == "--difficulty") options.difficulty = std::atoi(value);
+        else if (arg == "--time-budget") options.time_budget_ms = std::atof(value);
+        else if (arg == "--report") options.report_path = value;
+        else if (arg == "--seed") {
+            options.seed = static_cast<uint32_t>(std::strtoul(value, nullptr, 10));
+            options.has_seed = true;
+        } else {
+            std::cerr << "unknown option " << arg << "\n";
+            return false;
+        }
+    }
+
+    if (options.input_dir.empty()) {
+        return false;
+    }
+
+    // 与DiffDetector相同的参数范围
+    options.diff_count = std::max(5, std::min(10, options.diff_count));
+    options.difficulty = std::max(1, std::min(10, options.difficulty));
+    options.concurrency = std::max(1, options.concurrency);
+    options.duration_s = std::max(0.1, options.duration_s);
+    options.warmup_s = std::max(0.0, options.warmup_s);
+    options.sample_interval_s = std::max(0.05, options.sample_interval_s);
+    options.max_queue = std::max<size_t>(1, options.max_queue);
+    return true;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    HarnessOptions options;
+    if (!parse_options(argc, argv, options)) {
+        print_usage();
+        return 2;
+    }
+
+    std::error_code error;
+    if (!fs::is_directory(options.input_dir, error)) {
+        std::cerr << "input directory not found: " << options.input_dir << "\n";
+        return 2;
+    }
+
+    // 语料预先读入内存，测量不受磁盘影响
+    std::vector<fs::path> files;
+    for (const auto& entry : fs::directory_iterator(options.input_dir)) {
+        if (entry.is_regular_file() && is_image_file(entry.path())) {
+            files.push_back(entry.path());
+        }
+    }
+    std::sort(files.begin(), files.end());
+    std::vector<std::vector<uint8_t>> corpus(files.size());
+    for (size_t i = 0; i < files.size(); i++) {
+        if (!read_file(files[i], corpus[i])) {
+            std::cerr << "cannot read " << files[i] << "\n";
+            return 2;
+        }
+    }
+    if (corpus.empty()) {
+        std::cerr << "no images in " << options.input_dir << "\n";
+        return 2;
+    }
+
+    std::unique_ptr<HarnessDetector> detector;
+    if (options.model_path.empty()) {
+        detector = std::make_unique<StubDetector>(options.stub_objects, options.stub_latency_ms);
+    } else {
+        auto model_detector = std::make_unique<ModelDetector>();
+        if (!model_detector->initialize(options.model_path)) {
+            std::cerr << "failed to load model: " << options.model_path << "\n";
+            return 1;
+        }
+        detector = std::move(model_detector);
+    }
+
+    // 与游戏内一致：并发来自多个生成线程，关闭OpenCV内部线程
+    cv::setNumThreads(1);
+
+    std::vector<std::unique_ptr<HarnessWorker>> workers;
+    for (int i = 0; i < options.concurrency; i++) {
+        workers.push_back(std::make_unique<HarnessWorker>(options, *detector, i));
+    }
+
+    HarnessStats stats;
+    std::vector<Sample> samples;
+    std::atomic<bool> stopping(false);
+    std::atomic<uint64_t> issued(0);
+    size_t start_rss = read_rss_bytes();
+
+    auto start = Clock::now();
+    auto measure_start = start + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(options.warmup_s));
+    auto end = measure_start + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(options.duration_s));
+
+    // 领取下一个请求号，超出请求上限时返回false
+    auto claim_request = [&](uint64_t& number) {
+        number = issued.fetch_add(1);
+        return options.max_requests == 0 || number < options.max_requests;
+    };
+
+    auto run_request = [&](HarnessWorker& worker, size_t image, Clock::time_point scheduled) {
+        double stage_ms[STAGE_COUNT];
+        if (worker.process(corpus[image], scheduled, stage_ms)) {
+            stats.record(stage_ms, scheduled >= measure_start);
+        } else {
+            stats.record_failure();
+        }
+    };
+
+    RequestQueue queue(options.max_queue);
+    std::vector<std::thread> threads;
+    for (auto& worker : workers) {
+        threads.emplace_back([&, worker = worker.get()] {
+            if (options.rate > 0.0) {
+                Request request;
+                while (queue.pop(request)) {
+                    run_request(*worker, request.image, request.scheduled);
+                }
+            } else {
+                // 闭环：完成一个立即发出下一个
+                uint64_t number;
+                while (!stopping.load() && Clock::now() < end && claim_request(number)) {
+                    run_request(*worker, number % corpus.size(), Clock::now());
+                }
+            }
+        });
+    }
+
+    // 开环：按固定间隔发出请求，计划时间作为延迟起点，避免协同遗漏
+    std::thread dispatcher;
+    if (options.rate > 0.0) {
+        dispatcher = std::thread([&] {
+            uint64_t number;
+            while (!stopping.load() && claim_request(number)) {
+                auto due = start + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(number / options.rate));
+                if (due >= end) {
+                    break;
+                }
+                std::this_thread::sleep_until(due);
+                if (!queue.push({ number % corpus.size(), due })) {
+                    stats.record_drop();
+                }
+            }
+            queue.close();
+        });
+    }
+
+    // 采样：按固定间隔记录吞吐量、延迟和内存
+    auto next_sample = start;
+    uint64_t previous_completed = 0;
+    while (true) {
+        next_sample += std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(options.sample_interval_s));
+        std::this_thread::sleep_until(std::min(next_sample, end));
+        auto now = Clock::now();
+
+        Sample sample;
+        uint64_t interval_count = 0;
+        stats.take_interval(sample.completed, sample.p50_ms, sample.p99_ms, interval_count);
+        double interval_s = options.sample_interval_s;
+        if (!samples.empty()) {
+            interval_s = std::max(1e-3, std::chrono::duration<double>(now - start).count() - samples.back().t_s);
+        }
+        sample.t_s = std::chrono::duration<double>(now - start).count();
+        sample.warmup = now < measure_start;
+        sample.throughput = (sample.completed - previous_completed) / interval_s;
+        sample.rss_bytes = read_rss_bytes();
+        sample.heap_bytes = read_heap_bytes();
+        sample.allocations = allocation_count.load(std::memory_order_relaxed);
+        sample.frees = free_count.load(std::memory_order_relaxed);
+        sample.cpu_mhz = read_cpu_mhz();
+        previous_completed = sample.completed;
+        samples.push_back(sample);
+
+        std::cerr << "t=" << static_cast<int>(sample.t_s) << "s completed=" << sample.completed
+                  << " rps=" << sample.throughput << " p99=" << sample.p99_ms << "ms rss="
+                  << sample.rss_bytes / (1024 * 1024) << "MB\n";
+
+        bool exhausted = options.max_requests > 0 && stats.get_finished() >= options.max_requests;
+        if (now >= end || exhausted) {
+            break;
+        }
+    }
+
+    stopping.store(true);
+    if (dispatcher.joinable()) {
+        dispatcher.join();
+    }
+    queue.close();
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    // 测量阶段结束前发出、结束后才完成的请求也计入统计，测量时长相应延长到最后一次完成
+    auto measured_end = std::min(Clock::now(), end);
+    if (stats.measured > 0) {
+        measured_end = std::max(measured_end, stats.last_measured);
+    }
+    double measured_s = std::max(0.0, std::chrono::duration<double>(measured_end - measure_start).count());
+    size_t peak_rss = read_peak_rss_bytes();
+    size_t final_rss = read_rss_bytes();
+
+    std::string report = report_to_json(options, corpus.size(), stats, samples, measured_s, start_rss, peak_rss, final_rss);
+    std::ofstream file(options.report_path, std::ios::binary);
+    file << report;
+    if (!file) {
+        std::cerr << "failed to write report: " << options.report_path << "\n";
+        return 1;
+    }
+
+    std::cout << stats.measured << " requests measured over " << measured_s << " s ("
+              << (measured_s > 0.0 ? stats.measured / measured_s : 0.0) << " rps), total p99 "
+              << stats.stages[STAGE_TOTAL].percentile(99.0) << " ms, peak RSS "
+              << peak_rss / (1024 * 1024) << " MB, report written to " << options.report_path << "\n";
+    return stats.failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,561 @@
+// 谜题包批量生成工具
+// 不依赖Godot运行时，直接使用DiffGenerator/YoloDetector，在所有核心上并行处理一个目录中的图像
+//
+// 用法: diff_pack_builder --input <目录> --output <目录> [选项]
+//   --model <路径>          YOLO模型（.tflite），省略时不做检测，差异区域随机选择
+//   --jobs <N>              工作线程数，默认为CPU核心数
+//   --queue <N>             待处理队列上限，默认为工作线程数的2倍
+//   --diff-count <N>        每张图像的差异数量 (5-10)，默认7
+//   --difficulty <N>        难度 (1-10)，默认5
+//   --calibration <N>       感知校准最大迭代次数，默认3
+//   --time-budget <毫秒>    每张图像的生成时间预算，默认不限制
+//   --seed <N>              随机种子，与文件名组合后得到每张图像的种子，使结果可复现
+//   --format <pack|files>   输出格式，默认pack
+//   --pack-name <文件名>    谜题包文件名，默认puzzles.dpack
+//   --reference-originals   谜题包中只记录原图路径，不嵌入原图
+//   --raw-patches           谜题包中的补丁不做PNG压缩
+//
+// pack格式把所有谜题写入一个可内存映射的谜题包（见puzzle_pack.h），以文件名（不含扩展名）为谜题名称；
+// files格式为每张图像输出<名称>.diff.png（修改后图像）和<名称>.json（差异数据，字段与get_diff_data一致）。
+// 两种格式都会在输出目录写入summary.json，记录每张图像各阶段耗时和失败原因。
+
+#include "diff_generator.h"
+#include "instance_label_map.h"
+#include "yolo_detector.h"
+#include "cpu_kernels.h"
+#include "puzzle_pack.h"
+
+#include <opencv2/core.hpp>
+#include <opencv2/imgcodecs.hpp>
+#include <opencv2/imgproc.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cctype>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace godot;
+namespace fs = std::filesystem;
+
+namespace {
+
+struct BuilderOptions {
+    fs::path input_dir;
+    fs::path output_dir;
+    std::string model_path;
+    int jobs = 0;
+    int queue_size = 0;
+    int diff_count = 7;
+    int difficulty = 5;
+    int calibration_iterations = 3;
+    double time_budget_ms = 0.0;
+    uint32_t seed = 0;
+    bool has_seed = false;
+    bool write_pack = true;
+    std::string pack_name = "puzzles.dpack";
+    bool embed_originals = true;
+    bool compress_patches = true;
+};
+
+// 所有工作线程共享的谜题包写入器，编码在工作线程中并行完成，只有追加写入需要加锁
+struct PackSink {
+    std::mutex mutex;
+    PuzzlePackWriter writer;
+};
+
+// 单张图像的处理结果
+struct ImageResult {
+    std::string file;
+    bool ok = false;
+    std::string error;
+    int diff_count = 0;
+    int detections = 0;
+    double decode_ms = 0.0;
+    double detect_ms = 0.0;
+    double generate_ms = 0.0;
+    double write_ms = 0.0;
+    double total_ms = 0.0;
+};
+
+// 有界任务队列：队列满时生产者阻塞，关闭后消费者取完剩余任务即退出
+class WorkQueue {
+public:
+    explicit WorkQueue(size_t capacity) : capacity(capacity), closed(false) {}
+
+    void push(size_t item) {
+        std::unique_lock<std::mutex> lock(mutex);
+        not_full.wait(lock, [this] { return items.size() < capacity; });
+        items.push_back(item);
+        not_empty.notify_one();
+    }
+
+    bool pop(size_t& item) {
+        std::unique_lock<std::mutex> lock(mutex);
+        not_empty.wait(lock, [this] { return closed || !items.empty(); });
+        if (items.empty()) {
+            return false;
+        }
+        item = items.front();
+        items.pop_front();
+        not_full.notify_one();
+        return true;
+    }
+
+    void close() {
+        std::lock_guard<std::mutex> lock(mutex);
+        closed = true;
+        not_empty.notify_all();
+    }
+
+private:
+    size_t capacity;
+    bool closed;
+    std::deque<size_t> items;
+    std::mutex mutex;
+    std::condition_variable not_full;
+    std::condition_variable not_empty;
+};
+
+double elapsed_ms(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+std::string json_escape(const std::string& text) {
+    std::string escaped;
+    escaped.reserve(text.size() + 2);
+    for (char c : text) {
+        switch (c) {
+            case '"': escaped += "\\\""; break;
+            case '\\': escaped += "\\\\"; break;
+            case '\n': escaped += "\\n"; break;
+            case '\t': escaped += "\\t"; break;
+            default:
+                if (static_cast<unsigned char>(c) < 0x20) {
+                    char buffer[8];
+                    std::snprintf(buffer, sizeof(buffer), "\\u%04x", c);
+                    escaped += buffer;
+                } else {
+                    escaped += c;
+                }
+        }
+    }
+    return escaped;
+}
+
+// FNV-1a，用于由文件名派生每张图像的种子
+uint32_t hash_name(const std::string& name) {
+    uint32_t hash = 2166136261u;
+    for (char c : name) {
+        hash = (hash ^ static_cast<uint8_t>(c)) * 16777619u;
+    }
+    return hash;
+}
+
+bool is_image_file(const fs::path& path) {
+    std::string extension = path.extension().string();
+    std::transform(extension.begin(), extension.end(), extension.begin(),
+                   [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+    return extension == ".jpg" || extension == ".jpeg" || extension == ".png" ||
+           extension == ".bmp" || extension == ".webp";
+}
+
+// 差异数据，字段与DiffDetector::get_diff_data一致
+std::string diffs_to_json(const std::string& source, const cv::Size& size, const std::vector<DiffInfo>& diffs) {
+    std::ostringstream json;
+    json << "{\n  \"source\": \"" << json_escape(source) << "\",\n"
+         << "  \"width\": " << size.width << ",\n  \"height\": " << size.height << ",\n"
+         << "  \"diffs\": [";
+    for (size_t i = 0; i < diffs.size(); i++) {
+        const DiffInfo& diff = diffs[i];
+        json << (i == 0 ? "\n" : ",\n")
+             << "    {\"position\": [" << diff.position.x << ", " << diff.position.y << "], "
+             << "\"size\": " << (diff.size.width + diff.size.height) / 2.0f << ", "
+             << "\"algorithm_id\": " << diff.algorithm_id << ", "
+             << "\"region\": [" << diff.region.x << ", " << diff.region.y << ", "
+             << diff.region.width << ", " << diff.region.height << "], "
+             << "\"perceptual_score\": " << diff.perceptual_score << ", "
+             << "\"intensity_scale\": " << diff.intensity_scale << "}";
+    }
+    json << "\n  ]\n}\n";
+    return json.str();
+}
+
+bool read_file(const fs::path& path, std::vector<uint8_t>& bytes) {
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    if (!file) {
+        return false;
+    }
+    std::streamsize length = file.tellg();
+    file.seekg(0);
+    bytes.resize(static_cast<size_t>(length));
+    return static_cast<bool>(file.read(reinterpret_cast<char*>(bytes.data()), length));
+}
+
+bool write_text_file(const fs::path& path, const std::string& text) {
+    std::ofstream file(path, std::ios::binary);
+    file << text;
+    return static_cast<bool>(file);
+}
+
+// OpenCV按BGR(A)解码，生成器与检测器使用RGB(A)
+bool decode_image(const fs::path& path, cv::Mat& image, std::string& error) {
+    cv::Mat decoded = cv::imread(path.string(), cv::IMREAD_UNCHANGED);
+    if (decoded.empty()) {
+        error = "decode failed";
+        return false;
+    }
+    if (decoded.depth() != CV_8U) {
+        error = "unsupported bit depth (expected 8-bit)";
+        return false;
+    }
+
+    switch (decoded.channels()) {
+        case 1: image = decoded; break;
+        case 3: cv::cvtColor(decoded, image, cv::COLOR_BGR2RGB); break;
+        case 4: cv::cvtColor(decoded, image, cv::COLOR_BGRA2RGBA); break;
+        default:
+            error = "unsupported channel count";
+            return false;
+    }
+    return true;
+}
+
+bool encode_image(const fs::path& path, const cv::Mat& image) {
+    cv::Mat output;
+    switch (image.channels()) {
+        case 3: cv::cvtColor(image, output, cv::COLOR_RGB2BGR); break;
+        case 4: cv::cvtColor(image, output, cv::COLOR_RGBA2BGRA); break;
+        default: output = image; break;
+    }
+    return cv::imwrite(path.string(), output);
+}
+
+// 工作线程：每个线程拥有独立的检测器和生成器，互不加锁
+class PackWorker {
+public:
+    PackWorker(const BuilderOptions& options, PackSink* sink) : options(options), sink(sink) {
+        generator.set_calibration_iterations(options.calibration_iterations);
+    }
+
+    bool initialize() {
+        if (options.model_path.empty()) {
+            return true;
+        }
+        detector = std::make_unique<YoloDetector>();
+        return detector->initialize(options.model_path);
+    }
+
+    void process(const fs::path& path, ImageResult& result) {
+        auto start = std::chrono::steady_clock::now();
+        result.file = path.filename().string();
+
+        cv::Mat image;
+        if (!decode_image(path, image, result.error)) {
+            result.total_ms = elapsed_ms(start);
+            return;
+        }
+        result.decode_ms = elapsed_ms(start);
+
+        DetectionSet detections;
+        if (detector) {
+            auto detect_start = std::chrono::steady_clock::now();
+            cv::Mat detector_input;
+            if (!YoloDetector::prepare_input(image, detector_input) || !detector->detect(detector_input)) {
+                result.error = "detection failed";
+                result.total_ms = elapsed_ms(start);
+                return;
+            }
+            detections = detector->get_detections();
+            result.detections = static_cast<int>(detections.size());
+            result.detect_ms = elapsed_ms(detect_start);
+        }
+
+        auto generate_start = std::chrono::steady_clock::now();
+        if (options.has_seed) {
+            generator.set_seed(options.seed ^ hash_name(result.file));
+        }
+        cv::Mat modified = image.clone();
+        labels.build(modified.size(), detections);
+        std::vector<DiffInfo> diffs;
+        if (!generator.generate_diffs(modified, detections, options.diff_count, options.difficulty,
+                                      diffs, options.time_budget_ms, &labels)) {
+            result.error = "generation failed";
+            result.total_ms = elapsed_ms(start);
+            return;
+        }
+        result.diff_count = static_cast<int>(diffs.size());
+        result.generate_ms = elapsed_ms(generate_start);
+
+        auto write_start = std::chrono::steady_clock::now();
+        std::string stem = path.stem().string();
+        if (sink) {
+            // 原图以文件字节嵌入（不重新编码），或记录相对于包文件的路径
+            std::vector<uint8_t> original_file;
+            if (options.embed_originals && !read_file(path, original_file)) {
+                result.error = "read failed";
+                result.total_ms = elapsed_ms(start);
+                return;
+            }
+            std::string source = fs::relative(path, options.output_dir).generic_string();
+
+            EncodedPuzzle puzzle;
+            if (!PuzzlePackWriter::encode_puzzle(stem, image, modified, diffs, std::move(original_file),
+                                                 source, options.compress_patches, puzzle)) {
+                result.error = "encode failed";
+                result.total_ms = elapsed_ms(start);
+                return;
+            }
+            // 空区域的差异不写入包内
+            result.diff_count = static_cast<int>(puzzle.diffs.size());
+
+            std::lock_guard<std::mutex> lock(sink->mutex);
+            if (!sink->writer.add_puzzle(puzzle)) {
+                result.error = "write failed";
+                result.total_ms = elapsed_ms(start);
+                return;
+            }
+        } else if (!encode_image(options.output_dir / (stem + ".diff.png"), modified) ||
+                   !write_text_file(options.output_dir / (stem + ".json"),
+                                    diffs_to_json(path.filename().string(), image.size(), diffs))) {
+            result.error = "write failed";
+            result.total_ms = elapsed_ms(start);
+            return;
+        }
+        result.write_ms = elapsed_ms(write_start);
+
+        result.ok = true;
+        result.total_ms = elapsed_ms(start);
+    }
+
+private:
+    const BuilderOptions& options;
+    PackSink* sink;                 // 为空时按files格式输出
+    std::unique_ptr<YoloDetector> detector;
+    DiffGenerator generator;
+    InstanceLabelMap labels;        // 每个工作线程复用同一块标签图内存
+};
+
+std::string summary_to_json(const BuilderOptions& options, const std::vector<ImageResult>& results,
+                            double wall_ms) {
+    int succeeded = 0;
+    double stage_totals[4] = {};
+    for (const auto& result : results) {
+        if (result.ok) {
+            succeeded++;
+        }
+        stage_totals[0] += result.decode_ms;
+        stage_totals[1] += result.detect_ms;
+        stage_totals[2] += result.generate_ms;
+        stage_totals[3] += result.write_ms;
+    }
+
+    std::ostringstream json;
+    json << "{\n"
+         << "  \"images\": " << results.size() << ",\n"
+         << "  \"succeeded\": " << succeeded << ",\n"
+         << "  \"failed\": " << results.size() - succeeded << ",\n"
+         << "  \"jobs\": " << options.jobs << ",\n"
+         << "  \"cpu_kernels\": \"" << get_cpu_kernels().name << "\",\n"
+         << "  \"wall_ms\": " << wall_ms << ",\n"
+         << "  \"images_per_second\": " << (wall_ms > 0.0 ? results.size() * 1000.0 / wall_ms : 0.0) << ",\n"
+         << "  \"stage_ms_total\": {\"decode\": " << stage_totals[0] << ", \"detect\": " << stage_totals[1]
+         << ", \"generate\": " << stage_totals[2] << ", \"write\": " << stage_totals[3] << "},\n"
+         << "  \"results\": [";
+    for (size_t i = 0; i < results.size(); i++) {
+        const ImageResult& result = results[i];
+        json << (i == 0 ? "\n" : ",\n")
+             << "    {\"file\": \"" << json_escape(result.file) << "\", "
+             << "\"ok\": " << (result.ok ? "true" : "false") << ", ";
+        if (!result.ok) {
+            json << "\"error\": \"" << json_escape(result.error) << "\", ";
+        }
+        json << "\"diffs\": " << result.diff_count << ", "
+             << "\"detections\": " << result.detections << ", "
+             << "\"decode_ms\": " << result.decode_ms << ", "
+             << "\"detect_ms\": " << result.detect_ms << ", "
+             << "\"generate_ms\": " << result.generate_ms << ", "
+             << "\"write_ms\": " << result.write_ms << ", "
+             << "\"total_ms\": " << result.total_ms << "}";
+    }
+    json << "\n  ]\n}\n";
+    return json.str();
+}
+
+void print_usage() {
+    std::cerr << "usage: diff_pack_builder --input <dir> --output <dir> [--model <tflite>] [--jobs N]\n"
+                 "                         [--queue N] [--diff-count N] [--difficulty N]\n"
+                 "                         [--calibration N] [--time-budget MS] [--seed N]\n"
+                 "                         [--format pack|files] [--pack-name FILE]\n"
+                 "                         [--reference-originals] [--raw-patches]\n";
+}
+
+bool parse_options(int argc, char** argv, BuilderOptions& options) {
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--reference-originals") {
+            options.embed_originals = false;
+            continue;
+        }
+        if (arg == "--raw-patches") {
+            options.compress_patches = false;
+            continue;
+        }
+        if (i + 1 >= argc) {
+            std::cerr << "missing value for " << arg << "\n";
+            return false;
+        }
+        const char* value = argv[++i];
+        if (arg == "--input") options.input_dir = value;
+        else if (arg == "--output") options.output_dir = value;
+        else if (arg == "--model") options.model_path = value;
+        else if (arg == "--jobs") options.jobs = std::atoi(value);
+        else if (arg == "--queue") options.queue_size = std::atoi(value);
+        else if (arg == "--diff-count") options.diff_count = std::atoi(value);
+        else if (arg == "--difficulty") options.difficulty = std::atoi(value);
+        else if (arg == "--calibration") options.calibration_iterations = std::atoi(value);
+        else if (arg == "--time-budget") options.time_budget_ms = std::atof(value);
+        else if (arg == "--format") options.write_pack = std::string(value) != "files";
+        else if (arg == "--pack-name") options.pack_name = value;
+        else if (arg == "--seed") {
+            options.seed = static_cast<uint32_t>(std::strtoul(value, nullptr, 10));
+            options.has_seed = true;
+        } else {
+            std::cerr << "unknown option " << arg << "\n";
+            return false;
+        }
+    }
+
+    if (options.input_dir.empty() || options.output_dir.empty()) {
+        return false;
+    }
+
+    // 与DiffDetector相同的参数范围
+    options.diff_count = std::max(5, std::min(10, options.diff_count));
+    options.difficulty = std::max(1, std::min(10, options.difficulty));
+    if (options.jobs <= 0) {
+        options.jobs = std::max(1u, std::thread::hardware_concurrency());
+    }
+    if (options.queue_size <= 0) {
+        options.queue_size = options.jobs * 2;
+    }
+    return true;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    BuilderOptions options;
+    if (!parse_options(argc, argv, options)) {
+        print_usage();
+        return 2;
+    }
+
+    std::error_code error;
+    if (!fs::is_directory(options.input_dir, error)) {
+        std::cerr << "input directory not found: " << options.input_dir << "\n";
+        return 2;
+    }
+    fs::create_directories(options.output_dir, error);
+    if (error) {
+        std::cerr << "cannot create output directory: " << options.output_dir << "\n";
+        return 2;
+    }
+
+    std::vector<fs::path> files;
+    for (const auto& entry : fs::directory_iterator(options.input_dir)) {
+        if (entry.is_regular_file() && is_image_file(entry.path())) {
+            files.push_back(entry.path());
+        }
+    }
+    std::sort(files.begin(), files.end());
+    if (files.empty()) {
+        std::cerr << "no images in " << options.input_dir << "\n";
+        return 2;
+    }
+
+    // 已按图像并行，关闭OpenCV内部线程避免过度订阅
+    cv::setNumThreads(1);
+    options.jobs = std::min<int>(options.jobs, static_cast<int>(files.size()));
+
+    std::unique_ptr<PackSink> sink;
+    fs::path pack_path = options.output_dir / options.pack_name;
+    if (options.write_pack) {
+        sink = std::make_unique<PackSink>();
+        if (!sink->writer.open(pack_path.string())) {
+            std::cerr << "cannot create pack: " << pack_path << "\n";
+            return 2;
+        }
+    }
+
+    // 模型在开始前加载，失败时立即退出
+    std::vector<std::unique_ptr<PackWorker>> workers;
+    for (int i = 0; i < options.jobs; i++) {
+        workers.push_back(std::make_unique<PackWorker>(options, sink.get()));
+        if (!workers.back()->initialize()) {
+            std::cerr << "failed to load model: " << options.model_path << "\n";
+            return 1;
+        }
+    }
+    if (options.model_path.empty()) {
+        std::cerr << "no --model given, diff regions will be chosen at random\n";
+    }
+
+    std::vector<ImageResult> results(files.size());
+    WorkQueue queue(options.queue_size);
+    std::atomic<size_t> completed(0);
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for (auto& worker : workers) {
+        threads.emplace_back([&, worker = worker.get()] {
+            size_t index;
+            while (queue.pop(index)) {
+                worker->process(files[index], results[index]);
+                size_t done = ++completed;
+                if (!results[index].ok) {
+                    std::cerr << results[index].file << ": " << results[index].error << "\n";
+                }
+                if (done % 100 == 0) {
+                    std::cerr << done << "/" << files.size() << "\n";
+                }
+            }
+        });
+    }
+
+    for (size_t i = 0; i < files.size(); i++) {
+        queue.push(i);
+    }
+    queue.close();
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    if (sink && !sink->writer.finish()) {
+        std::cerr << "failed to finish pack: " << pack_path << "\n";
+        return 1;
+    }
+    double wall_ms = elapsed_ms(start);
+
+    if (!write_text_file(options.output_dir / "summary.json", summary_to_json(options, results, wall_ms))) {
+        std::cerr << "failed to write summary.json\n";
+        return 1;
+    }
+
+    size_t failed = std::count_if(results.begin(), results.end(), [](const ImageResult& r) { return !r.ok; });
+    std::cout << files.size() - failed << "/" << files.size() << " puzzles built in "
+              << wall_ms / 1000.0 << " s with " << options.jobs << " jobs\n";
+    return failed == 0 ? 0 : 1;
+}
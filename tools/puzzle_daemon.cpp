@@ -0,0 +1,595 @@
+// 谜题生成守护进程（Linux）
+// 在Unix域套接字上为多个客户端（关卡编辑器、QA机器人、每日挑战后端等）生成谜题。
+// 模型只加载一次并常驻；各客户端的检测请求由一个推理线程在短时间窗口内合并处理，
+// 相同图像只推理一次，结果按文件内容缓存，之后的请求直接复用。
+// 响应为紧凑的二进制配方（差异记录）或区域补丁，格式见daemon_protocol.h。
+//
+// 用法: diff_puzzle_daemon [选项]
+//   --socket <路径>          监听的套接字路径，默认/tmp/diff_detector.sock
+//   --model <路径>           YOLO模型（.tflite），省略时不做检测，差异区域随机选择
+//   --max-clients <N>        同时连接的客户端上限，默认32；超出时新连接收到BUSY消息后被关闭
+//   --batch-window <毫秒>    推理线程收到第一个请求后等待更多请求的时间，默认5
+//   --max-batch <N>          一批最多处理的检测请求数，默认8
+//   --cache-entries <N>      检测结果缓存的图像数，默认256，0表示不缓存
+//   --calibration <N>        感知校准最大迭代次数，默认3
+//
+// 每个连接由一个线程处理，线程拥有独立的生成器；同一连接上的请求按顺序处理。
+// 收到SIGINT或SIGTERM时关闭所有连接并删除套接字文件。
+
+#include "daemon_protocol.h"
+#include "image_decode.h"
+#include "diff_generator.h"
+#include "instance_label_map.h"
+#include "yolo_detector.h"
+#include "puzzle_pack.h"
+
+#include <opencv2/core.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+using namespace godot;
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+struct DaemonOptions {
+    std::string socket_path = DAEMON_DEFAULT_SOCKET;
+    std::string model_path;
+    int max_clients = 32;
+    double batch_window_ms = 5.0;
+    int max_batch = 8;
+    size_t cache_entries = 256;
+    int calibration_iterations = 3;
+};
+
+// 信号处理函数只能使用异步信号安全的调用
+std::atomic<bool> stop_requested(false);
+int listen_socket = -1;
+
+void handle_signal(int) {
+    stop_requested.store(true);
+    if (listen_socket >= 0) {
+        shutdown(listen_socket, SHUT_RDWR);
+    }
+}
+
+double elapsed_ms(Clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+// FNV-1a，作为检测缓存的键
+uint64_t hash_bytes(const uint8_t* data, size_t size) {
+    uint64_t hash = 1469598103934665603ull;
+    for (size_t i = 0; i < size; i++) {
+        hash = (hash ^ data[i]) * 1099511628211ull;
+    }
+    return hash ^ size;
+}
+
+/**
+ * 检测结果缓存（LRU）
+ * 以图像文件内容的哈希为键，同一张图像的后续请求不再推理
+ */
+class DetectionCache {
+public:
+    explicit DetectionCache(size_t capacity) : capacity(capacity) {}
+
+    bool find(uint64_t key, DetectionSet& detections) {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = index.find(key);
+        if (it == index.end()) {
+            return false;
+        }
+        entries.splice(entries.begin(), entries, it->second);
+        detections = it->second->second;
+        return true;
+    }
+
+    void insert(uint64_t key, const DetectionSet& detections) {
+        if (capacity == 0) {
+            return;
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = index.find(key);
+        if (it != index.end()) {
+            entries.splice(entries.begin(), entries, it->second);
+            it->second->second = detections;
+            return;
+        }
+        entries.emplace_front(key, detections);
+        index[key] = entries.begin();
+        if (entries.size() > capacity) {
+            index.erase(entries.back().first);
+            entries.pop_back();
+        }
+    }
+
+private:
+    using Entry = std::pair<uint64_t, DetectionSet>;
+
+    size_t capacity;
+    std::mutex mutex;
+    std::list<Entry> entries;   // 最近使用的在前
+    std::unordered_map<uint64_t, std::list<Entry>::iterator> index;
+};
+
+/**
+ * 跨客户端的批量检测
+ * 连接线程在各自线程上完成输入转换后提交任务并等待；推理线程收到第一个任务后在窗口内继续收集，
+ * 然后一次处理整批：相同图像只推理一次，结果写入缓存。模型的推理接口一次只接受一张图像，
+ * 合并带来的收益是相同图像去重、模型常驻以及推理线程连续运行时缓存保持热状态。
+ */
+class DetectionBatcher {
+public:
+    DetectionBatcher(YoloDetector& detector, DetectionCache& cache, double window_ms, int max_batch)
+        : detector(detector), cache(cache), window_ms(window_ms), max_batch(std::max(1, max_batch)),
+          stopping(false), batches(0), batched_jobs(0), inferences(0), cache_hits(0) {
+        worker = std::thread([this] { run(); });
+    }
+
+    ~DetectionBatcher() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        queue_condition.notify_all();
+        worker.join();
+    }
+
+    /**
+     * 检测图像中的物体（线程安全，阻塞直到所在批次完成）
+     * @param key 图像文件内容的哈希
+     * @param cached 输出结果是否来自缓存
+     */
+    bool detect(uint64_t key, const cv::Mat& image, DetectionSet& detections, bool& cached) {
+        cached = cache.find(key, detections);
+        if (cached) {
+            cache_hits.fetch_add(1);
+            return true;
+        }
+
+        Job job;
+        job.key = key;
+        job.cached = false;
+        job.done = false;
+        job.success = false;
+        if (!YoloDetector::prepare_input(image, job.input)) {
+            return false;
+        }
+
+        std::unique_lock<std::mutex> lock(mutex);
+        if (stopping) {
+            return false;
+        }
+        job.enqueued = Clock::now();
+        queue.push_back(&job);
+        queue_condition.notify_all();
+        done_condition.wait(lock, [&job] { return job.done; });
+        detections = std::move(job.detections);
+        cached = job.cached;
+        return job.success;
+    }
+
+    uint64_t get_batches() const { return batches.load(); }
+    uint64_t get_batched_jobs() const { return batched_jobs.load(); }
+    uint64_t get_inferences() const { return inferences.load(); }
+    uint64_t get_cache_hits() const { return cache_hits.load(); }
+
+private:
+    struct Job {
+        uint64_t key;
+        cv::Mat input;
+        Clock::time_point enqueued;
+        DetectionSet detections;
+        bool cached;
+        bool done;
+        bool success;
+    };
+
+    YoloDetector& detector;
+    DetectionCache& cache;
+    double window_ms;
+    int max_batch;
+
+    std::mutex mutex;
+    std::condition_variable queue_condition;
+    std::condition_variable done_condition;
+    std::deque<Job*> queue;
+    bool stopping;
+    std::thread worker;
+
+    std::atomic<uint64_t> batches;
+    std::atomic<uint64_t> batched_jobs;
+    std::atomic<uint64_t> inferences;
+    std::atomic<uint64_t> cache_hits;
+
+    void run() {
+        std::vector<Job*> batch;
+        while (true) {
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                queue_condition.wait(lock, [this] { return stopping || !queue.empty(); });
+                if (queue.empty()) {
+                    return;
+                }
+
+                // 从第一个任务入队起等待一个窗口，批次满时立即处理
+                auto deadline = queue.front()->enqueued +
+                                std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double, std::milli>(window_ms));
+                queue_condition.wait_until(lock, deadline, [this] {
+                    return stopping || static_cast<int>(queue.size()) >= max_batch;
+                });
+
+                size_t count = std::min(queue.size(), static_cast<size_t>(max_batch));
+                batch.assign(queue.begin(), queue.begin() + count);
+                queue.erase(queue.begin(), queue.begin() + count);
+            }
+
+            process(batch);
+            batches.fetch_add(1);
+            batched_jobs.fetch_add(batch.size());
+
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                for (Job* job : batch) {
+                    job->done = true;
+                }
+            }
+            done_condition.notify_all();
+        }
+    }
+
+    void process(std::vector<Job*>& batch) {
+        // 按图像去重，每张不同的图像只推理一次
+        for (size_t i = 0; i < batch.size(); i++) {
+            Job* job = batch[i];
+            bool duplicate = false;
+            for (size_t j = 0; j < i; j++) {
+                if (batch[j]->key == job->key && batch[j]->success) {
+                    job->detections = batch[j]->detections;
+                    job->cached = true;
+                    job->success = true;
+                    duplicate = true;
+                    break;
+                }
+            }
+            if (duplicate) {
+                continue;
+            }
+
+            // 等待期间可能已有其它批次写入缓存
+            if (cache.find(job->key, job->detections)) {
+                job->cached = true;
+                job->success = true;
+                continue;
+            }
+
+            job->success = detector.detect(job->input);
+            inferences.fetch_add(1);
+            if (job->success) {
+                job->detections = detector.get_detections();
+                cache.insert(job->key, job->detections);
+            }
+        }
+    }
+};
+
+// 守护进程级别的统计
+struct DaemonStats {
+    std::atomic<uint64_t> requests{0};
+    std::atomic<uint64_t> failed{0};
+    std::atomic<int> clients{0};
+};
+
+/**
+ * 单个客户端连接
+ * 拥有独立的生成器和标签图，连接期间复用其素材缓存和开销模型
+ */
+class ClientSession {
+public:
+    ClientSession(const DaemonOptions& options, DetectionBatcher* batcher, DaemonStats& stats)
+        : options(options), batcher(batcher), stats(stats) {
+        generator.set_calibration_iterations(options.calibration_iterations);
+    }
+
+    void serve(int fd) {
+        DaemonMessageHeader header;
+        std::vector<uint8_t> payload;
+        std::vector<uint8_t> response;
+        while (!stop_requested.load() && daemon_read_message(fd, header, payload)) {
+            bool sent = false;
+            switch (header.type) {
+                case DAEMON_MESSAGE_GENERATE: {
+                    stats.requests.fetch_add(1);
+                    std::string error;
+                    if (generate(payload, response, error)) {
+                        sent = daemon_write_message(fd, DAEMON_MESSAGE_PUZZLE, header.request_id, response.data(), response.size());
+                    } else {
+                        stats.failed.fetch_add(1);
+                        sent = daemon_write_message(fd, DAEMON_MESSAGE_ERROR, header.request_id, error.data(), error.size());
+                    }
+                    break;
+                }
+                case DAEMON_MESSAGE_STATS: {
+                    std::string json = stats_to_json();
+                    sent = daemon_write_message(fd, DAEMON_MESSAGE_STATS, header.request_id, json.data(), json.size());
+                    break;
+                }
+                default: {
+                    std::string error = "unknown message type";
+                    sent = daemon_write_message(fd, DAEMON_MESSAGE_ERROR, header.request_id, error.data(), error.size());
+                    break;
+                }
+            }
+            if (!sent) {
+                break;
+            }
+        }
+    }
+
+private:
+    const DaemonOptions& options;
+    DetectionBatcher* batcher;
+    DaemonStats& stats;
+    DiffGenerator generator;
+    InstanceLabelMap labels;
+
+    bool generate(const std::vector<uint8_t>& payload, std::vector<uint8_t>& response, std::string& error) {
+        if (payload.size() <= sizeof(DaemonGenerateRequest)) {
+            error = "malformed generate request";
+            return false;
+        }
+        DaemonGenerateRequest request;
+        memcpy(&request, payload.data(), sizeof(request));
+        const uint8_t* file_data = payload.data() + sizeof(request);
+        size_t file_size = payload.size() - sizeof(request);
+
+        // 与DiffDetector相同的参数范围
+        int diff_count = std::max(5, std::min(10, static_cast<int>(request.diff_count)));
+        int difficulty = std::max(1, std::min(10, static_cast<int>(request.difficulty)));
+        bool recipe = request.result_mode == DAEMON_RESULT_RECIPE;
+
+        auto start = Clock::now();
+        cv::Mat image;
+        if (!decode_image_buffer(file_data, file_size, image)) {
+            error = "decode failed";
+            return false;
+        }
+
+        DaemonPuzzleHeader puzzle_header;
+        memset(&puzzle_header, 0, sizeof(puzzle_header));
+        puzzle_header.width = image.cols;
+        puzzle_header.height = image.rows;
+        puzzle_header.channels = image.channels();
+        puzzle_header.difficulty = difficulty;
+        puzzle_header.decode_ms = static_cast<float>(elapsed_ms(start));
+
+        auto detect_start = Clock::now();
+        DetectionSet detections;
+        if (batcher) {
+            bool cached = false;
+            if (!batcher->detect(hash_bytes(file_data, file_size), image, detections, cached)) {
+                error = "detection failed";
+                return false;
+            }
+            puzzle_header.flags |= DAEMON_PUZZLE_DETECTED | (cached ? DAEMON_PUZZLE_DETECTION_CACHED : 0);
+        }
+        puzzle_header.detect_ms = static_cast<float>(elapsed_ms(detect_start));
+
+        // 配方由客户端用reapply_diff重放，不使用实例标签图，保证重放结果与此处一致
+        auto generate_start = Clock::now();
+        if (request.flags & DAEMON_REQUEST_SEED) {
+            generator.set_seed(request.seed);
+        }
+        cv::Mat original = recipe ? cv::Mat() : image.clone();
+        if (!recipe) {
+            labels.build(image.size(), detections);
+        }
+        std::vector<DiffInfo> diffs;
+        if (!generator.generate_diffs(image, detections, diff_count, difficulty, diffs,
+                                      request.time_budget_ms, recipe ? nullptr : &labels)) {
+            error = "diff generation failed";
+            return false;
+        }
+        puzzle_header.generate_ms = static_cast<float>(elapsed_ms(generate_start));
+
+        if (recipe) {
+            encode_daemon_puzzle(puzzle_header, diffs, nullptr, response);
+            return true;
+        }
+
+        EncodedPuzzle encoded;
+        if (!PuzzlePackWriter::encode_puzzle(std::string(), original, image, diffs, std::vector<uint8_t>(),
+                                             std::string(), true, encoded)) {
+            error = "patch encoding failed";
+            return false;
+        }
+        encode_daemon_puzzle(puzzle_header, diffs, &encoded, response);
+        return true;
+    }
+
+    std::string stats_to_json() const {
+        std::ostringstream json;
+        json << "{\"clients\": " << stats.clients.load()
+             << ", \"requests\": " << stats.requests.load()
+             << ", \"failed\": " << stats.failed.load()
+             << ", \"model_loaded\": " << (batcher ? "true" : "false");
+        if (batcher) {
+            json << ", \"batches\": " << batcher->get_batches()
+                 << ", \"batched_requests\": " << batcher->get_batched_jobs()
+                 << ", \"inferences\": " << batcher->get_inferences()
+                 << ", \"cache_hits\": " << batcher->get_cache_hits();
+        }
+        json << "}";
+        return json.str();
+    }
+};
+
+// 连接线程，结束后由主循环回收
+struct ClientThread {
+    int fd;
+    std::thread thread;
+    std::shared_ptr<std::atomic<bool>> finished;
+};
+
+void print_usage() {
+    std::cerr << "usage: diff_puzzle_daemon [--socket PATH] [--model <tflite>] [--max-clients N]\n"
+                 "                          [--batch-window MS] [--max-batch N] [--cache-entries N]\n"
+                 "                          [--calibration N]\n";
+}
+
+bool parse_options(int argc, char** argv, DaemonOptions& options) {
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (i + 1 >= argc) {
+            std::cerr << "missing value for " << arg << "\n";
+            return false;
+        }
+        const char* value = argv[++i];
+        if (arg == "--socket") options.socket_path = value;
+        else if (arg == "--model") options.model_path = value;
+        else if (arg == "--max-clients") options.max_clients = std::atoi(value);
+        else if (arg == "--batch-window") options.batch_window_ms = std::atof(value);
+        else if (arg == "--max-batch") options.max_batch = std::atoi(value);
+        else if (arg == "--cache-entries") options.cache_entries = static_cast<size_t>(std::strtoull(value, nullptr, 10));
+        else if (arg == "--calibration") options.calibration_iterations = std::atoi(value);
+        else {
+            std::cerr << "unknown option " << arg << "\n";
+            return false;
+        }
+    }
+
+    options.max_clients = std::max(1, options.max_clients);
+    options.batch_window_ms = std::max(0.0, options.batch_window_ms);
+    options.max_batch = std::max(1, options.max_batch);
+    return true;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    DaemonOptions options;
+    if (!parse_options(argc, argv, options)) {
+        print_usage();
+        return 2;
+    }
+
+    // 模型在启动时加载一次，之后所有客户端共享
+    std::unique_ptr<YoloDetector> detector;
+    std::unique_ptr<DetectionCache> cache;
+    std::unique_ptr<DetectionBatcher> batcher;
+    if (!options.model_path.empty()) {
+        detector = std::make_unique<YoloDetector>();
+        if (!detector->initialize(options.model_path)) {
+            std::cerr << "failed to load model: " << options.model_path << "\n";
+            return 1;
+        }
+        cache = std::make_unique<DetectionCache>(options.cache_entries);
+        batcher = std::make_unique<DetectionBatcher>(*detector, *cache, options.batch_window_ms, options.max_batch);
+    }
+
+    std::string listen_error;
+    listen_socket = daemon_listen(options.socket_path, options.max_clients, listen_error);
+    if (listen_socket < 0) {
+        std::cerr << "cannot listen on " << options.socket_path << ": " << listen_error << "\n";
+        return 1;
+    }
+
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = handle_signal;
+    sigaction(SIGINT, &action, nullptr);
+    sigaction(SIGTERM, &action, nullptr);
+
+    // 并发来自多个连接，关闭OpenCV内部线程避免过度订阅
+    cv::setNumThreads(1);
+
+    std::cout << "listening on " << options.socket_path
+              << (batcher ? " (model loaded)" : " (no model, random regions)") << std::endl;
+
+    DaemonStats stats;
+    std::list<ClientThread> clients;
+    while (!stop_requested.load()) {
+        int fd = accept4(listen_socket, nullptr, nullptr, SOCK_CLOEXEC);
+
+        int accept_error = errno;
+
+        // 回收已结束的连接线程，描述符在join之后关闭
+        for (auto it = clients.begin(); it != clients.end();) {
+            if (it->finished->load()) {
+                it->thread.join();
+                daemon_close(it->fd);
+                it = clients.erase(it);
+            } else {
+                ++it;
+            }
+        }
+
+        if (fd < 0) {
+            if (accept_error == EINTR || accept_error == ECONNABORTED || accept_error == EPROTO) {
+                continue;
+            }
+            if (accept_error == EMFILE || accept_error == ENFILE || accept_error == ENOBUFS || accept_error == ENOMEM) {
+                // 描述符或内存暂时耗尽：等待连接结束释放资源后重试，不退出守护进程
+                std::cerr << "accept: " << strerror(accept_error) << ", retrying" << std::endl;
+                std::this_thread::sleep_for(std::chrono::milliseconds(100));
+                continue;
+            }
+            break;
+        }
+
+        if (static_cast<int>(clients.size()) >= options.max_clients) {
+            // 不等待请求，直接发送不对应任何请求的BUSY消息，客户端据此与连接断开区分
+            std::string error = "too many clients";
+            daemon_write_message(fd, DAEMON_MESSAGE_BUSY, 0, error.data(), error.size());
+            daemon_close(fd);
+            continue;
+        }
+
+        auto finished = std::make_shared<std::atomic<bool>>(false);
+        std::thread thread([fd, finished, &options, &batcher, &stats]() {
+            stats.clients.fetch_add(1);
+            ClientSession session(options, batcher.get(), stats);
+            session.serve(fd);
+            stats.clients.fetch_sub(1);
+            finished->store(true);
+        });
+        clients.push_back({ fd, std::move(thread), finished });
+    }
+
+    // 唤醒仍在等待请求的连接线程；描述符由主线程在join之后关闭
+    for (ClientThread& client : clients) {
+        shutdown(client.fd, SHUT_RDWR);
+    }
+    for (ClientThread& client : clients) {
+        client.thread.join();
+        daemon_close(client.fd);
+    }
+    batcher.reset();
+
+    daemon_close(listen_socket);
+    unlink(options.socket_path.c_str());
+    std::cout << stats.requests.load() << " requests served, " << stats.failed.load() << " failed" << std::endl;
+    return 0;
+}
@@ -0,0 +1,279 @@
+// 流式会话回放工具
+// 不依赖Godot运行时，把视频文件（或按文件名排序的帧图像目录）逐帧送入StreamSession，
+// 与DiffDetector::process_stream_frame相同：差异直接写入解码出的帧，检测只在需要时运行。
+// 用于在Linux上验证跟踪稳定性和每帧开销。
+//
+// 用法: diff_stream_replay --input <视频文件|帧目录> [选项]
+//   --model <路径>             YOLO模型（.tflite），省略时不做检测，差异区域随机选择
+//   --diff-count <N>           差异数量 (5-10)，默认7
+//   --difficulty <N>           难度 (1-10)，默认5
+//   --detect-interval <N>      每隔多少帧重新检测，默认30，<=0表示只在首帧和场景切换时检测
+//   --scene-threshold <比例>   场景切换阈值 (0-1)，默认0.2
+//   --search-margin <像素>     跟踪搜索范围，默认24
+//   --min-track-score <值>     模板匹配最低相关系数，默认0.5
+//   --max-frames <N>           最多处理的帧数，默认全部
+//   --seed <N>                 随机种子，使结果可复现
+//   --output <目录>            把应用了差异的帧写为PNG
+//   --output-every <N>         每隔多少帧写一帧，默认1（指定--output时）
+//
+// 视频文件通过cv::VideoCapture读取，需要OpenCV构建包含视频文件解码（FFmpeg/GStreamer）；
+// 不支持时可先用ffmpeg把视频拆成帧图像目录。结束时打印各阶段平均耗时和每帧总耗时的p50/p95/最大值，
+// 有帧处理失败时退出码为1。
+
+#include "diff_generator.h"
+#include "stream_session.h"
+#include "yolo_detector.h"
+
+#include <opencv2/core.hpp>
+#include <opencv2/imgcodecs.hpp>
+#include <opencv2/imgproc.hpp>
+#include <opencv2/videoio.hpp>
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+using namespace godot;
+namespace fs = std::filesystem;
+
+namespace {
+
+struct ReplayOptions {
+    fs::path input;
+    fs::path output_dir;
+    std::string model_path;
+    int diff_count = 7;
+    int difficulty = 5;
+    int detect_interval = 30;
+    float scene_threshold = 0.2f;
+    int search_margin = 24;
+    float min_track_score = 0.5f;
+    long max_frames = 0;
+    int output_every = 1;
+    uint32_t seed = 0;
+    bool has_seed = false;
+};
+
+double elapsed_ms(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+bool is_image_file(const fs::path& path) {
+    std::string extension = path.extension().string();
+    std::transform(extension.begin(), extension.end(), extension.begin(),
+                   [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+    return extension == ".jpg" || extension == ".jpeg" || extension == ".png" ||
+           extension == ".bmp" || extension == ".webp";
+}
+
+/**
+ * 帧来源：视频文件或帧图像目录，输出RGB帧（与Godot视频纹理转换为RGB8后的布局一致）
+ */
+class FrameSource {
+public:
+    bool open(const fs::path& path) {
+        if (fs::is_directory(path)) {
+            for (const auto& entry : fs::directory_iterator(path)) {
+                if (entry.is_regular_file() && is_image_file(entry.path())) {
+                    frame_files.push_back(entry.path());
+                }
+            }
+            std::sort(frame_files.begin(), frame_files.end());
+            return !frame_files.empty();
+        }
+        return capture.open(path.string());
+    }
+
+    bool read(cv::Mat& rgb) {
+        if (!frame_files.empty()) {
+            if (next_file >= frame_files.size()) {
+                return false;
+            }
+            bgr = cv::imread(frame_files[next_file++].string(), cv::IMREAD_COLOR);
+        } else if (!capture.read(bgr)) {
+            return false;
+        }
+        if (bgr.empty()) {
+            return false;
+        }
+        // 复用输出缓冲区，尺寸不变时不重新分配
+        cv::cvtColor(bgr, rgb, cv::COLOR_BGR2RGB);
+        return true;
+    }
+
+private:
+    cv::VideoCapture capture;
+    std::vector<fs::path> frame_files;
+    size_t next_file = 0;
+    cv::Mat bgr;
+};
+
+double percentile(std::vector<double> values, double p) {
+    if (values.empty()) {
+        return 0.0;
+    }
+    size_t index = static_cast<size_t>(p * (values.size() - 1) + 0.5);
+    std::nth_element(values.begin(), values.begin() + index, values.end());
+    return values[index];
+}
+
+void print_usage() {
+    std::cerr << "usage: diff_stream_replay --input <video|dir> [--model <tflite>] [--diff-count N] [--difficulty N]\n"
+                 "                          [--detect-interval N] [--scene-threshold R] [--search-margin PX]\n"
+                 "                          [--min-track-score S] [--max-frames N] [--seed N]\n"
+                 "                          [--output <dir>] [--output-every N]\n";
+}
+
+bool parse_options(int argc, char** argv, ReplayOptions& options) {
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (i + 1 >= argc) {
+            std::cerr << "missing value for " << arg << "\n";
+            return false;
+        }
+        const char* value = argv[++i];
+        if (arg == "--input") options.input = value;
+        else if (arg == "--output") options.output_dir = value;
+        else if (arg == "--model") options.model_path = value;
+        else if (arg == "--diff-count") options.diff_count = std::atoi(value);
+        else if (arg == "--difficulty") options.difficulty = std::atoi(value);
+        else if (arg == "--detect-interval") options.detect_interval = std::atoi(value);
+        else if (arg == "--scene-threshold") options.scene_threshold = static_cast<float>(std::atof(value));
+        else if (arg == "--search-margin") options.search_margin = std::atoi(value);
+        else if (arg == "--min-track-score") options.min_track_score = static_cast<float>(std::atof(value));
+        else if (arg == "--max-frames") options.max_frames = std::atol(value);
+        else if (arg == "--output-every") options.output_every = std::atoi(value);
+        else if (arg == "--seed") {
+            options.seed = static_cast<uint32_t>(std::strtoul(value, nullptr, 10));
+            options.has_seed = true;
+        } else {
+            std::cerr << "unknown option " << arg << "\n";
+            return false;
+        }
+    }
+
+    if (options.input.empty()) {
+        std::cerr << "--input is required\n";
+        return false;
+    }
+    options.diff_count = std::max(5, std::min(10, options.diff_count));
+    options.difficulty = std::max(1, std::min(10, options.difficulty));
+    options.search_margin = std::max(1, options.search_margin);
+    options.output_every = std::max(1, options.output_every);
+    return true;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    ReplayOptions options;
+    if (!parse_options(argc, argv, options)) {
+        print_usage();
+        return 2;
+    }
+
+    FrameSource source;
+    if (!source.open(options.input)) {
+        std::cerr << "cannot open " << options.input << " (no frames, or this OpenCV build cannot decode video files)\n";
+        return 1;
+    }
+    if (!options.output_dir.empty()) {
+        std::error_code error;
+        fs::create_directories(options.output_dir, error);
+        if (error) {
+            std::cerr << "cannot create " << options.output_dir << ": " << error.message() << "\n";
+            return 1;
+        }
+    }
+
+    std::unique_ptr<YoloDetector> detector;
+    if (!options.model_path.empty()) {
+        detector = std::make_unique<YoloDetector>();
+        if (!detector->initialize(options.model_path)) {
+            std::cerr << "failed to load model: " << options.model_path << "\n";
+            return 1;
+        }
+    }
+
+    DiffGenerator generator;
+    if (options.has_seed) {
+        generator.set_seed(options.seed);
+    }
+
+    cv::Mat detector_input;
+    StreamSession session(generator, [&](const cv::Mat& image, DetectionSet& detections) {
+        if (!detector || !YoloDetector::prepare_input(image, detector_input) || !detector->detect(detector_input)) {
+            return false;
+        }
+        detections = detector->get_detections();
+        return true;
+    });
+
+    StreamOptions stream_options = session.get_options();
+    stream_options.detect_interval = options.detect_interval;
+    stream_options.scene_change_threshold = options.scene_threshold;
+    stream_options.search_margin = options.search_margin;
+    stream_options.min_track_score = options.min_track_score;
+    session.set_options(stream_options);
+    session.start(options.diff_count, options.difficulty);
+
+    cv::Mat frame;
+    cv::Mat bgr;
+    std::vector<double> frame_ms;
+    double read_ms = 0.0, detect_ms = 0.0, track_ms = 0.0, apply_ms = 0.0;
+    long frames = 0, detections_run = 0, scene_changes = 0, lost_tracks = 0, failed = 0;
+
+    while (options.max_frames <= 0 || frames < options.max_frames) {
+        auto read_start = std::chrono::steady_clock::now();
+        if (!source.read(frame)) {
+            break;
+        }
+        read_ms += elapsed_ms(read_start);
+
+        auto frame_start = std::chrono::steady_clock::now();
+        StreamFrameStats stats;
+        if (!session.process_frame(frame, stats)) {
+            failed++;
+            frames++;
+            continue;
+        }
+        frame_ms.push_back(elapsed_ms(frame_start));
+
+        detect_ms += stats.detect_ms;
+        track_ms += stats.track_ms;
+        apply_ms += stats.apply_ms;
+        detections_run += stats.detected ? 1 : 0;
+        scene_changes += stats.scene_change ? 1 : 0;
+        lost_tracks += stats.lost_tracks;
+
+        if (!options.output_dir.empty() && frames % options.output_every == 0) {
+            char name[32];
+            std::snprintf(name, sizeof(name), "frame_%06ld.png", frames);
+            cv::cvtColor(frame, bgr, cv::COLOR_RGB2BGR);
+            cv::imwrite((options.output_dir / name).string(), bgr);
+        }
+        frames++;
+    }
+
+    if (frames == 0) {
+        std::cerr << "no frames read from " << options.input << "\n";
+        return 1;
+    }
+
+    double processed = std::max<size_t>(1, frame_ms.size());
+    std::printf("frames: %ld (failed %ld)\n", frames, failed);
+    std::printf("detections: %ld, scene changes: %ld, lost tracks: %ld\n", detections_run, scene_changes, lost_tracks);
+    std::printf("avg ms: read %.2f, detect %.2f, track %.2f, apply %.2f\n",
+                read_ms / frames, detect_ms / processed, track_ms / processed, apply_ms / processed);
+    std::printf("frame ms: p50 %.2f, p95 %.2f, max %.2f\n",
+                percentile(frame_ms, 0.5), percentile(frame_ms, 0.95),
+                frame_ms.empty() ? 0.0 : *std::max_element(frame_ms.begin(), frame_ms.end()));
+    return failed > 0 ? 1 : 0;
+}